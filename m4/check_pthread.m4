@@ -0,0 +1,71 @@
+# Determines the flags needed to build and link C code using POSIX
+# threads. Sets PTHREAD_CFLAGS and PTHREAD_LIBS.
+
+# Copying and distribution of this file, with or without modification, are
+# permitted in any medium without royalty provided the copyright notice
+# and this notice are preserved. This file is offered as-is, without any
+# warranty.
+
+m4_define([_CHECK_PTHREAD_testbody], [[
+  #include <pthread.h>
+
+  static void* f(void* p) { return p; }
+
+  int main() {
+    pthread_t t;
+    pthread_mutex_t m;
+    pthread_cond_t c;
+    pthread_mutex_init(&m, 0);
+    pthread_cond_init(&c, 0);
+    if (pthread_create(&t, 0, f, 0)) {
+      return 1;
+    }
+    return pthread_join(t, 0);
+  }
+]])
+
+AC_DEFUN([CHECK_PTHREAD], [
+
+  AC_LANG_PUSH(C)
+
+  PTHREAD_CFLAGS=
+  PTHREAD_LIBS=
+  check_pthread_save_CFLAGS="$CFLAGS"
+  check_pthread_save_LIBS="$LIBS"
+
+  AC_MSG_CHECKING([whether pthreads work with -pthread])
+  CFLAGS="$check_pthread_save_CFLAGS -pthread"
+  LIBS="$check_pthread_save_LIBS -pthread"
+  AC_LINK_IFELSE([AC_LANG_SOURCE([_CHECK_PTHREAD_testbody])],[
+      AC_MSG_RESULT([yes])
+      PTHREAD_CFLAGS="-pthread"
+      PTHREAD_LIBS="-pthread"
+    ],[
+      AC_MSG_RESULT([no])
+      AC_MSG_CHECKING([whether pthreads work with -lpthread])
+      CFLAGS="$check_pthread_save_CFLAGS"
+      LIBS="$check_pthread_save_LIBS -lpthread"
+      AC_LINK_IFELSE([AC_LANG_SOURCE([_CHECK_PTHREAD_testbody])],[
+          AC_MSG_RESULT([yes])
+          PTHREAD_LIBS="-lpthread"
+        ],[
+          AC_MSG_RESULT([no])
+          AC_MSG_CHECKING([whether pthreads work without flags])
+          LIBS="$check_pthread_save_LIBS"
+          AC_LINK_IFELSE([AC_LANG_SOURCE([_CHECK_PTHREAD_testbody])],[
+              AC_MSG_RESULT([yes])
+            ],[
+              AC_MSG_RESULT([no])
+              AC_MSG_FAILURE([cannot figure out how to use pthreads])
+            ])
+        ])
+    ])
+
+  CFLAGS="$check_pthread_save_CFLAGS"
+  LIBS="$check_pthread_save_LIBS"
+
+  AC_SUBST(PTHREAD_CFLAGS)
+  AC_SUBST(PTHREAD_LIBS)
+
+  AC_LANG_POP
+])
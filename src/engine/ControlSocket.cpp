@@ -506,9 +506,13 @@ void CControlSocket::OnTimer(fz::timer_id)
 	int const timeout = engine_.GetOptions().GetOptionVal(OPTION_TIMEOUT);
 	if (timeout > 0) {
 		fz::duration elapsed = fz::monotonic_clock::now() - m_lastActivity;
+		fz::duration limit = fz::duration::from_seconds(timeout);
+		if (!operations_.empty()) {
+			limit += operations_.back()->extraTimeout_;
+		}
 
 		if ((operations_.empty() || !operations_.back()->waitForAsyncRequest) && !opLockManager_.Waiting(this)) {
-			if (elapsed > fz::duration::from_seconds(timeout)) {
+			if (elapsed > limit) {
 				LogMessage(MessageType::Error, fztranslate("Connection timed out after %d second of inactivity", "Connection timed out after %d seconds of inactivity", timeout), timeout);
 				DoClose(FZ_REPLY_TIMEOUT);
 				return;
@@ -518,7 +522,7 @@ void CControlSocket::OnTimer(fz::timer_id)
 			elapsed = fz::duration();
 		}
 
-		m_timer = add_timer(fz::duration::from_milliseconds(timeout * 1000) - elapsed, true);
+		m_timer = add_timer(limit - elapsed, true);
 	}
 }
 
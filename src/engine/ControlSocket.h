@@ -41,6 +41,9 @@ public:
 	bool waitForAsyncRequest{};
 	OpLock opLock_;
 
+	// Added to the timeout while this is the current operation
+	fz::duration extraTimeout_;
+
 	wchar_t const* const name_;
 
 	MessageType sendLogLevel_{MessageType::Debug_Verbose};
@@ -71,6 +71,27 @@ int CSocketBackend::Read(void *buffer, unsigned int len, int& error)
 	return read;
 }
 
+int CSocketBackend::ReadTlsRecord(unsigned char& type, void *buffer, unsigned int len, int& error)
+{
+	int64_t max = GetAvailableBytes(CRateLimiter::inbound);
+	if (max == 0) {
+		Wait(CRateLimiter::inbound);
+		error = EAGAIN;
+		return -1;
+	}
+	else if (max > 0 && max < len) {
+		len = static_cast<unsigned int>(max);
+	}
+
+	int read = socket_.read_tls_record(type, buffer, len, error);
+
+	if (read > 0 && max != -1) {
+		UpdateUsage(CRateLimiter::inbound, read);
+	}
+
+	return read;
+}
+
 int CSocketBackend::Peek(void *buffer, unsigned int len, int& error)
 {
 	return socket_.peek(buffer, len, error);
@@ -37,6 +37,9 @@ public:
 	virtual int Peek(void *buffer, unsigned int size, int& error) override;
 	virtual int Write(const void *buffer, unsigned int size, int& error) override;
 
+	// Like Read, for sockets with kernel TLS for receiving
+	int ReadTlsRecord(unsigned char& type, void *buffer, unsigned int size, int& error);
+
 protected:
 	virtual void OnRateAvailable(CRateLimiter::rate_direction direction) override;
 
@@ -1,9 +1,11 @@
 #include <filezilla.h>
 #include "directorycache.h"
+#include "metrics.h"
 
 #include <assert.h>
 
-CDirectoryCache::CDirectoryCache()
+CDirectoryCache::CDirectoryCache(CMetrics & metrics)
+	: metrics_(metrics)
 {
 }
 
@@ -60,15 +62,18 @@ bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server,
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
+		metrics_.directoryCacheMisses_.Add();
 		return false;
 	}
 
 	tCacheIter iter;
 	if (Lookup(iter, sit, path, allowUnsureEntries, is_outdated)) {
+		metrics_.directoryCacheHits_.Add();
 		listing = iter->listing;
 		return true;
 	}
 
+	metrics_.directoryCacheMisses_.Add();
 	return false;
 }
 
@@ -18,6 +18,8 @@ version.
 
 #include <set>
 
+class CMetrics;
+
 class CDirectoryCache final
 {
 public:
@@ -28,7 +30,7 @@ public:
 		dir
 	};
 
-	CDirectoryCache();
+	explicit CDirectoryCache(CMetrics & metrics);
 	~CDirectoryCache();
 
 	CDirectoryCache(CDirectoryCache const&) = delete;
@@ -112,6 +114,8 @@ protected:
 	int64_t m_totalFileCount{};
 
 	fz::duration ttl_{fz::duration::from_seconds(600)};
+
+	CMetrics & metrics_;
 };
 
 #endif
@@ -708,7 +708,9 @@ CDirectoryListing CDirectoryListingParser::Parse(const CServerPath &path)
 	listing.path = path;
 	listing.m_firstListTime = fz::monotonic_clock::now();
 
-	if (!ParseData(false)) {
+	bool const parsed = ParseData(false);
+	parseTime_ += fz::monotonic_clock::now() - listing.m_firstListTime;
+	if (!parsed) {
 		listing.m_flags |= CDirectoryListing::listing_failed;
 		return listing;
 	}
@@ -2072,7 +2074,11 @@ bool CDirectoryListingParser::AddData(char *pData, int len)
 		return true;
 	}
 
-	return ParseData(true);
+	auto const start = fz::monotonic_clock::now();
+	bool const ret = ParseData(true);
+	parseTime_ += fz::monotonic_clock::now() - start;
+
+	return ret;
 }
 
 bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name, fz::datetime const& time)
@@ -2084,8 +2090,38 @@ bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name
 	CDirentry override;
 	override.name = std::move(name);
 	override.time = time;
+	auto const start = fz::monotonic_clock::now();
 	CLine l(std::move(line));
 	ParseLine(l, m_server.GetType(), true, &override);
+	parseTime_ += fz::monotonic_clock::now() - start;
+
+	return true;
+}
+
+bool CDirectoryListingParser::AddEntry(std::wstring const& line, CDirentry && entry, std::wstring const& permissions, std::wstring const& ownerGroup)
+{
+	if (m_pControlSocket) {
+		m_pControlSocket->LogMessageRaw(MessageType::RawList, line);
+	}
+
+	m_maybeMultilineVms = false;
+	m_fileList.clear();
+	m_fileListOnly = false;
+
+	// Don't add . or ..
+	if (entry.name.empty() || entry.name == L"." || entry.name == L"..") {
+		return true;
+	}
+
+	entry.permissions = objcache.get(permissions);
+	entry.ownerGroup = objcache.get(ownerGroup);
+
+	auto const timezoneOffset = m_server.GetTimezoneOffset();
+	if (timezoneOffset) {
+		entry.time += fz::duration::from_minutes(timezoneOffset);
+	}
+
+	entries_.emplace_back(std::move(entry));
 
 	return true;
 }
@@ -2920,6 +2956,7 @@ void CDirectoryListingParser::Reset()
 	m_currentOffset = 0;
 	m_fileListOnly = true;
 	m_maybeMultilineVms = false;
+	parseTime_ = fz::duration();
 }
 
 bool CDirectoryListingParser::ParseAsZVM(CLine &line, CDirentry &entry)
@@ -61,12 +61,19 @@ public:
 	bool AddData(char *pData, int len);
 	bool AddLine(std::wstring && line, std::wstring && name, fz::datetime const& time);
 
+	// For entries whose details are already known, e.g. from SFTP attributes.
+	// The line is only logged.
+	bool AddEntry(std::wstring const& line, CDirentry && entry, std::wstring const& permissions, std::wstring const& ownerGroup);
+
 	void Reset();
 
 	void SetTimezoneOffset(fz::duration const& span) { m_timezoneOffset = span; }
 
 	void SetServer(const CServer& server) { m_server = server; };
 
+	// Total time spent parsing since construction or the last Reset
+	fz::duration GetParseTime() const { return parseTime_; }
+
 protected:
 	CLine *GetLine(bool breakAtEnd, bool& error);
 
@@ -143,6 +150,8 @@ protected:
 	fz::duration m_timezoneOffset;
 
 	listingEncoding::type m_listingEncoding;
+
+	fz::duration parseTime_;
 };
 
 #endif
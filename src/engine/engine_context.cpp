@@ -3,10 +3,14 @@
 
 #include "directorycache.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "oplock_manager.h"
 #include "pathcache.h"
 #include "ratelimiter.h"
+#include "sftp/process_pool.h"
+#include "tls_session_cache.h"
 #include "tls_system_trust_store.h"
+#include "trace_writer.h"
 
 #include <libfilezilla/event_loop.hpp>
 #include <libfilezilla/thread_pool.hpp>
@@ -48,9 +52,14 @@ class CFileZillaEngineContext::Impl final
 {
 public:
 	Impl(COptionsBase& options)
-		: limiter_(loop_, options)
+		: limiter_(loop_, options, metrics_)
+		, directory_cache_(metrics_)
+		, path_cache_(metrics_)
 		, optionChangeHandler_(options, loop_)
 		, tlsSystemTrustStore_(pool_)
+		, sftpProcessPool_(pool_)
+		, traceWriter_(fz::to_native(options.GetOption(OPTION_TRACE_FILE)))
+		, metricsWriter_(metrics_, options, loop_)
 	{
 		CLogging::UpdateLogLevel(options);
 
@@ -64,12 +73,17 @@ public:
 
 	fz::thread_pool pool_;
 	fz::event_loop loop_;
+	CMetrics metrics_;
 	CRateLimiter limiter_;
 	CDirectoryCache directory_cache_;
 	CPathCache path_cache_;
 	CLoggingOptionsChanged optionChangeHandler_;
 	OpLockManager opLockManager_;
 	TlsSystemTrustStore tlsSystemTrustStore_;
+	TlsSessionCache tlsSessionCache_;
+	CSftpProcessPool sftpProcessPool_;
+	CTraceWriter traceWriter_;
+	CMetricsWriter metricsWriter_;
 };
 
 CFileZillaEngineContext::CFileZillaEngineContext(COptionsBase & options, CustomEncodingConverterBase const& customEncodingConverter)
@@ -117,3 +131,28 @@ TlsSystemTrustStore& CFileZillaEngineContext::GetTlsSystemTrustStore()
 {
 	return impl_->tlsSystemTrustStore_;
 }
+
+TlsSessionCache& CFileZillaEngineContext::GetTlsSessionCache()
+{
+	return impl_->tlsSessionCache_;
+}
+
+CSftpProcessPool& CFileZillaEngineContext::GetSftpProcessPool()
+{
+	return impl_->sftpProcessPool_;
+}
+
+CTraceWriter& CFileZillaEngineContext::GetTraceWriter()
+{
+	return impl_->traceWriter_;
+}
+
+CMetrics& CFileZillaEngineContext::GetMetrics()
+{
+	return impl_->metrics_;
+}
+
+CMetricsWriter& CFileZillaEngineContext::GetMetricsWriter()
+{
+	return impl_->metricsWriter_;
+}
@@ -5,9 +5,11 @@
 #include "ftp/ftpcontrolsocket.h"
 #include "http/httpcontrolsocket.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "pathcache.h"
 #include "ratelimiter.h"
 #include "sftp/sftpcontrolsocket.h"
+#include "trace_writer.h"
 #if ENABLE_STORJ
 #include "storj/storjcontrolsocket.h"
 #endif
@@ -45,6 +47,7 @@ CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& contex
 	, path_cache_(context.GetPathCache())
 	, parent_(parent)
 	, thread_pool_(context.GetThreadPool())
+	, trace_writer_(context.GetTraceWriter())
 	, encoding_converter_(context.GetCustomEncodingConverter())
 	, context_(context)
 {
@@ -261,6 +264,14 @@ int CFileZillaEnginePrivate::ResetOperation(int nErrorCode)
 			}
 		}
 
+		Trace(trace_event::operation_end, static_cast<int>(m_pCurrentCommand->GetId()), nErrorCode);
+
+		// The metrics writer has no log of its own, the next engine to finish an operation reports its failure.
+		std::wstring const metricsError = context_.GetMetricsWriter().TakeError();
+		if (!metricsError.empty()) {
+			m_pLogging->LogMessageRaw(MessageType::Error, metricsError);
+		}
+
 		if (!m_bIsInCommand) {
 			COperationNotification *notification = new COperationNotification();
 			notification->nReplyCode = nErrorCode;
@@ -634,6 +645,8 @@ void CFileZillaEnginePrivate::OnCommandEvent()
 		CCommand & command = *m_pCurrentCommand;
 		Command id = command.GetId();
 
+		Trace(trace_event::operation_start, static_cast<int>(id));
+
 		int res = CheckCommandPreconditions(command, false);
 		if (res == FZ_REPLY_OK) {
 			switch (command.GetId())
@@ -722,6 +735,7 @@ void CFileZillaEnginePrivate::DoCancel()
 		m_retryTimer = 0;
 
 		m_pLogging->LogMessage(MessageType::Error, _("Connection attempt interrupted by user"));
+		Trace(trace_event::operation_end, static_cast<int>(Command::connect), FZ_REPLY_DISCONNECTED | FZ_REPLY_CANCELED);
 		COperationNotification *notification = new COperationNotification();
 		notification->nReplyCode = FZ_REPLY_DISCONNECTED | FZ_REPLY_CANCELED;
 		notification->commandId = Command::connect;
@@ -848,6 +862,11 @@ CTransferStatus CFileZillaEnginePrivate::GetTransferStatus(bool &changed)
 	return transfer_status_.Get(changed);
 }
 
+void CFileZillaEnginePrivate::Trace(trace_event event, int op, int reply, int64_t bytes, int64_t value)
+{
+	trace_writer_.Record(m_engine_id, event, op, reply, bytes, value);
+}
+
 int CFileZillaEnginePrivate::CacheLookup(const CServerPath& path, CDirectoryListing& listing)
 {
 	// TODO: Possible optimization: Atomically get current server. The cache has its own mutex.
@@ -900,6 +919,18 @@ void CTransferStatusManager::Reset()
 {
 	{
 		fz::scoped_lock lock(mutex_);
+		if (status_) {
+			status_.currentOffset += currentOffset_.exchange(0);
+			int64_t const transferred = status_.currentOffset - status_.startOffset;
+			engine_.Trace(trace_event::transfer_end, static_cast<int>(status_.list ? Command::list : Command::transfer), 0, transferred);
+
+			CMetrics & metrics = engine_.GetContext().GetMetrics();
+			metrics.activeTransfers_.Add(-1);
+			auto const elapsed = fz::monotonic_clock::now() - start_;
+			if (transferred > 0 && elapsed.get_microseconds() > 0) {
+				metrics.transferRate_.Observe(transferred * 1000000.0 / elapsed.get_microseconds());
+			}
+		}
 		status_.clear();
 		send_state_ = 0;
 	}
@@ -914,8 +945,15 @@ void CTransferStatusManager::Init(int64_t totalSize, int64_t startOffset, bool l
 		startOffset = 0;
 	}
 
+	if (!status_) {
+		engine_.GetContext().GetMetrics().activeTransfers_.Add(1);
+	}
+	start_ = fz::monotonic_clock::now();
+
 	status_ = CTransferStatus(totalSize, startOffset, list);
 	currentOffset_ = 0;
+
+	engine_.Trace(trace_event::transfer_start, static_cast<int>(list ? Command::list : Command::transfer), 0, totalSize, startOffset);
 }
 
 void CTransferStatusManager::SetStartTime()
@@ -943,6 +981,8 @@ void CTransferStatusManager::Update(int64_t transferredBytes)
 	CNotification* notification = nullptr;
 
 	{
+		engine_.GetContext().GetMetrics().transferredBytes_.Add(transferredBytes);
+
 		int64_t oldOffset = currentOffset_.fetch_add(transferredBytes);
 		if (!oldOffset) {
 			fz::scoped_lock lock(mutex_);
@@ -953,6 +993,9 @@ void CTransferStatusManager::Update(int64_t transferredBytes)
 			if (!send_state_) {
 				status_.currentOffset += currentOffset_.exchange(0);
 				notification = new CTransferStatusNotification(status_);
+
+				// Throttled the same way as the notifications
+				engine_.Trace(trace_event::transfer_progress, static_cast<int>(status_.list ? Command::list : Command::transfer), 0, status_.currentOffset - status_.startOffset);
 			}
 			send_state_ = 2;
 		}
@@ -9,12 +9,14 @@
 #include "engine_context.h"
 #include "FileZillaEngine.h"
 #include "option_change_event_handler.h"
+#include "trace_format.h"
 
 #include <atomic>
 
 class CControlSocket;
 class CLogging;
 class CRateLimiter;
+class CTraceWriter;
 class OpLockManager;
 
 enum EngineNotificationType
@@ -50,6 +52,9 @@ protected:
 	std::atomic<int64_t> currentOffset_{};
 	int send_state_{};
 
+	// For the transfer rate metric
+	fz::monotonic_clock start_;
+
 	CFileZillaEnginePrivate& engine_;
 };
 
@@ -104,6 +109,9 @@ public:
 
 	unsigned int GetEngineId() const { return m_engine_id; }
 
+	// Adds a record to the binary trace, does nothing unless tracing is enabled.
+	void Trace(trace_event event, int op, int reply = 0, int64_t bytes = 0, int64_t value = 0);
+
 	CTransferStatusManager transfer_status_;
 
 	CustomEncodingConverterBase const& GetEncodingConverter() const { return encoding_converter_; }
@@ -209,6 +217,8 @@ protected:
 
 	fz::thread_pool & thread_pool_;
 
+	CTraceWriter & trace_writer_;
+
 	CustomEncodingConverterBase const& encoding_converter_;
 
 	CFileZillaEngineContext& context_;
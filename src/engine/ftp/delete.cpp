@@ -18,6 +18,11 @@ int CFtpDeleteOpData::Send()
 		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == del_del) {
+		if (files_.empty() || sent_.size() >= pipelineDepth_) {
+			// Wait for replies to outstanding commands
+			return FZ_REPLY_WOULDBLOCK;
+		}
+
 		std::wstring const& file = files_.front();
 		if (file.empty()) {
 			LogMessage(MessageType::Debug_Info, L"Empty filename");
@@ -32,7 +37,19 @@ int CFtpDeleteOpData::Send()
 
 		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
 
-		return controlSocket_.SendCommand(L"DELE " + filename);
+		int res = controlSocket_.SendCommand(L"DELE " + filename);
+		if (res != FZ_REPLY_WOULDBLOCK) {
+			return res;
+		}
+
+		sent_.emplace_back(std::move(files_.front()));
+		files_.pop_front();
+
+		if (!files_.empty() && sent_.size() < pipelineDepth_) {
+			// Replies arrive in order, so we can keep sending without waiting
+			return FZ_REPLY_CONTINUE;
+		}
+		return FZ_REPLY_WOULDBLOCK;
 	}
 
 	LogMessage(MessageType::Debug_Warning, L"Unkown op state %d", opState);
@@ -41,12 +58,17 @@ int CFtpDeleteOpData::Send()
 
 int CFtpDeleteOpData::ParseResponse()
 {
+	if (sent_.empty()) {
+		LogMessage(MessageType::Debug_Warning, L"Reply received without outstanding command");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
 	int code = controlSocket_.GetReplyCode();
 	if (code != 2 && code != 3) {
 		deleteFailed_ = true;
 	}
 	else {
-		std::wstring const& file = files_.front();
+		std::wstring const& file = sent_.front();
 
 		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
 
@@ -61,11 +83,15 @@ int CFtpDeleteOpData::ParseResponse()
 		}
 	}
 
-	files_.pop_front();
+	sent_.pop_front();
 
 	if (!files_.empty()) {
 		return FZ_REPLY_CONTINUE;
 	}
+	if (!sent_.empty()) {
+		// Nothing left to send, wait for the remaining replies
+		return FZ_REPLY_WOULDBLOCK;
+	}
 
 	return deleteFailed_ ? FZ_REPLY_ERROR : FZ_REPLY_OK;
 }
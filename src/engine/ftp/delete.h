@@ -19,7 +19,16 @@ public:
 	virtual int Reset(int result) override;
 
 	CServerPath path_;
+
+	// Files not yet sent to the server
 	std::deque<std::wstring> files_;
+
+	// Files for which DELE has been sent, in order, awaiting reply
+	std::deque<std::wstring> sent_;
+
+	// Maximum number of DELE commands awaiting reply at any time
+	size_t pipelineDepth_{1};
+
 	bool omitPath_{};
 
 	// Set to fz::monotonic_clock::now initially and after
@@ -8,6 +8,25 @@
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/local_filesys.hpp>
 
+namespace {
+// Already compressed data only gets bigger when deflated again
+bool IsCompressedFile(std::wstring const& name, std::wstring const& extensions)
+{
+	size_t const pos = name.rfind('.');
+	if (pos == std::wstring::npos || pos + 1 == name.size()) {
+		return false;
+	}
+
+	std::wstring const ext = fz::str_tolower_ascii(name.substr(pos + 1));
+	for (auto const& token : fz::strtok(extensions, L"|")) {
+		if (fz::str_tolower_ascii(token) == ext) {
+			return true;
+		}
+	}
+	return false;
+}
+}
+
 CFtpFileTransferOpData::CFtpFileTransferOpData(CFtpControlSocket& controlSocket, bool is_download, std::wstring const& local_file, std::wstring const& remote_file, CServerPath const& remote_path, CFileTransferCommand::t_transferSettings const& settings)
 	: CFileTransferOpData(L"CFtpFileTransferOpData", is_download, local_file, remote_file, remote_path, settings)
 	, CFtpOpData(controlSocket)
@@ -194,6 +213,9 @@ int CFtpFileTransferOpData::Send()
 				engine_.transfer_status_.Init(len, startOffset, false);
 			}
 			ioThread_ = std::make_unique<CIOThread>();
+			SelectHash();
+			ioThread_->SetHash(hash_);
+			ioThread_->SetMetrics(engine_.GetContext().GetMetrics());
 			if (!ioThread_->Create(engine_.GetThreadPool(), std::move(pFile), !download_, binary)) {
 				// CIOThread will delete pFile
 				ioThread_.reset();
@@ -204,6 +226,7 @@ int CFtpFileTransferOpData::Send()
 
 		controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, download_ ? TransferMode::download : TransferMode::upload);
 		controlSocket_.m_pTransferSocket->m_binaryMode = transferSettings_.binary;
+		compressible = !IsCompressedFile(remoteFile_, engine_.GetOptions().GetOption(OPTION_FTP_MODEZ_SKIP_EXTENSIONS));
 		controlSocket_.m_pTransferSocket->SetIOThread(ioThread_.get());
 
 		if (download_) {
@@ -236,6 +259,15 @@ int CFtpFileTransferOpData::Send()
 
 		break;
 	}
+	case filetransfer_hashopts:
+		cmd = L"OPTS HASH " + hashAlgorithm_;
+		break;
+	case filetransfer_hash:
+		cmd = hashCommand_ + L" " + remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_);
+
+		// The server reads the whole file before replying. Allow for a slow disk.
+		extraTimeout_ = fz::duration::from_seconds(std::max(localFileSize_, remoteFileSize_) / (10 * 1024 * 1024));
+		break;
 	default:
 		LogMessage(MessageType::Debug_Warning, L"Unhandled opState: %d", opState);
 		return FZ_REPLY_ERROR;
@@ -248,6 +280,137 @@ int CFtpFileTransferOpData::Send()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+int CFtpFileTransferOpData::TransferFinished(int prevResult)
+{
+	if (prevResult == FZ_REPLY_OK && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (!download_ &&
+			CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
+		{
+			fz::datetime mtime = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
+			if (!mtime.empty()) {
+				fileTime_ = mtime;
+				opState = filetransfer_mfmt;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+		else if (download_ && !fileTime_.empty()) {
+			ioThread_.reset();
+			if (!fz::local_filesys::set_modification_time(fz::to_native(localFile_), fileTime_)) {
+				LogMessage(MessageType::Debug_Warning, L"Could not set modification time");
+			}
+		}
+	}
+	return prevResult;
+}
+
+void CFtpFileTransferOpData::SelectHash()
+{
+	hash_ = TransferHash::none;
+	hashCommand_.clear();
+	hashAlgorithm_.clear();
+
+	if (!engine_.GetOptions().GetOptionVal(OPTION_FTP_VERIFY_HASH) || !transferSettings_.binary || resume_) {
+		return;
+	}
+
+	std::wstring option;
+	if (CServerCapabilities::GetCapability(currentServer_, hash_command, &option) == yes) {
+		hashCommand_ = L"HASH";
+		hashAlgorithm_ = option;
+	}
+	else if (CServerCapabilities::GetCapability(currentServer_, xhash_command, &option) == yes) {
+		hashCommand_ = option;
+	}
+	else {
+		return;
+	}
+
+	if (option == L"SHA-256" || option == L"XSHA256") {
+		hash_ = TransferHash::sha256;
+	}
+	else if (option == L"SHA-1" || option == L"XSHA1") {
+		hash_ = TransferHash::sha1;
+	}
+	else if (option == L"MD5" || option == L"XMD5") {
+		hash_ = TransferHash::md5;
+	}
+	else if (option == L"CRC32" || option == L"XCRC") {
+		hash_ = TransferHash::crc32;
+	}
+}
+
+int CFtpFileTransferOpData::VerifyHash()
+{
+	int const code = controlSocket_.GetReplyCode();
+	if (code != 2) {
+		LogMessage(MessageType::Status, _("Server could not compute hash of file, skipping verification"));
+		return TransferFinished(FZ_REPLY_OK);
+	}
+
+	std::wstring const local = ioThread_ ? ioThread_->GetHash() : std::wstring();
+	if (local.empty()) {
+		return TransferFinished(FZ_REPLY_OK);
+	}
+
+	std::wstring const remote = ParseHashReply(controlSocket_.m_Response, hashCommand_, hashAlgorithm_, local.size());
+	if (remote.empty()) {
+		LogMessage(MessageType::Status, _("Could not parse hash reply, skipping verification"));
+		return TransferFinished(FZ_REPLY_OK);
+	}
+
+	std::wstring const name = hashAlgorithm_.empty() ? hashCommand_ : hashAlgorithm_;
+	if (remote != local) {
+		LogMessage(MessageType::Error, _("File hash mismatch: %s of local file is %s, server reports %s"), name, local, remote);
+		return FZ_REPLY_ERROR;
+	}
+
+	LogMessage(MessageType::Status, _("File hash verified: %s %s"), name, local);
+
+	auto notification = new CTransferHashNotification;
+	notification->algorithm = name;
+	notification->hash = local;
+	engine_.AddNotification(notification);
+
+	return TransferFinished(FZ_REPLY_OK);
+}
+
+std::wstring ParseHashReply(std::wstring const& reply, std::wstring const& command, std::wstring const& algorithm, size_t length)
+{
+	auto const tokens = fz::strtok(reply, L" ");
+
+	// HASH replies have the form "213 <algorithm> <range> <digest> <filename>".
+	// Replies to the X commands are "250 <digest>", some servers repeat the
+	// command name in front of the digest.
+	std::wstring token;
+	if (command == L"HASH") {
+		if (tokens.size() < 4 || fz::str_tolower_ascii(tokens[1]) != fz::str_tolower_ascii(algorithm)) {
+			return std::wstring();
+		}
+		token = tokens[3];
+	}
+	else if (tokens.size() >= 2) {
+		if (fz::str_tolower_ascii(tokens[1]) != fz::str_tolower_ascii(command)) {
+			token = tokens[1];
+		}
+		else if (tokens.size() >= 3) {
+			token = tokens[2];
+		}
+	}
+
+	bool const crc = algorithm == L"CRC32" || command == L"XCRC";
+	if (token.empty() || token.size() > length || (!crc && token.size() != length)) {
+		return std::wstring();
+	}
+
+	for (auto const& c : token) {
+		if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+			return std::wstring();
+		}
+	}
+
+	return std::wstring(length - token.size(), '0') + fz::str_tolower_ascii(token);
+}
+
 int CFtpFileTransferOpData::TestResumeCapability()
 {
 	LogMessage(MessageType::Debug_Verbose, L"CFtpFileTransferOpData::TestResumeCapability()");
@@ -283,6 +446,7 @@ int CFtpFileTransferOpData::TestResumeCapability()
 					resumeOffset = remoteFileSize_ - 1;
 
 					controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, TransferMode::resumetest);
+					compressible = false;
 
 					controlSocket_.Transfer(L"RETR " + remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_), this);
 					return FZ_REPLY_CONTINUE;
@@ -366,6 +530,18 @@ int CFtpFileTransferOpData::ParseResponse()
 		break;
 	case filetransfer_mfmt:
 		return FZ_REPLY_OK;
+	case filetransfer_hashopts:
+		if (code != 2) {
+			LogMessage(MessageType::Status, _("Server does not support the %s hash algorithm, skipping verification"), hashAlgorithm_);
+			CServerCapabilities::SetCapability(currentServer_, hash_command, no);
+			return TransferFinished(FZ_REPLY_OK);
+		}
+		controlSocket_.m_hashAlgorithm = hashAlgorithm_;
+		opState = filetransfer_hash;
+		break;
+	case filetransfer_hash:
+		extraTimeout_ = fz::duration();
+		return VerifyHash();
 	default:
 		LogMessage(MessageType::Debug_Warning, L"Unknown op state");
 		return FZ_REPLY_INTERNALERROR;
@@ -491,25 +667,16 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		}
 	}
 	else if (opState == filetransfer_waittransfer) {
-		if (prevResult == FZ_REPLY_OK && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (!download_ &&
-				CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
-			{
-				fz::datetime mtime = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
-				if (!mtime.empty()) {
-					fileTime_ = mtime;
-					opState = filetransfer_mfmt;
-					return FZ_REPLY_CONTINUE;
-				}
+		if (prevResult == FZ_REPLY_OK && hash_ != TransferHash::none) {
+			if (hashCommand_ == L"HASH" && controlSocket_.m_hashAlgorithm != hashAlgorithm_) {
+				opState = filetransfer_hashopts;
 			}
-			else if (download_ && !fileTime_.empty()) {
-				ioThread_.reset();
-				if (!fz::local_filesys::set_modification_time(fz::to_native(localFile_), fileTime_)) {
-					LogMessage(MessageType::Debug_Warning, L"Could not set modification time");
-				}
+			else {
+				opState = filetransfer_hash;
 			}
+			return FZ_REPLY_CONTINUE;
 		}
-		return prevResult;
+		return TransferFinished(prevResult);
 	}
 	else if (opState == filetransfer_waitresumetest) {
 		if (prevResult != FZ_REPLY_OK) {
@@ -16,9 +16,17 @@ enum filetransferStates
 	filetransfer_transfer,
 	filetransfer_waittransfer,
 	filetransfer_waitresumetest,
-	filetransfer_mfmt
+	filetransfer_mfmt,
+	filetransfer_hashopts,
+	filetransfer_hash
 };
 
+// Extracts the digest from the reply to a HASH command or to one of the
+// XSHA256, XSHA1, XMD5 and XCRC commands. The digest must consist of
+// exactly length hex digits, CRC32 values may lack leading zeroes.
+// Returns the lowercase digest, or an empty string if there is none.
+std::wstring ParseHashReply(std::wstring const& reply, std::wstring const& command, std::wstring const& algorithm, size_t length);
+
 class CFtpFileTransferOpData final : public CFileTransferOpData, public CFtpTransferOpData, public CFtpOpData
 {
 public:
@@ -30,8 +38,19 @@ public:
 
 	int TestResumeCapability();
 
+	// Sets timestamps if needed once the file has been transferred
+	int TransferFinished(int prevResult);
+
+	void SelectHash();
+	int VerifyHash();
+
 	std::unique_ptr<CIOThread> ioThread_;
 	bool fileDidExist_{true};
+
+	// Hash computed by the IO thread, compared against the server's
+	TransferHash hash_{TransferHash::none};
+	std::wstring hashCommand_;
+	std::wstring hashAlgorithm_;
 };
 
 #endif
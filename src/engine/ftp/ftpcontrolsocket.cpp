@@ -12,6 +12,7 @@
 #include "iothread.h"
 #include "list.h"
 #include "logon.h"
+#include "metrics.h"
 #include "mkd.h"
 #include "pathcache.h"
 #include "proxy.h"
@@ -116,7 +117,11 @@ void CFtpControlSocket::OnReceive()
 
 void CFtpControlSocket::ParseLine(std::wstring line)
 {
-	m_rtt.Stop();
+	fz::duration rtt;
+	if (m_rtt.Stop(&rtt)) {
+		engine_.GetContext().GetMetrics().controlRtt_.Observe(rtt.get_microseconds() / 1000000.0);
+	}
+
 	LogMessageRaw(MessageType::Response, line);
 	SetAlive();
 
@@ -179,6 +184,10 @@ void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
 
+	// Servers start out in stream mode
+	m_lastModeZ = 0;
+	m_hashAlgorithm.clear();
+
 	SetAlive();
 
 	if (currentServer_.GetProtocol() == FTPS) {
@@ -217,6 +226,10 @@ void CFtpControlSocket::OnConnect()
 	}
 	m_pendingReplies = 1;
 	m_repliesToSkip = 0;
+
+	commandTimes_.clear();
+	commandTimes_.push_back(fz::monotonic_clock::now());
+	preliminaryReply_ = false;
 }
 
 void CFtpControlSocket::ParseResponse()
@@ -226,9 +239,23 @@ void CFtpControlSocket::ParseResponse()
 		return;
 	}
 
-	if (m_Response[0] != '1') {
+	// Only the first reply to a command gets timed. A final reply
+	// following a preliminary one waited for the data transfer.
+	int64_t latency = -1;
+	if (!commandTimes_.empty() && !preliminaryReply_) {
+		latency = (fz::monotonic_clock::now() - commandTimes_.front()).get_microseconds();
+	}
+
+	if (m_Response[0] == '1') {
+		preliminaryReply_ = true;
+	}
+	else {
 		if (m_pendingReplies > 0) {
 			m_pendingReplies--;
+			if (!commandTimes_.empty()) {
+				commandTimes_.pop_front();
+			}
+			preliminaryReply_ = false;
 		}
 		else {
 			LogMessage(MessageType::Debug_Warning, L"Unexpected reply, no reply was pending.");
@@ -236,6 +263,9 @@ void CFtpControlSocket::ParseResponse()
 		}
 	}
 
+	engine_.Trace(trace_event::reply_received, static_cast<int>(operations_.empty() ? Command::none : operations_.back()->opId),
+		fz::to_integral<int>(m_Response.substr(0, 3)), 0, latency);
+
 	if (m_repliesToSkip) {
 		LogMessage(MessageType::Debug_Info, L"Skipping reply after cancelled operation or keepalive command.");
 		if (m_Response[0] != '1') {
@@ -315,6 +345,9 @@ int CFtpControlSocket::SendCommand(std::wstring const& str, bool maskArgs, bool
 	bool res = CRealControlSocket::Send(buffer.c_str(), buffer.size());
 	if (res) {
 		++m_pendingReplies;
+		commandTimes_.push_back(fz::monotonic_clock::now());
+
+		engine_.Trace(trace_event::command_sent, static_cast<int>(operations_.empty() ? Command::none : operations_.back()->opId), 0, static_cast<int64_t>(buffer.size()));
 	}
 
 	if (measureRTT) {
@@ -589,6 +622,7 @@ void CFtpControlSocket::Delete(CServerPath const& path, std::deque<std::wstring>
 	pData->path_ = path;
 	pData->files_ = std::move(files);
 	pData->omitPath_ = true;
+	pData->pipelineDepth_ = static_cast<size_t>(std::max(1, engine_.GetOptions().GetOptionVal(OPTION_FTP_PIPELINE_DEPTH)));
 
 	Push(std::move(pData));
 }
@@ -753,10 +787,14 @@ void CFtpControlSocket::Transfer(std::wstring const& cmd, CFtpTransferOpData* ol
 		}
 	}
 
+	pData->modeZ_ = pData->pOldData->compressible &&
+		engine_.GetOptions().GetOptionVal(OPTION_FTP_MODEZ_LEVEL) > 0 &&
+		CServerCapabilities::GetCapability(currentServer_, mode_z_support) == yes;
+
 	if ((pData->pOldData->binary && m_lastTypeBinary == 1) ||
 		(!pData->pOldData->binary && m_lastTypeBinary == 0))
 	{
-		pData->opState = rawtransfer_port_pasv;
+		pData->opState = pData->NextStateAfterType();
 	}
 	else {
 		pData->opState = rawtransfer_type;
@@ -6,6 +6,7 @@
 #include "externalipresolver.h"
 #include "rtt.h"
 
+#include <deque>
 #include <regex>
 
 namespace PrivCommand {
@@ -91,12 +92,22 @@ protected:
 
 	int m_pendingReplies{1};
 
+	// When the commands still waiting for their replies have been sent, for tracing
+	std::deque<fz::monotonic_clock> commandTimes_;
+
+	// Whether the oldest command waiting for its final reply already got a 1yz reply
+	bool preliminaryReply_{};
+
 	std::unique_ptr<CExternalIPResolver> m_pIPResolver;
 
 	CTlsSocket* m_pTlsSocket{};
 	bool m_protectDataChannel{};
 
 	int m_lastTypeBinary{-1};
+	int m_lastModeZ{-1};
+
+	// Algorithm selected with OPTS HASH on this connection
+	std::wstring m_hashAlgorithm;
 
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
@@ -140,6 +151,9 @@ public:
 
 	int64_t resumeOffset{};
 	bool binary{true};
+
+	// Whether MODE Z may be used for the data connection
+	bool compressible{true};
 };
 
 #endif
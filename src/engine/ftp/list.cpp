@@ -1,6 +1,7 @@
 #include <filezilla.h>
 
 #include "../directorycache.h"
+#include "../metrics.h"
 #include "../servercapabilities.h"
 #include "list.h"
 #include "transfersocket.h"
@@ -214,6 +215,7 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 	else if (opState == list_waittransfer) {
 		if (prevResult == FZ_REPLY_OK) {
 			CDirectoryListing listing = listing_parser_->Parse(currentPath_);
+			engine_.GetContext().GetMetrics().listingParseTime_.Observe(listing_parser_->GetParseTime());
 
 			if (viewHiddenCheck_) {
 				if (!viewHidden_) {
@@ -766,6 +766,21 @@ bool HasFeature(std::wstring const& line, std::wstring const& feature)
 	}
 	return line.size() > feature.size() && line.substr(0, feature.size()) == feature && line[feature.size()] == ' ';
 }
+
+// Strongest first
+wchar_t const* const hash_algorithms[] = { L"SHA-256", L"SHA-1", L"MD5", L"CRC32" };
+wchar_t const* const xhash_commands[] = { L"XSHA256", L"XSHA1", L"XMD5", L"XCRC" };
+
+template<size_t N>
+size_t HashRank(std::wstring const& name, wchar_t const* const (&names)[N])
+{
+	for (size_t i = 0; i < N; ++i) {
+		if (name == names[i]) {
+			return i;
+		}
+	}
+	return N;
+}
 }
 
 void CFtpLogonOpData::ParseFeat(std::wstring line)
@@ -832,4 +847,24 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 	else if (HasFeature(up, L"EPSV")) {
 		CServerCapabilities::SetCapability(currentServer_, epsv_command, yes);
 	}
+	else if (HasFeature(up, L"HASH")) {
+		// Algorithms are separated by semicolons, the currently selected one is marked with an asterisk
+		std::wstring best;
+		for (auto algorithm : fz::strtok(up.substr(4), L"; ")) {
+			fz::replace_substrings(algorithm, L"*", L"");
+			if (HashRank(algorithm, hash_algorithms) < HashRank(best, hash_algorithms)) {
+				best = algorithm;
+			}
+		}
+		if (!best.empty()) {
+			CServerCapabilities::SetCapability(currentServer_, hash_command, yes, best);
+		}
+	}
+	else if (HasFeature(up, L"XSHA256") || HasFeature(up, L"XSHA1") || HasFeature(up, L"XMD5") || HasFeature(up, L"XCRC")) {
+		std::wstring const command = up.substr(0, up.find(' '));
+		std::wstring current;
+		if (CServerCapabilities::GetCapability(currentServer_, xhash_command, &current) != yes || HashRank(command, xhash_commands) < HashRank(current, xhash_commands)) {
+			CServerCapabilities::SetCapability(currentServer_, xhash_command, yes, command);
+		}
+	}
 }
@@ -22,10 +22,28 @@ int CFtpRawTransferOpData::ParseResponse()
 			error = true;
 		}
 		else {
-			opState = rawtransfer_port_pasv;
+			opState = NextStateAfterType();
 			controlSocket_.m_lastTypeBinary = pOldData->binary ? 1 : 0;
 		}
 		break;
+	case rawtransfer_mode:
+		if (code == 2) {
+			controlSocket_.m_lastModeZ = modeZ_ ? 1 : 0;
+		}
+		else if (modeZ_) {
+			// Server still uses the previous mode, continue without compression
+			LogMessage(MessageType::Status, _("MODE Z failed, continuing without compression"));
+			CServerCapabilities::SetCapability(currentServer_, mode_z_support, no);
+			modeZ_ = false;
+			opState = NextStateAfterType();
+			break;
+		}
+		else {
+			// Stream mode is the default, assume the server is using it
+			controlSocket_.m_lastModeZ = 0;
+		}
+		opState = rawtransfer_port_pasv;
+		break;
 	case rawtransfer_port_pasv:
 		if (code != 2 && code != 3) {
 			if (!engine_.GetOptions().GetOptionVal(OPTION_ALLOW_TRANSFERMODEFALLBACK)) {
@@ -185,6 +203,10 @@ int CFtpRawTransferOpData::Send()
 		}
 		measureRTT = true;
 		break;
+	case rawtransfer_mode:
+		cmd = modeZ_ ? L"MODE Z" : L"MODE S";
+		measureRTT = true;
+		break;
 	case rawtransfer_port_pasv:
 		if (bPasv) {
 			cmd = GetPassiveCommand();
@@ -227,6 +249,7 @@ int CFtpRawTransferOpData::Send()
 		measureRTT = true;
 		break;
 	case rawtransfer_transfer:
+		controlSocket_.m_pTransferSocket->m_modeZ = modeZ_;
 		if (bPasv) {
 			if (!controlSocket_.m_pTransferSocket->SetupPassiveTransfer(host_, port_)) {
 				LogMessage(MessageType::Error, _("Could not establish connection to server"));
@@ -256,6 +279,15 @@ int CFtpRawTransferOpData::Send()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+int CFtpRawTransferOpData::NextStateAfterType() const
+{
+	int const mode = controlSocket_.m_lastModeZ;
+	if ((modeZ_ && mode == 1) || (!modeZ_ && mode == 0)) {
+		return rawtransfer_port_pasv;
+	}
+	return rawtransfer_mode;
+}
+
 bool CFtpRawTransferOpData::ParseEpsvResponse()
 {
 	size_t pos = controlSocket_.m_Response.find(L"(|||");
@@ -7,6 +7,7 @@ enum rawtransferStates
 {
 	rawtransfer_init = 0,
 	rawtransfer_type,
+	rawtransfer_mode,
 	rawtransfer_port_pasv,
 	rawtransfer_rest,
 	rawtransfer_transfer,
@@ -28,6 +29,9 @@ public:
 	virtual int Send() override;
 	virtual int ParseResponse() override;
 
+	// Skips MODE if the server already uses the right transfer mode
+	int NextStateAfterType() const;
+
 	std::wstring GetPassiveCommand();
 	bool ParsePasvResponse();
 	bool ParseEpsvResponse();
@@ -40,6 +44,8 @@ public:
 	bool bTriedPasv{};
 	bool bTriedActive{};
 
+	bool modeZ_{};
+
 	std::wstring host_;
 	int port_{};
 };
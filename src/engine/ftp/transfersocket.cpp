@@ -9,6 +9,7 @@
 #include "socket_errors.h"
 #include "tlssocket.h"
 #include "transfersocket.h"
+#include "zlibbackend.h"
 
 #include <libfilezilla/util.hpp>
 
@@ -41,6 +42,11 @@ CTransferSocket::~CTransferSocket()
 void CTransferSocket::ResetSocket()
 {
 	delete m_pProxyBackend;
+	if (m_pZlibBackend) {
+		m_pBackend = &m_pZlibBackend->GetNext();
+		delete m_pZlibBackend;
+		m_pZlibBackend = nullptr;
+	}
 	if (m_pBackend == m_pTlsSocket) {
 		m_pBackend = nullptr;
 	}
@@ -516,6 +522,14 @@ void CTransferSocket::TransferEnd(TransferEndReason reason)
 	}
 	m_transferEndReason = reason;
 
+	if (m_pZlibBackend && reason == TransferEndReason::successful) {
+		int64_t const compressed = m_pZlibBackend->GetCompressedBytes();
+		int64_t const uncompressed = m_pZlibBackend->GetUncompressedBytes();
+		if (uncompressed > 0) {
+			controlSocket_.LogMessage(MessageType::Status, _("MODE Z: %d bytes of data transferred as %d bytes (%d%%)"), uncompressed, compressed, static_cast<int>(compressed * 100 / uncompressed));
+		}
+	}
+
 	ResetSocket();
 
 	controlSocket_.send_event<TransferEndEvent>();
@@ -621,6 +635,16 @@ bool CTransferSocket::CheckGetNextReadBuffer()
 			return false;
 		}
 		else if (res == IO_Success) {
+			if (m_pZlibBackend) {
+				int error = m_pZlibBackend->Finish();
+				if (error != 0) {
+					if (error != EAGAIN) {
+						controlSocket_.LogMessage(MessageType::Error, L"Could not write to transfer socket: %s", fz::socket_error_description(error));
+						TransferEnd(TransferEndReason::transfer_failure);
+					}
+					return false;
+				}
+			}
 			if (m_pTlsSocket) {
 				int error = m_pTlsSocket->Shutdown();
 				if (error != 0) {
@@ -693,6 +717,8 @@ bool CTransferSocket::InitTls(const CTlsSocket* pPrimaryTlsSocket)
 
 	bool try_resume = CServerCapabilities::GetCapability(controlSocket_.currentServer_, tls_resume) != no;
 
+	m_pTlsSocket->SetKernelOffload(engine_.GetOptions().GetOptionVal(OPTION_FTP_KTLS) != 0);
+
 	int res = m_pTlsSocket->Handshake(pPrimaryTlsSocket, try_resume);
 	if (res && res != FZ_REPLY_WOULDBLOCK) {
 		delete m_pTlsSocket;
@@ -747,6 +773,12 @@ bool CTransferSocket::InitBackend()
 		m_pBackend = new CSocketBackend(this, *socket_, engine_.GetRateLimiter());
 	}
 
+	if (m_modeZ) {
+		int const level = engine_.GetOptions().GetOptionVal(OPTION_FTP_MODEZ_LEVEL);
+		m_pZlibBackend = new CZlibBackend(this, *m_pBackend, m_transferMode == TransferMode::upload, level);
+		m_pBackend = m_pZlibBackend;
+	}
+
 	return true;
 }
 
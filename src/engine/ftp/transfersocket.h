@@ -19,6 +19,7 @@ enum class TransferMode
 
 class CIOThread;
 class CTlsSocket;
+class CZlibBackend;
 class CTransferSocket final : public fz::event_handler
 {
 public:
@@ -34,6 +35,9 @@ public:
 
 	bool m_binaryMode{true};
 
+	// Data connection uses MODE Z
+	bool m_modeZ{};
+
 	TransferEndReason GetTransferEndreason() const { return m_transferEndReason; }
 
 	void SetIOThread(CIOThread* ioThread) { ioThread_ = ioThread; }
@@ -93,6 +97,9 @@ protected:
 
 	CTlsSocket* m_pTlsSocket{};
 
+	// Sits on top of m_pTlsSocket or the socket backend, if set it is m_pBackend
+	CZlibBackend* m_pZlibBackend{};
+
 	// Needed for the madeProgress field in CTransferStatus
 	// Initially 0, 2 if made progress
 	// On uploads, 1 after first WSAE_WOULDBLOCK
@@ -0,0 +1,184 @@
+#include <filezilla.h>
+
+#include "zlibbackend.h"
+
+#include <errno.h>
+
+CZlibBackend::CZlibBackend(fz::event_handler* pEvtHandler, CBackend & next, bool deflate, int level)
+	: CBackend(pEvtHandler)
+	, next_(next)
+	, deflate_(deflate)
+{
+	if (deflate_) {
+		if (level < 1 || level > 9) {
+			level = Z_DEFAULT_COMPRESSION;
+		}
+		initialized_ = deflateInit(&stream_, level) == Z_OK;
+	}
+	else {
+		initialized_ = inflateInit(&stream_) == Z_OK;
+	}
+}
+
+CZlibBackend::~CZlibBackend()
+{
+	if (initialized_) {
+		if (deflate_) {
+			deflateEnd(&stream_);
+		}
+		else {
+			inflateEnd(&stream_);
+		}
+	}
+}
+
+int CZlibBackend::Read(void *buffer, unsigned int size, int& error)
+{
+	if (!initialized_ || deflate_) {
+		error = initialized_ ? EINVAL : ENOMEM;
+		return -1;
+	}
+
+	if (finished_ || !size) {
+		return 0;
+	}
+
+	stream_.next_out = static_cast<Bytef*>(buffer);
+	stream_.avail_out = size;
+
+	while (true) {
+		if (!stream_.avail_in && !eof_) {
+			int read = next_.Read(buffer_, sizeof(buffer_), error);
+			if (read < 0) {
+				return -1;
+			}
+			if (!read) {
+				eof_ = true;
+			}
+			else {
+				compressed_ += read;
+				stream_.next_in = buffer_;
+				stream_.avail_in = static_cast<unsigned int>(read);
+			}
+		}
+
+		int res = inflate(&stream_, Z_NO_FLUSH);
+		if (res == Z_STREAM_END) {
+			// Anything after the end of the stream is ignored
+			finished_ = true;
+		}
+		else if (res != Z_OK && res != Z_BUF_ERROR) {
+			error = EPROTO;
+			return -1;
+		}
+
+		unsigned int const produced = size - stream_.avail_out;
+		if (produced) {
+			uncompressed_ += produced;
+			return static_cast<int>(produced);
+		}
+
+		if (finished_) {
+			return 0;
+		}
+		if (eof_ && !stream_.avail_in) {
+			// Connection closed in the middle of the stream
+			error = EPROTO;
+			return -1;
+		}
+	}
+}
+
+int CZlibBackend::Peek(void *, unsigned int, int& error)
+{
+	error = EINVAL;
+	return -1;
+}
+
+bool CZlibBackend::FlushPending(int& error)
+{
+	while (pending_) {
+		int written = next_.Write(buffer_ + pendingOffset_, pending_, error);
+		if (written <= 0) {
+			if (!written) {
+				error = EAGAIN;
+			}
+			return false;
+		}
+		compressed_ += written;
+		pending_ -= static_cast<unsigned int>(written);
+		pendingOffset_ += static_cast<unsigned int>(written);
+	}
+
+	return true;
+}
+
+int CZlibBackend::Write(const void *buffer, unsigned int size, int& error)
+{
+	if (!initialized_ || !deflate_ || finished_) {
+		error = initialized_ ? EINVAL : ENOMEM;
+		return -1;
+	}
+
+	if (!FlushPending(error)) {
+		return -1;
+	}
+
+	stream_.next_in = static_cast<Bytef*>(const_cast<void*>(buffer));
+	stream_.avail_in = size;
+	stream_.next_out = buffer_;
+	stream_.avail_out = sizeof(buffer_);
+
+	int res = deflate(&stream_, Z_NO_FLUSH);
+	if (res != Z_OK && res != Z_BUF_ERROR) {
+		error = EPROTO;
+		return -1;
+	}
+
+	unsigned int const consumed = size - stream_.avail_in;
+	stream_.avail_in = 0;
+	uncompressed_ += consumed;
+
+	pendingOffset_ = 0;
+	pending_ = sizeof(buffer_) - stream_.avail_out;
+
+	// The input has been consumed already, so only hard errors count.
+	if (!FlushPending(error) && error != EAGAIN) {
+		return -1;
+	}
+
+	return static_cast<int>(consumed);
+}
+
+int CZlibBackend::Finish()
+{
+	if (!initialized_ || !deflate_) {
+		return initialized_ ? EINVAL : ENOMEM;
+	}
+
+	while (true) {
+		int error;
+		if (!FlushPending(error)) {
+			return error;
+		}
+		if (finished_) {
+			return 0;
+		}
+
+		stream_.next_in = nullptr;
+		stream_.avail_in = 0;
+		stream_.next_out = buffer_;
+		stream_.avail_out = sizeof(buffer_);
+
+		int res = deflate(&stream_, Z_FINISH);
+		if (res == Z_STREAM_END) {
+			finished_ = true;
+		}
+		else if (res != Z_OK && res != Z_BUF_ERROR) {
+			return EPROTO;
+		}
+
+		pendingOffset_ = 0;
+		pending_ = sizeof(buffer_) - stream_.avail_out;
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef FILEZILLA_ENGINE_FTP_ZLIBBACKEND_HEADER
+#define FILEZILLA_ENGINE_FTP_ZLIBBACKEND_HEADER
+
+#include "backend.h"
+
+#include <zlib.h>
+
+// Implements MODE Z on top of another backend, the data connection
+// carries a single zlib stream.
+//
+// Only one direction is used per data connection. If deflating, outgoing
+// data gets compressed with the given level, otherwise incoming data
+// gets inflated.
+//
+// Does not take ownership of the next backend, events are delivered
+// directly by the next backend to the event handler.
+class CZlibBackend final : public CBackend
+{
+public:
+	CZlibBackend(fz::event_handler* pEvtHandler, CBackend & next, bool deflate, int level);
+	virtual ~CZlibBackend();
+
+	virtual int Read(void *buffer, unsigned int size, int& error) override;
+	virtual int Peek(void *buffer, unsigned int size, int& error) override;
+	virtual int Write(const void *buffer, unsigned int size, int& error) override;
+
+	// Ends the compressed stream and passes everything on to the next
+	// backend. Returns 0 once done, EAGAIN if it needs to be called again
+	// after the next write event.
+	int Finish();
+
+	CBackend& GetNext() { return next_; }
+
+	// Bytes on the data connection and bytes of actual data
+	int64_t GetCompressedBytes() const { return compressed_; }
+	int64_t GetUncompressedBytes() const { return uncompressed_; }
+
+protected:
+	virtual void OnRateAvailable(CRateLimiter::rate_direction) override {}
+
+private:
+	bool FlushPending(int& error);
+
+	CBackend & next_;
+	bool const deflate_;
+
+	z_stream stream_{};
+	bool initialized_{};
+	bool eof_{};
+	bool finished_{};
+
+	// Compressed data, either received but not yet inflated or
+	// deflated but not yet written.
+	unsigned char buffer_[64 * 1024];
+	unsigned int pending_{};
+	unsigned int pendingOffset_{};
+
+	int64_t compressed_{};
+	int64_t uncompressed_{};
+};
+
+#endif
@@ -1,6 +1,9 @@
 #include <filezilla.h>
 
 #include "filetransfer.h"
+#include "iothread.h"
+#include "proxy.h"
+#include "rangedownload.h"
 
 #include <libfilezilla/local_filesys.hpp>
 
@@ -11,7 +14,8 @@ enum filetransferStates
 	filetransfer_init = 0,
 	filetransfer_waitfileexists,
 	filetransfer_transfer,
-	filetransfer_waittransfer
+	filetransfer_waittransfer,
+	filetransfer_waitranges
 };
 
 CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSocket, bool is_download, std::wstring const& local_file, std::wstring const& remote_file, CServerPath const& remote_path, CFileTransferCommand::t_transferSettings const& settings)
@@ -32,6 +36,19 @@ CHttpFileTransferOpData::CHttpFileTransferOpData(CHttpControlSocket & controlSoc
 	rr_.request_.verb_ = verb;
 }
 
+CHttpFileTransferOpData::~CHttpFileTransferOpData()
+{
+	if (ioThread_) {
+		// Keep what has been received so far, e.g. if the transfer got canceled
+		FinalizeWrite();
+	}
+
+	if (!segments_.empty() && !segmentsComplete_) {
+		StopRanges();
+		TruncateToCompletePart();
+	}
+}
+
 
 int CHttpFileTransferOpData::Send()
 {
@@ -66,13 +83,19 @@ int CHttpFileTransferOpData::Send()
 		opState = filetransfer_transfer;
 		return FZ_REPLY_CONTINUE;
 	case filetransfer_transfer:
-		if (resume_) {
+		if (!segments_.empty()) {
+			// Retry of a part that could not be downloaded over its own connection
+			auto const& s = segments_[currentSegment_];
+			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-%d", s.start_ + s.received_, s.end_ - 1);
+		}
+		else if (resume_) {
 			rr_.request_.headers_["Range"] = fz::sprintf("bytes=%d-", localFileSize_);
 		}
 
 		rr_.response_ = HttpResponse();
+		memoryDataFlushed_ = 0;
 		rr_.response_.on_header_ = [this](auto const&) { return this->OnHeader(); };
-		rr_.response_.on_data_ = [this](auto data, auto len) { return this->OnData(data, len); };
+		rr_.response_.on_data_ = [this](auto data, auto & len) { return this->OnData(data, len); };
 
 		opState = filetransfer_waittransfer;
 		controlSocket_.Request(make_simple_rr(&rr_));
@@ -87,25 +110,27 @@ int CHttpFileTransferOpData::Send()
 int CHttpFileTransferOpData::OpenFile()
 {
 	LogMessage(MessageType::Debug_Verbose, L"CHttpFileTransferOpData::OpenFile");
-	if (file_.opened()) {
+	if (file_) {
 		if (transferSettings_.fsync) {
-			file_.fsync();
+			file_->fsync();
 		}
-		file_.close();
+		file_.reset();
 	}
 
 	controlSocket_.CreateLocalDir(localFile_);
 
-	if (!file_.open(fz::to_native(localFile_),
+	file_ = std::make_unique<fz::file>();
+	if (!file_->open(fz::to_native(localFile_),
 		download_ ? fz::file::writing : fz::file::reading,
 		fz::file::existing))
 	{
+		file_.reset();
 		LogMessage(MessageType::Error, _("Failed to open \"%s\" for writing"), localFile_);
 		return FZ_REPLY_ERROR;
 	}
 
 	assert(download_);
-	int64_t end = file_.seek(0, fz::file::end);
+	int64_t end = file_->seek(0, fz::file::end);
 	if (end < 0) {
 		LogMessage(MessageType::Error, _("Could not seek to the end of the file"));
 		return FZ_REPLY_ERROR;
@@ -121,9 +146,13 @@ int CHttpFileTransferOpData::OnHeader()
 {
 	LogMessage(MessageType::Debug_Verbose, L"CHttpFileTransferOpData::OnHeader");
 
+	if (!segments_.empty()) {
+		return OnRetryHeader();
+	}
+
 	if (rr_.response_.code_ == 416 && resume_) {
-		assert(file_.opened());
-		if (file_.seek(0, fz::file::begin) != 0) {
+		assert(file_);
+		if (file_->seek(0, fz::file::begin) != 0) {
 			LogMessage(MessageType::Error, _("Could not seek to the beginning of the file"));
 			return FZ_REPLY_ERROR;
 		}
@@ -181,8 +210,8 @@ int CHttpFileTransferOpData::OnHeader()
 
 	// Check if the server disallowed resume
 	if (resume_ && rr_.response_.code_ != 206) {
-		assert(file_.opened());
-		if (file_.seek(0, fz::file::begin) != 0) {
+		assert(file_);
+		if (file_->seek(0, fz::file::begin) != 0) {
 			LogMessage(MessageType::Error, _("Could not seek to the beginning of the file"));
 			return FZ_REPLY_ERROR;
 		}
@@ -201,27 +230,293 @@ int CHttpFileTransferOpData::OnHeader()
 		engine_.transfer_status_.SetStartTime();
 	}
 
+	if (file_) {
+		bool const split = SplitIntoRanges(resume_ ? localFileSize_ : 0, fz::to_integral<int64_t>(rr_.response_.get_header("Content-Length"), -1));
+
+		// From here on the file is only accessed by the IO thread so that
+		// a slow disk does not hold up the socket.
+		ioThread_ = std::make_unique<CIOThread>();
+		ioThread_->SetMetrics(engine_.GetContext().GetMetrics());
+		if (split) {
+			// The file has been preallocated, the other parts are written behind it
+			ioThread_->SetTruncate(false);
+		}
+		if (!ioThread_->Create(engine_.GetThreadPool(), std::move(file_), false, true)) {
+			// CIOThread will delete the file
+			ioThread_.reset();
+			LogMessage(MessageType::Error, _("Could not spawn IO thread"));
+			return FZ_REPLY_ERROR;
+		}
+		ioThread_->SetEventHandler(&controlSocket_);
+
+		if (split) {
+			StartRanges();
+		}
+	}
+
+	return FZ_REPLY_CONTINUE;
+}
+
+int CHttpFileTransferOpData::OnRetryHeader()
+{
+	if (rr_.response_.code_ != 206) {
+		LogMessage(MessageType::Error, _("Server did not honor the range request"));
+		return FZ_REPLY_ERROR;
+	}
+
+	auto const& s = segments_[currentSegment_];
+	int64_t const offset = s.start_ + s.received_;
+
+	int64_t start{};
+	int64_t end{};
+	int64_t total{};
+	if (!ParseContentRange(rr_.response_.get_header("Content-Range"), start, end, total) || start != offset || end != s.end_) {
+		LogMessage(MessageType::Error, _("Server did not honor the range request"));
+		return FZ_REPLY_ERROR;
+	}
+
+	ioThread_ = CreateRangeIOThread(engine_, controlSocket_, localFile_, offset);
+	if (!ioThread_) {
+		return FZ_REPLY_ERROR;
+	}
+	ioThread_->SetEventHandler(&controlSocket_);
+
 	return FZ_REPLY_CONTINUE;
 }
 
-int CHttpFileTransferOpData::OnData(unsigned char const* data, unsigned int len)
+bool CHttpFileTransferOpData::SplitIntoRanges(int64_t start, int64_t size)
+{
+#ifdef FZ_WINDOWS
+	// Each part writes through its own handle. fz::file does not share
+	// write access on Windows, so the second handle could not be opened.
+	(void)start;
+	(void)size;
+	return false;
+#else
+	int64_t connections = engine_.GetOptions().GetOptionVal(OPTION_HTTP_RANGE_CONNECTIONS);
+	if (connections < 2 || size <= 0) {
+		return false;
+	}
+
+	if (rr_.request_.verb_ != "GET" || (rr_.response_.code_ != 200 && rr_.response_.code_ != 206)) {
+		return false;
+	}
+	if (fz::str_tolower_ascii(rr_.response_.get_header("Accept-Ranges")) != "bytes") {
+		return false;
+	}
+	if (!rr_.response_.get_header("Content-Encoding").empty()) {
+		return false;
+	}
+
+	// The additional connections do not go through the proxy
+	int const proxyType = engine_.GetOptions().GetOptionVal(OPTION_PROXY_TYPE);
+	if (proxyType > CProxySocket::unknown && proxyType < CProxySocket::proxytype_count && !currentServer_.GetBypassProxy()) {
+		return false;
+	}
+
+	// Not worth it for small files
+	int64_t const minSegmentSize = 4 * 1024 * 1024;
+	connections = std::min(connections, size / minSegmentSize);
+	if (connections < 2) {
+		return false;
+	}
+
+	// Preallocate so that the parts can be written at their offsets
+	int64_t const total = start + size;
+	if (file_->seek(total, fz::file::begin) != total || !file_->truncate()) {
+		LogMessage(MessageType::Debug_Warning, L"Could not preallocate file, not splitting the download");
+		file_->seek(start, fz::file::begin);
+		return false;
+	}
+	if (file_->seek(start, fz::file::begin) != start) {
+		LogMessage(MessageType::Debug_Warning, L"Could not seek back after preallocating the file");
+		return false;
+	}
+
+	int64_t const segmentSize = size / connections;
+	for (int64_t i = 0; i < connections; ++i) {
+		segment s;
+		s.start_ = start + i * segmentSize;
+		s.end_ = (i + 1 == connections) ? total : (s.start_ + segmentSize);
+		segments_.emplace_back(std::move(s));
+	}
+	currentSegment_ = 0;
+
+	LogMessage(MessageType::Status, _("Downloading file over %d connections"), connections);
+	return true;
+#endif
+}
+
+void CHttpFileTransferOpData::StartRanges()
+{
+	for (size_t i = 1; i < segments_.size(); ++i) {
+		auto & s = segments_[i];
+		s.download_ = std::make_unique<CHttpRangeDownload>(controlSocket_, rr_.request_.uri_, rr_.request_.headers_, localFile_, s.start_, s.end_);
+		if (!s.download_->Start()) {
+			// Gets retried over the primary connection
+			s.download_.reset();
+		}
+	}
+}
+
+void CHttpFileTransferOpData::StopRanges()
+{
+	for (auto & s : segments_) {
+		if (s.download_) {
+			s.download_->Abort();
+			s.received_ = s.download_->received();
+			s.download_.reset();
+		}
+	}
+}
+
+int CHttpFileTransferOpData::CheckRanges(int prevResult)
+{
+	if ((prevResult & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED || (prevResult & FZ_REPLY_CRITICALERROR) == FZ_REPLY_CRITICALERROR) {
+		// No point in retrying anything
+		StopRanges();
+		TruncateToCompletePart();
+		segmentsComplete_ = true;
+		return prevResult;
+	}
+
+	opState = filetransfer_waitranges;
+	for (auto const& s : segments_) {
+		if (s.download_ && !s.download_->finished()) {
+			return FZ_REPLY_WOULDBLOCK;
+		}
+	}
+	for (auto & s : segments_) {
+		if (s.download_) {
+			s.received_ = s.download_->received();
+			s.download_.reset();
+		}
+	}
+
+	for (size_t i = 0; i < segments_.size(); ++i) {
+		auto & s = segments_[i];
+		if (s.start_ + s.received_ >= s.end_) {
+			continue;
+		}
+
+		if (s.retried_) {
+			LogMessage(MessageType::Error, _("Could not download all parts of the file"));
+			TruncateToCompletePart();
+			segmentsComplete_ = true;
+			return FZ_REPLY_ERROR;
+		}
+
+		LogMessage(MessageType::Status, _("Retrying bytes %d-%d of the file"), s.start_ + s.received_, s.end_ - 1);
+		s.retried_ = true;
+		currentSegment_ = i;
+		opState = filetransfer_transfer;
+		return FZ_REPLY_CONTINUE;
+	}
+
+	segmentsComplete_ = true;
+	return FZ_REPLY_OK;
+}
+
+int CHttpFileTransferOpData::OnRangeFinished()
+{
+	if (opState != filetransfer_waitranges) {
+		// Looked at once the primary connection is done
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	return CheckRanges(FZ_REPLY_OK);
+}
+
+void CHttpFileTransferOpData::TruncateToCompletePart()
+{
+	int64_t end = segments_.front().start_;
+	for (auto const& s : segments_) {
+		end = s.start_ + s.received_;
+		if (end < s.end_) {
+			break;
+		}
+	}
+
+	fz::file f;
+	if (f.open(fz::to_native(localFile_), fz::file::writing, fz::file::existing) && f.seek(end, fz::file::begin) == end) {
+		LogMessage(MessageType::Debug_Info, L"Truncating incomplete file to %d bytes", end);
+		f.truncate();
+	}
+}
+
+int CHttpFileTransferOpData::OnData(unsigned char const* data, unsigned int & len)
 {
 	if (opState != filetransfer_waittransfer) {
 		return FZ_REPLY_INTERNALERROR;
 	}
 
 	if (localFile_.empty()) {
-		char* q = new char[len];
-		memcpy(q, data, len);
-		engine_.AddNotification(new CDataNotification(q, len));
+		AppendMemoryData(data, len);
 	}
 	else {
-		assert(file_.opened());
+		assert(ioThread_);
+
+		// If downloading in parts, only the current part is wanted
+		unsigned int wanted = len;
+		bool segmentComplete{};
+		if (!segments_.empty()) {
+			auto const& s = segments_[currentSegment_];
+			int64_t const remaining = s.end_ - s.start_ - s.received_;
+			if (static_cast<int64_t>(wanted) >= remaining) {
+				wanted = static_cast<unsigned int>(remaining);
+				segmentComplete = true;
+			}
+		}
 
-		auto write = static_cast<int64_t>(len);
-		if (file_.write(data, write) != write) {
-			LogMessage(MessageType::Error, _("Failed to write to file %s"), localFile_);
-			return FZ_REPLY_ERROR;
+		unsigned int written{};
+		while (written < wanted) {
+			if (!transferBufferLen_) {
+				int res = ioThread_->GetNextWriteBuffer(&transferBuffer_);
+				if (res == IO_Again) {
+					// All buffers are full. Once the IO thread has written one
+					// of them, the control socket gets a CIOThreadEvent and
+					// continues reading.
+					break;
+				}
+				else if (res == IO_Error) {
+					std::wstring error = ioThread_->GetError();
+					if (error.empty()) {
+						LogMessage(MessageType::Error, _("Can't write data to file."));
+					}
+					else {
+						LogMessage(MessageType::Error, _("Can't write data to file: %s"), error);
+					}
+					return FZ_REPLY_ERROR;
+				}
+				transferBufferLen_ = BUFFERSIZE;
+			}
+
+			unsigned int const chunk = std::min(wanted - written, transferBufferLen_);
+			memcpy(transferBuffer_, data + written, chunk);
+			transferBuffer_ += chunk;
+			transferBufferLen_ -= chunk;
+			written += chunk;
+		}
+
+		if (!segments_.empty()) {
+			segments_[currentSegment_].received_ += written;
+		}
+
+		if (written < wanted) {
+			len = written;
+			if (written) {
+				engine_.transfer_status_.Update(written);
+			}
+			return FZ_REPLY_WOULDBLOCK;
+		}
+
+		len = wanted;
+		if (segmentComplete) {
+			// The rest of the response body belongs to the other parts
+			if (len) {
+				engine_.transfer_status_.Update(len);
+			}
+			return FZ_REPLY_OK;
 		}
 	}
 
@@ -230,6 +525,56 @@ int CHttpFileTransferOpData::OnData(unsigned char const* data, unsigned int len)
 	return FZ_REPLY_CONTINUE;
 }
 
+void CHttpFileTransferOpData::AppendMemoryData(unsigned char const* data, unsigned int len)
+{
+	while (len) {
+		if (!memoryData_) {
+			// Small responses of known size get a buffer of exactly their size
+			memoryDataSize_ = 64 * 1024;
+			int64_t const remaining = fz::to_integral<int64_t>(rr_.response_.get_header("Content-Length"), -1) - memoryDataFlushed_;
+			if (remaining >= static_cast<int64_t>(len) && remaining < static_cast<int64_t>(memoryDataSize_)) {
+				memoryDataSize_ = static_cast<size_t>(remaining);
+			}
+			memoryData_.reset(new char[memoryDataSize_]);
+			memoryDataLen_ = 0;
+		}
+
+		size_t const chunk = std::min(static_cast<size_t>(len), memoryDataSize_ - memoryDataLen_);
+		memcpy(memoryData_.get() + memoryDataLen_, data, chunk);
+		memoryDataLen_ += chunk;
+		data += chunk;
+		len -= static_cast<unsigned int>(chunk);
+
+		if (memoryDataLen_ == memoryDataSize_) {
+			FlushMemoryData();
+		}
+	}
+}
+
+void CHttpFileTransferOpData::FlushMemoryData()
+{
+	if (memoryData_ && memoryDataLen_) {
+		memoryDataFlushed_ += memoryDataLen_;
+		engine_.AddNotification(new CDataNotification(memoryData_.release(), memoryDataLen_));
+	}
+	memoryData_.reset();
+	memoryDataLen_ = 0;
+}
+
+bool CHttpFileTransferOpData::FinalizeWrite()
+{
+	bool res = ioThread_->Finalize(BUFFERSIZE - transferBufferLen_);
+	transferBufferLen_ = 0;
+	transferBuffer_ = nullptr;
+
+	if (res && transferSettings_.fsync) {
+		ioThread_->Fsync();
+	}
+	ioThread_->SetEventHandler(nullptr);
+
+	return res;
+}
+
 int CHttpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 {
 	if (opState == filetransfer_transfer) {
@@ -237,11 +582,31 @@ int CHttpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 	}
 
 	if (opState == filetransfer_waittransfer) {
-		if (file_.opened()) {
+		FlushMemoryData();
+
+		if (ioThread_) {
+			if (!FinalizeWrite() && prevResult == FZ_REPLY_OK) {
+				std::wstring error = ioThread_->GetError();
+				if (error.empty()) {
+					LogMessage(MessageType::Error, _("Can't write data to file."));
+				}
+				else {
+					LogMessage(MessageType::Error, _("Can't write data to file: %s"), error);
+				}
+				prevResult = FZ_REPLY_ERROR;
+			}
+			ioThread_.reset();
+		}
+		else if (file_) {
+			// Response without body
 			if (transferSettings_.fsync) {
-				file_.fsync();
+				file_->fsync();
 			}
 		}
+
+		if (!segments_.empty()) {
+			return CheckRanges(prevResult);
+		}
 	}
 
 	return prevResult;
@@ -5,6 +5,8 @@
 
 #include <libfilezilla/file.hpp>
 
+class CHttpRangeDownload;
+class CIOThread;
 class CServerPath;
 
 class CHttpFileTransferOpData final : public CFileTransferOpData, public CHttpOpData
@@ -12,21 +14,73 @@ class CHttpFileTransferOpData final : public CFileTransferOpData, public CHttpOp
 public:
 	CHttpFileTransferOpData(CHttpControlSocket & controlSocket, bool is_download, std::wstring const& local_file, std::wstring const& remote_file, CServerPath const& remote_path, CFileTransferCommand::t_transferSettings const& settings);
 	CHttpFileTransferOpData(CHttpControlSocket & controlSocket, fz::uri const& uri, std::string const& verb, std::string const& body);
+	virtual ~CHttpFileTransferOpData();
 
 	virtual int Send() override;
 	virtual int ParseResponse() override { return FZ_REPLY_INTERNALERROR; }
 	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
 
+	// Called by the control socket once an additional connection has finished
+	int OnRangeFinished();
+
 private:
 	int OpenFile();
 
 	int OnHeader();
-	int OnData(unsigned char const* data, unsigned int len);
+	int OnRetryHeader();
+	int OnData(unsigned char const* data, unsigned int & len);
+
+	bool FinalizeWrite();
+
+	// If not downloading to a file, the body is passed on in blocks
+	// of up to 64 KiB instead of one notification per received piece.
+	void AppendMemoryData(unsigned char const* data, unsigned int len);
+	void FlushMemoryData();
+
+	// If the server supports it, splits the rest of the file starting at the
+	// given offset into several parts downloaded in parallel.
+	bool SplitIntoRanges(int64_t start, int64_t size);
+	void StartRanges();
+
+	// Waits for the additional connections and retries failed parts
+	int CheckRanges(int prevResult);
+	void StopRanges();
+
+	// So that the next attempt can resume the download, cuts off
+	// everything after the first missing part of the file.
+	void TruncateToCompletePart();
 
 	HttpRequestResponse rr_;
-	fz::file file_;
+
+	// Handed over to the IO thread once the response body starts
+	std::unique_ptr<fz::file> file_;
+	std::unique_ptr<CIOThread> ioThread_;
+
+	char* transferBuffer_{};
+	unsigned int transferBufferLen_{};
+
+	std::unique_ptr<char[]> memoryData_;
+	size_t memoryDataSize_{};
+	size_t memoryDataLen_{};
+	int64_t memoryDataFlushed_{};
 
 	int redirectCount_{};
+
+	// Parts of the file if it gets downloaded over several connections.
+	// The primary request receives the first one, the others get their own
+	// connections. Parts that could not be downloaded are requested once
+	// more over the primary connection.
+	struct segment final
+	{
+		int64_t start_{};
+		int64_t end_{};
+		int64_t received_{};
+		std::unique_ptr<CHttpRangeDownload> download_;
+		bool retried_{};
+	};
+	std::vector<segment> segments_;
+	size_t currentSegment_{};
+	bool segmentsComplete_{};
 };
 
 #endif
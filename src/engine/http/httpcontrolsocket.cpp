@@ -6,6 +6,9 @@
 #include "filetransfer.h"
 #include "httpcontrolsocket.h"
 #include "internalconnect.h"
+#include "iothread.h"
+#include "proxy.h"
+#include "rangedownload.h"
 #include "request.h"
 #include "socket_errors.h"
 #include "tlssocket.h"
@@ -188,6 +191,184 @@ void CHttpControlSocket::OnReceive()
 	}
 }
 
+void CHttpControlSocket::ResumeReading()
+{
+	if (operations_.empty() || operations_.back()->opId != PrivCommand::http_request) {
+		return;
+	}
+
+	int res = static_cast<CHttpRequestOpData&>(*operations_.back()).ResumeReading();
+	if (res == FZ_REPLY_CONTINUE) {
+		SendNextCommand();
+	}
+	else if (res != FZ_REPLY_WOULDBLOCK) {
+		ResetOperation(res);
+	}
+}
+
+void CHttpControlSocket::OnRangeFinished()
+{
+	// Only of interest once the file transfer is waiting for the ranges,
+	// until then the primary request is still in progress.
+	if (operations_.empty() || operations_.back()->opId != Command::transfer) {
+		return;
+	}
+
+	int res = static_cast<CHttpFileTransferOpData&>(*operations_.back()).OnRangeFinished();
+	if (res == FZ_REPLY_CONTINUE) {
+		SendNextCommand();
+	}
+	else if (res != FZ_REPLY_WOULDBLOCK) {
+		ResetOperation(res);
+	}
+}
+
+void CHttpControlSocket::operator()(fz::event_base const& ev)
+{
+	// The IO thread of a download has a buffer available again
+	if (fz::dispatch<CIOThreadEvent>(ev, this, &CHttpControlSocket::ResumeReading)) {
+		return;
+	}
+
+	if (fz::dispatch<CHttpRangeEvent>(ev, this, &CHttpControlSocket::OnRangeFinished)) {
+		return;
+	}
+
+	if (fz::dispatch<fz::socket_event>(ev, this, &CHttpControlSocket::OnSocketEvent)) {
+		return;
+	}
+
+	CRealControlSocket::operator()(ev);
+}
+
+void CHttpControlSocket::OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error)
+{
+	if (resumable_ && resumable_->matches(source)) {
+		return;
+	}
+
+	for (auto it = idle_connections_.begin(); it != idle_connections_.end(); ++it) {
+		if (!it->matches(source)) {
+			continue;
+		}
+
+		// Servers don't send anything on idle connections other than closing them
+		if (t == fz::socket_event_flag::read && !it->alive()) {
+			LogMessage(MessageType::Debug_Verbose, L"Idle connection to %s:%d got closed", it->host_, it->port_);
+			DiscardIdleConnection(it);
+		}
+		return;
+	}
+
+	CRealControlSocket::OnSocketEvent(source, t, error);
+}
+
+bool CHttpControlSocket::idle_connection::matches(fz::socket_event_source const* source) const
+{
+	return source == socket_.get() || source == backend_.get() || (proxy_ && source == proxy_.get());
+}
+
+bool CHttpControlSocket::idle_connection::alive()
+{
+	uint8_t buffer;
+	int error{};
+	int read = backend_->Read(&buffer, 1, error);
+	return read == -1 && error == EAGAIN;
+}
+
+void CHttpControlSocket::ParkConnection()
+{
+	size_t const limit = static_cast<size_t>(engine_.GetOptions().GetOptionVal(OPTION_HTTP_IDLE_CONNECTIONS));
+
+	bool reusable = m_pBackend && limit && !connected_host_.empty() && sendBuffer_.empty();
+	if (reusable && m_pProxyBackend && m_pProxyBackend == m_pBackend) {
+		reusable = false;
+	}
+	if (reusable && connected_tls_ && (m_pTlsSocket != m_pBackend || m_pTlsSocket->GetState() != CTlsSocket::TlsState::conn)) {
+		reusable = false;
+	}
+	if (!reusable) {
+		ResetSocket();
+		return;
+	}
+
+	LogMessage(MessageType::Debug_Verbose, L"Keeping idle connection to %s:%d", connected_host_, connected_port_);
+
+	idle_connection c;
+	c.host_ = connected_host_;
+	c.port_ = connected_port_;
+	c.tls_ = connected_tls_;
+	c.socket_.reset(socket_);
+	c.proxy_.reset(m_pProxyBackend);
+	c.backend_.reset(m_pBackend);
+	c.since_ = fz::monotonic_clock::now();
+	idle_connections_.push_back(std::move(c));
+
+	socket_ = new fz::socket(engine_.GetThreadPool(), this);
+	m_pBackend = nullptr;
+	m_pProxyBackend = nullptr;
+	m_pTlsSocket = nullptr;
+	sendBuffer_.clear();
+
+	connected_host_.clear();
+	connected_port_ = 0;
+	connected_tls_ = false;
+
+	while (idle_connections_.size() > limit) {
+		DiscardIdleConnection(idle_connections_.begin());
+	}
+}
+
+bool CHttpControlSocket::TakeIdleConnection(std::wstring const& host, unsigned short port, bool tls)
+{
+	// Most servers close idle connections well before this
+	fz::duration const max_idle = fz::duration::from_seconds(60);
+
+	auto const now = fz::monotonic_clock::now();
+	for (auto it = idle_connections_.begin(); it != idle_connections_.end(); ) {
+		if (now - it->since_ >= max_idle) {
+			DiscardIdleConnection(it++);
+			continue;
+		}
+		if (it->host_ != host || it->port_ != port || it->tls_ != tls) {
+			++it;
+			continue;
+		}
+
+		if (!it->alive()) {
+			LogMessage(MessageType::Debug_Verbose, L"Idle connection to %s:%d got closed", it->host_, it->port_);
+			DiscardIdleConnection(it++);
+			continue;
+		}
+
+		ResetSocket();
+		delete socket_;
+
+		socket_ = it->socket_.release();
+		m_pProxyBackend = it->proxy_.release();
+		m_pBackend = it->backend_.release();
+		if (tls) {
+			m_pTlsSocket = static_cast<CTlsSocket*>(m_pBackend);
+		}
+		idle_connections_.erase(it);
+
+		return true;
+	}
+
+	return false;
+}
+
+void CHttpControlSocket::DiscardIdleConnection(std::list<idle_connection>::iterator it)
+{
+	if (it->tls_) {
+		// Close the connection, but keep its TLS state around so that a
+		// new connection can resume the session
+		it->socket_->close();
+		resumable_ = std::make_unique<idle_connection>(std::move(*it));
+	}
+	idle_connections_.erase(it);
+}
+
 void CHttpControlSocket::OnConnect()
 {
 	if (operations_.empty() || operations_.back()->opId != PrivCommand::http_connect) {
@@ -211,13 +392,19 @@ void CHttpControlSocket::OnConnect()
 				return;
 			}
 
-			int res = m_pTlsSocket->Handshake();
+			CTlsSocket const* primary{};
+			if (resumable_ && resumable_->host_ == connected_host_ && resumable_->port_ == connected_port_) {
+				primary = static_cast<CTlsSocket const*>(resumable_->backend_.get());
+			}
+
+			int res = m_pTlsSocket->Handshake(primary, primary != nullptr);
 			if (res == FZ_REPLY_ERROR) {
 				DoClose();
 			}
 		}
 		else {
 			LogMessage(MessageType::Status, _("TLS connection established, sending HTTP request"));
+			resumable_.reset();
 			ResetOperation(FZ_REPLY_OK);
 		}
 	}
@@ -286,7 +473,18 @@ int CHttpControlSocket::InternalConnect(std::wstring const& host, unsigned short
 		}
 	}
 
-	ResetSocket();
+	// Current connection might be needed again, e.g. when going back and forth
+	// between an API and a storage host.
+	ParkConnection();
+
+	if (TakeIdleConnection(host, port, tls)) {
+		LogMessage(MessageType::Debug_Verbose, L"Reusing an idle connection to %s:%d", host, port);
+		connected_host_ = host;
+		connected_port_ = port;
+		connected_tls_ = tls;
+		return FZ_REPLY_OK;
+	}
+
 	connected_host_ = host;
 	connected_port_ = port;
 	connected_tls_ = tls;
@@ -324,6 +522,8 @@ void CHttpControlSocket::ResetSocket()
 
 int CHttpControlSocket::Disconnect()
 {
+	idle_connections_.clear();
+	resumable_.reset();
 	DoClose();
 	return FZ_REPLY_OK;
 }
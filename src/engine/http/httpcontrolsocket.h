@@ -5,8 +5,11 @@
 #include "httpheaders.h"
 
 #include <libfilezilla/file.hpp>
+#include <libfilezilla/time.hpp>
 #include <libfilezilla/uri.hpp>
 
+#include <list>
+
 namespace PrivCommand {
 auto const http_request = Command::private1;
 auto const http_connect = Command::private2;
@@ -90,7 +93,7 @@ public:
 	int64_t get_content_length() const
 	{
 		int64_t result = 0;
-		auto value = get_header(HEADER_NAME_CONTENT_LENGTH);
+		auto const& value = get_header(HEADER_NAME_CONTENT_LENGTH);
 		if (!value.empty()) {
 			result = fz::to_integral<int64_t>(value);
 		}
@@ -107,13 +110,16 @@ public:
 		headers_[HEADER_NAME_CONTENT_TYPE] = content_type;
 	}
 
-	std::string get_header(std::string const& key) const
+	// The returned reference remains valid until the headers get modified
+	std::string const& get_header(std::string const& key) const
 	{
+		static std::string const empty;
+
 		auto it = headers_.find(key);
 		if (it != headers_.end()) {
 			return it->second;
 		}
-		return std::string();
+		return empty;
 	}
 
 	bool keep_alive() const
@@ -179,11 +185,20 @@ public:
 	std::function<int(std::shared_ptr<HttpRequestResponseInterface> const&)> on_header_;
 
 	// Is only called after the on_header_ callback.
-	// Callback must return FZ_REPLY_CONTINUE or FZ_REPLY_ERROR
-	std::function<int(unsigned char const* data, unsigned int len)> on_data_;
+	// Callback must return one of:
+	//   FZ_REPLY_CONTINUE: All data has been consumed
+	//   FZ_REPLY_WOULDBLOCK: Only len bytes have been consumed. Reading from
+	//                        the socket is suspended until CHttpControlSocket::ResumeReading
+	//                        gets called, at which point the callback is invoked with the
+	//                        remaining data.
+	//   FZ_REPLY_OK: len bytes have been consumed and the rest of the body is not
+	//                needed. The response is treated as complete, the connection
+	//                is closed unless the body has been received in full.
+	//   FZ_REPLY_ERROR: Abort connection
+	std::function<int(unsigned char const* data, unsigned int & len)> on_data_;
 
 	// Called if !success && got_body
-	std::function<int(unsigned char const* data, unsigned int len)> on_error_data_;
+	std::function<int(unsigned char const* data, unsigned int & len)> on_error_data_;
 
 	bool success() const {
 		return code_ >= 200 && code_ < 300;
@@ -252,7 +267,7 @@ protected:
 		Request(std::move(rrs));
 	}
 
-	// FZ_REPLY_OK: Re-using existing connection
+	// FZ_REPLY_OK: Re-using existing or idle connection
 	// FZ_REPLY_WOULDBLOCK: Cannot perform action right now (!allowDisconnect)
 	// FZ_REPLY_CONTINUE: Connection operation pusehd to stack
 	int InternalConnect(std::wstring const& host, unsigned short port, bool tls, bool allowDisconnect);
@@ -262,18 +277,62 @@ protected:
 
 	CTlsSocket* m_pTlsSocket{};
 
+	virtual void operator()(fz::event_base const& ev) override;
+	void OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+
 	virtual void OnConnect() override;
 	virtual void OnSocketError(int error) override;
 	virtual void OnReceive() override;
 	virtual int OnSend() override;
+
+	// Continues reading a response after a body consumer has returned
+	// FZ_REPLY_WOULDBLOCK from its on_data_ callback.
+	void ResumeReading();
+
+	// One of the additional connections of a ranged download has finished
+	void OnRangeFinished();
 	
 	virtual void ResetSocket() override;
 	
 	friend class CProtocolOpData<CHttpControlSocket>;
 	friend class CHttpFileTransferOpData;
 	friend class CHttpInternalConnectOpData;
+	friend class CHttpRangeDownload;
 	friend class CHttpRequestOpData;
 private:
+	// A connection kept open for later requests to the same endpoint.
+	// Members are declared in the order they depend on each other.
+	struct idle_connection final
+	{
+		std::wstring host_;
+		unsigned short port_{};
+		bool tls_{};
+
+		std::unique_ptr<fz::socket> socket_;
+		std::unique_ptr<CProxySocket> proxy_;
+		std::unique_ptr<CBackend> backend_;
+
+		fz::monotonic_clock since_;
+
+		bool matches(fz::socket_event_source const* source) const;
+		bool alive();
+	};
+
+	// Moves the current connection into the pool of idle connections if
+	// it can be reused, otherwise closes it.
+	void ParkConnection();
+
+	// Makes a pooled connection to the given endpoint the current one.
+	bool TakeIdleConnection(std::wstring const& host, unsigned short port, bool tls);
+
+	void DiscardIdleConnection(std::list<idle_connection>::iterator it);
+
+	std::list<idle_connection> idle_connections_;
+
+	// Last discarded TLS connection, its socket is closed. Its session
+	// gets resumed when reconnecting to the same endpoint.
+	std::unique_ptr<idle_connection> resumable_;
+
 	std::wstring	connected_host_;
 	unsigned short	connected_port_{};
 	bool			connected_tls_{};
@@ -0,0 +1,426 @@
+#include <filezilla.h>
+
+#include "rangedownload.h"
+
+#include "backend.h"
+#include "iothread.h"
+#include "request.h"
+#include "socket_errors.h"
+#include "tlssocket.h"
+
+#include <libfilezilla/file.hpp>
+
+#include <algorithm>
+
+#include <string.h>
+
+bool ParseContentRange(std::string const& value, int64_t & start, int64_t & end, int64_t & total)
+{
+	auto const tokens = fz::strtok(value, " -/");
+	if (tokens.size() != 4 || fz::str_tolower_ascii(tokens[0]) != "bytes") {
+		return false;
+	}
+
+	start = fz::to_integral<int64_t>(tokens[1], -1);
+	int64_t const last = fz::to_integral<int64_t>(tokens[2], -1);
+	if (start < 0 || last < start) {
+		return false;
+	}
+	end = last + 1;
+
+	if (tokens[3] == "*") {
+		total = -1;
+	}
+	else {
+		total = fz::to_integral<int64_t>(tokens[3], -1);
+		if (total < end) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::unique_ptr<CIOThread> CreateRangeIOThread(CFileZillaEnginePrivate & engine, CLogging & logger, std::wstring const& localFile, int64_t offset)
+{
+	auto file = std::make_unique<fz::file>();
+	if (!file->open(fz::to_native(localFile), fz::file::writing, fz::file::existing)) {
+		logger.LogMessage(MessageType::Error, _("Failed to open \"%s\" for writing"), localFile);
+		return nullptr;
+	}
+
+	if (file->seek(offset, fz::file::begin) != offset) {
+		logger.LogMessage(MessageType::Error, _("Could not seek to offset %d within file"), offset);
+		return nullptr;
+	}
+
+	auto ioThread = std::make_unique<CIOThread>();
+	ioThread->SetTruncate(false);
+	ioThread->SetMetrics(engine.GetContext().GetMetrics());
+	if (!ioThread->Create(engine.GetThreadPool(), std::move(file), false, true)) {
+		logger.LogMessage(MessageType::Error, _("Could not spawn IO thread"));
+		return nullptr;
+	}
+
+	return ioThread;
+}
+
+CHttpRangeDownload::CHttpRangeDownload(CHttpControlSocket & controlSocket, fz::uri const& uri, HttpHeaders const& headers,
+	std::wstring const& localFile, int64_t start, int64_t end)
+	: fz::event_handler(controlSocket.event_loop_)
+	, controlSocket_(controlSocket)
+	, uri_(uri)
+	, headers_(headers)
+	, localFile_(localFile)
+	, start_(start)
+	, end_(end)
+{
+}
+
+CHttpRangeDownload::~CHttpRangeDownload()
+{
+	remove_handler();
+
+	backend_.reset();
+	socket_.reset();
+
+	if (ioThread_) {
+		ioThread_->Finalize(BUFFERSIZE - transferBufferLen_);
+	}
+}
+
+bool CHttpRangeDownload::Start()
+{
+	bool const tls = uri_.scheme_ == "https";
+	if (tls && !controlSocket_.m_pTlsSocket) {
+		// Nothing to take the certificate from
+		return false;
+	}
+
+	ioThread_ = CreateRangeIOThread(controlSocket_.GetEngine(), controlSocket_, localFile_, start_);
+	if (!ioThread_) {
+		return false;
+	}
+	ioThread_->SetEventHandler(this);
+
+	controlSocket_.LogMessage(MessageType::Debug_Info, L"Downloading bytes %d-%d over an additional connection", start_, end_ - 1);
+
+	socket_ = std::make_unique<fz::socket>(controlSocket_.GetEngine().GetThreadPool(), this);
+	backend_ = std::make_unique<CSocketBackend>(this, *socket_, controlSocket_.GetEngine().GetRateLimiter());
+
+	unsigned int port = uri_.port_;
+	if (!port) {
+		port = tls ? 443 : 80;
+	}
+
+	std::wstring const host = controlSocket_.ConvertDomainName(fz::to_wstring_from_utf8(uri_.host_));
+	int res = socket_->connect(fz::to_native(host), port);
+	if (res && res != EINPROGRESS) {
+		controlSocket_.LogMessage(MessageType::Debug_Warning, L"Could not connect additional connection: %s", fz::socket_error_description(res));
+		return false;
+	}
+
+	return true;
+}
+
+void CHttpRangeDownload::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, CIOThreadEvent>(ev, this,
+		&CHttpRangeDownload::OnSocketEvent,
+		&CHttpRangeDownload::OnIOThreadEvent);
+}
+
+void CHttpRangeDownload::OnSocketEvent(fz::socket_event_source*, fz::socket_event_flag t, int error)
+{
+	if (finished_ || !backend_) {
+		return;
+	}
+
+	switch (t)
+	{
+	case fz::socket_event_flag::connection_next:
+		break;
+	case fz::socket_event_flag::connection:
+		if (error) {
+			controlSocket_.LogMessage(MessageType::Debug_Warning, L"Additional connection failed: %s", fz::socket_error_description(error));
+			Finish(false);
+		}
+		else {
+			OnConnect();
+		}
+		break;
+	case fz::socket_event_flag::read:
+		if (error) {
+			controlSocket_.LogMessage(MessageType::Debug_Warning, L"Could not read from additional connection: %s", fz::socket_error_description(error));
+			Finish(false);
+		}
+		else {
+			OnReceive();
+		}
+		break;
+	case fz::socket_event_flag::write:
+		if (error) {
+			controlSocket_.LogMessage(MessageType::Debug_Warning, L"Could not write to additional connection: %s", fz::socket_error_description(error));
+			Finish(false);
+		}
+		else {
+			OnSend();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void CHttpRangeDownload::OnConnect()
+{
+	if (uri_.scheme_ == "https" && !tls_) {
+		if (!controlSocket_.m_pTlsSocket) {
+			Finish(false);
+			return;
+		}
+
+		backend_.reset();
+		tls_ = new CTlsSocket(this, *socket_, &controlSocket_);
+		backend_.reset(tls_);
+
+		if (!tls_->Init()) {
+			Finish(false);
+			return;
+		}
+
+		// Implicitly trusts the certificate of the primary connection
+		int res = tls_->Handshake(controlSocket_.m_pTlsSocket, true);
+		if (res == FZ_REPLY_ERROR) {
+			Finish(false);
+		}
+		return;
+	}
+
+	std::string command = fz::sprintf("GET %s HTTP/1.1\r\n", uri_.get_request());
+	headers_["Range"] = fz::sprintf("bytes=%d-%d", start_, end_ - 1);
+	headers_["Connection"] = "close";
+	for (auto const& header : headers_) {
+		command += fz::sprintf("%s: %s\r\n", header.first, header.second);
+	}
+	command += "\r\n";
+
+	send_buffer_.append(command);
+	OnSend();
+}
+
+void CHttpRangeDownload::OnSend()
+{
+	while (!send_buffer_.empty()) {
+		int error;
+		int written = backend_->Write(send_buffer_.get(), send_buffer_.size(), error);
+		if (written < 0) {
+			if (error != EAGAIN) {
+				controlSocket_.LogMessage(MessageType::Debug_Warning, L"Could not write to additional connection: %s", fz::socket_error_description(error));
+				Finish(false);
+			}
+			return;
+		}
+		send_buffer_.consume(static_cast<size_t>(written));
+	}
+}
+
+void CHttpRangeDownload::OnReceive()
+{
+	while (!finished_ && !waitingForIO_) {
+		int error;
+		size_t const recv_size = 1024 * 64;
+		int read = backend_->Read(recv_buffer_.get(recv_size), recv_size, error);
+		if (read < 0) {
+			if (error != EAGAIN) {
+				controlSocket_.LogMessage(MessageType::Debug_Warning, L"Could not read from additional connection: %s", fz::socket_error_description(error));
+				Finish(false);
+			}
+			return;
+		}
+		if (!read) {
+			controlSocket_.LogMessage(MessageType::Debug_Warning, L"Additional connection closed before the range was complete");
+			Finish(false);
+			return;
+		}
+		recv_buffer_.add(static_cast<size_t>(read));
+		controlSocket_.SetActive(CFileZillaEngine::recv);
+
+		if (!response_.got_header()) {
+			int res = ParseHeader();
+			if (res == FZ_REPLY_WOULDBLOCK) {
+				continue;
+			}
+			else if (res != FZ_REPLY_OK) {
+				Finish(false);
+				return;
+			}
+		}
+
+		int res = ProcessData();
+		if (res == FZ_REPLY_OK) {
+			Finish(true);
+		}
+		else if (res != FZ_REPLY_WOULDBLOCK) {
+			Finish(false);
+		}
+	}
+}
+
+void CHttpRangeDownload::OnIOThreadEvent()
+{
+	if (finished_ || !waitingForIO_) {
+		return;
+	}
+	waitingForIO_ = false;
+
+	int res = ProcessData();
+	if (res == FZ_REPLY_OK) {
+		Finish(true);
+	}
+	else if (res != FZ_REPLY_WOULDBLOCK) {
+		Finish(false);
+	}
+	else {
+		OnReceive();
+	}
+}
+
+int CHttpRangeDownload::ParseHeader()
+{
+	unsigned char const* const begin = recv_buffer_.get();
+	unsigned char const* const end = begin + recv_buffer_.size();
+
+	unsigned char const* const terminator = reinterpret_cast<unsigned char const*>("\r\n\r\n");
+	unsigned char const* header_end = std::search(begin, end, terminator, terminator + 4);
+	if (header_end == end) {
+		if (recv_buffer_.size() > 64 * 1024) {
+			controlSocket_.LogMessage(MessageType::Debug_Warning, L"Header on additional connection too long");
+			return FZ_REPLY_ERROR;
+		}
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	// Parsed in place, line by line
+	static char const crlf[] = "\r\n";
+	char const* line = reinterpret_cast<char const*>(begin);
+	char const* const lines_end = reinterpret_cast<char const*>(header_end);
+	bool first = true;
+	while (line < lines_end) {
+		char const* line_end = std::search(line, lines_end, crlf, crlf + 2);
+		size_t const len = line_end - line;
+		if (first) {
+			if (len < 12 || memcmp(line, "HTTP/1.", 7) ||
+				line[9] < '1' || line[9] > '5' ||
+				line[10] < '0' || line[10] > '9' ||
+				line[11] < '0' || line[11] > '9')
+			{
+				controlSocket_.LogMessage(MessageType::Debug_Warning, L"Invalid HTTP response on additional connection");
+				return FZ_REPLY_ERROR;
+			}
+			response_.code_ = (line[9] - '0') * 100 + (line[10] - '0') * 10 + line[11] - '0';
+			response_.flags_ |= HttpResponse::flag_got_code;
+			first = false;
+		}
+		else {
+			// Malformed lines are of no concern here, the primary connection got the same header
+			AddHeaderLine(response_.headers_, line, len);
+		}
+		line = line_end + 2;
+	}
+	if (first) {
+		controlSocket_.LogMessage(MessageType::Debug_Warning, L"Invalid HTTP response on additional connection");
+		return FZ_REPLY_ERROR;
+	}
+	recv_buffer_.consume(header_end - begin + 4);
+	response_.flags_ |= HttpResponse::flag_got_header;
+
+	if (response_.code_ != 206) {
+		controlSocket_.LogMessage(MessageType::Debug_Warning, L"Server replied with code %d to range request on additional connection", response_.code_);
+		return FZ_REPLY_ERROR;
+	}
+
+	int64_t start{};
+	int64_t end{};
+	int64_t total{};
+	if (!ParseContentRange(response_.get_header("Content-Range"), start, end, total) || start != start_ || end != end_) {
+		controlSocket_.LogMessage(MessageType::Debug_Warning, L"Server sent wrong range on additional connection");
+		return FZ_REPLY_ERROR;
+	}
+
+	auto const te = fz::str_tolower_ascii(response_.get_header("Transfer-Encoding"));
+	if (!te.empty() && te != "identity") {
+		controlSocket_.LogMessage(MessageType::Debug_Warning, L"Unsupported transfer encoding on additional connection");
+		return FZ_REPLY_ERROR;
+	}
+
+	return FZ_REPLY_OK;
+}
+
+int CHttpRangeDownload::ProcessData()
+{
+	while (!recv_buffer_.empty()) {
+		int64_t const pending = end_ - start_ - received_;
+		if (!pending) {
+			// Anything past the requested range gets ignored, the connection gets closed anyhow
+			recv_buffer_.clear();
+			break;
+		}
+
+		if (!transferBufferLen_) {
+			int res = ioThread_->GetNextWriteBuffer(&transferBuffer_);
+			if (res == IO_Again) {
+				waitingForIO_ = true;
+				return FZ_REPLY_WOULDBLOCK;
+			}
+			else if (res == IO_Error) {
+				controlSocket_.LogMessage(MessageType::Error, _("Can't write data to file."));
+				return FZ_REPLY_ERROR | FZ_REPLY_CRITICALERROR;
+			}
+			transferBufferLen_ = BUFFERSIZE;
+		}
+
+		size_t chunk = std::min(recv_buffer_.size(), static_cast<size_t>(transferBufferLen_));
+		if (static_cast<int64_t>(chunk) > pending) {
+			chunk = static_cast<size_t>(pending);
+		}
+		memcpy(transferBuffer_, recv_buffer_.get(), chunk);
+		transferBuffer_ += chunk;
+		transferBufferLen_ -= static_cast<unsigned int>(chunk);
+		recv_buffer_.consume(chunk);
+		received_ += chunk;
+
+		controlSocket_.GetEngine().transfer_status_.Update(chunk);
+	}
+
+	return (received_ == end_ - start_) ? FZ_REPLY_OK : FZ_REPLY_WOULDBLOCK;
+}
+
+void CHttpRangeDownload::Finish(bool success)
+{
+	if (finished_) {
+		return;
+	}
+	finished_ = true;
+
+	backend_.reset();
+	tls_ = nullptr;
+	if (socket_) {
+		socket_->close();
+	}
+
+	if (ioThread_) {
+		if (!ioThread_->Finalize(BUFFERSIZE - transferBufferLen_)) {
+			// Cannot tell which parts made it to disk
+			received_ = 0;
+			success = false;
+		}
+		ioThread_.reset();
+	}
+
+	if (success) {
+		controlSocket_.LogMessage(MessageType::Debug_Info, L"Finished downloading bytes %d-%d over an additional connection", start_, end_ - 1);
+	}
+
+	controlSocket_.send_event<CHttpRangeEvent>();
+}
@@ -0,0 +1,93 @@
+#ifndef FILEZILLA_ENGINE_HTTP_RANGEDOWNLOAD_HEADER
+#define FILEZILLA_ENGINE_HTTP_RANGEDOWNLOAD_HEADER
+
+#include "httpcontrolsocket.h"
+
+#include <libfilezilla/buffer.hpp>
+
+class CBackend;
+class CIOThread;
+
+struct http_range_event_type{};
+typedef fz::simple_event<http_range_event_type> CHttpRangeEvent;
+
+// Parses the value of a Content-Range header of the form "bytes first-last/total".
+// On success, end is one past the last byte. Total is -1 if unknown.
+bool ParseContentRange(std::string const& value, int64_t & start, int64_t & end, int64_t & total);
+
+// Opens the local file for writing at the given offset and hands it to a
+// new IO thread. The file is not truncated when closed.
+std::unique_ptr<CIOThread> CreateRangeIOThread(CFileZillaEnginePrivate & engine, CLogging & logger, std::wstring const& localFile, int64_t offset);
+
+// Downloads the part [start, end) of a file over an additional connection
+// while the control socket's own connection receives another part.
+//
+// Like FTP data connections, TLS connections resume the session of the
+// primary connection and have to present the same certificate.
+//
+// Once finished, successfully or not, a CHttpRangeEvent is sent to the control socket.
+class CHttpRangeDownload final : public fz::event_handler
+{
+public:
+	CHttpRangeDownload(CHttpControlSocket & controlSocket, fz::uri const& uri, HttpHeaders const& headers,
+		std::wstring const& localFile, int64_t start, int64_t end);
+	virtual ~CHttpRangeDownload();
+
+	CHttpRangeDownload(CHttpRangeDownload const&) = delete;
+	CHttpRangeDownload& operator=(CHttpRangeDownload const&) = delete;
+
+	bool Start();
+
+	// Stops the download, keeping what has been written so far
+	void Abort() { Finish(false); }
+
+	bool finished() const { return finished_; }
+
+	// Number of bytes from the start of the range that made it into the
+	// file. Only valid once finished.
+	int64_t received() const { return received_; }
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+	void OnIOThreadEvent();
+
+	void OnConnect();
+	void OnReceive();
+	void OnSend();
+
+	// FZ_REPLY_OK once the complete header has been parsed
+	int ParseHeader();
+
+	// FZ_REPLY_WOULDBLOCK if waiting for the IO thread or for more data
+	int ProcessData();
+
+	void Finish(bool success);
+
+	CHttpControlSocket & controlSocket_;
+
+	fz::uri const uri_;
+	HttpHeaders headers_;
+	std::wstring const localFile_;
+
+	int64_t const start_;
+	int64_t const end_;
+
+	std::unique_ptr<fz::socket> socket_;
+	std::unique_ptr<CBackend> backend_;
+	CTlsSocket* tls_{};
+
+	std::unique_ptr<CIOThread> ioThread_;
+	char* transferBuffer_{};
+	unsigned int transferBufferLen_{};
+	bool waitingForIO_{};
+
+	fz::buffer send_buffer_;
+	fz::buffer recv_buffer_;
+
+	HttpResponse response_;
+	int64_t received_{};
+	bool finished_{};
+};
+
+#endif
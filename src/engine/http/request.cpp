@@ -45,6 +45,9 @@ void CHttpRequestOpData::AddRequest(std::shared_ptr<HttpRequestResponseInterface
 			else if (requests_.back() && !(requests_.back()->request().keep_alive() || requests_.back()->response().keep_alive())) {
 				wait = true;
 			}
+			else if (!engine_.GetOptions().GetOptionVal(OPTION_HTTP_PIPELINING)) {
+				wait = true;
+			}
 		}
 		if (wait) {
 			opState |= request_send_wait_for_read;
@@ -94,8 +97,11 @@ int CHttpRequestOpData::Send()
 		req.headers_["Host"] = host_header;
 		auto pos = req.headers_.find("Connection");
 		if (pos == req.headers_.end()) {
-			// TODO: consider making keep-alive the default
-			req.headers_["Connection"] = "close";
+			// Keep-alive is the default in HTTP/1.1, only worth it if
+			// idle connections are kept for later requests.
+			if (!engine_.GetOptions().GetOptionVal(OPTION_HTTP_IDLE_CONNECTIONS)) {
+				req.headers_["Connection"] = "close";
+			}
 		}
 		req.headers_["User-Agent"] = fz::replaced_substrings(PACKAGE_STRING, " ", "/");
 
@@ -153,7 +159,7 @@ int CHttpRequestOpData::Send()
 					}
 				}
 
-				auto const cl = req.get_header("Content-Length");
+				auto const& cl = req.get_header("Content-Length");
 				if (!cl.empty()) {
 					int64_t requestContentLength = fz::to_integral<int64_t>(cl, -1);
 					if (requestContentLength < 0) {
@@ -187,13 +193,7 @@ int CHttpRequestOpData::Send()
 					opState &= ~request_send;
 					++send_pos_;
 					if (send_pos_ < requests_.size()) {
-						if (!req.keep_alive()) {
-							opState |= request_send_wait_for_read;
-							LogMessage(MessageType::Debug_Info, L"Request did not ask for keep-alive. Waiting for response to finish before sending next request a new connection.");
-						}
-						else {
-							opState |= request_init;
-						}
+						SetNextSendState(req);
 					}
 				}
 				else {
@@ -258,13 +258,7 @@ int CHttpRequestOpData::Send()
 				++send_pos_;
 
 				if (send_pos_ < requests_.size()) {
-					if (!req.keep_alive()) {
-						opState |= request_send_wait_for_read;
-						LogMessage(MessageType::Debug_Info, L"Request did not ask for keep-alive. Waiting for response to finish before sending next request a new connection.");
-					}
-					else {
-						opState |= request_init;
-					}
+					SetNextSendState(req);
 				}
 				return FZ_REPLY_CONTINUE;
 			}
@@ -278,6 +272,21 @@ int CHttpRequestOpData::Send()
 	return FZ_REPLY_INTERNALERROR;
 }
 
+void CHttpRequestOpData::SetNextSendState(HttpRequest const& req)
+{
+	if (!req.keep_alive()) {
+		opState |= request_send_wait_for_read;
+		LogMessage(MessageType::Debug_Info, L"Request did not ask for keep-alive. Waiting for response to finish before sending next request a new connection.");
+	}
+	else if (!engine_.GetOptions().GetOptionVal(OPTION_HTTP_PIPELINING)) {
+		opState |= request_send_wait_for_read;
+		LogMessage(MessageType::Debug_Info, L"Pipelining is disabled. Waiting for response to finish before sending next request.");
+	}
+	else {
+		opState |= request_init;
+	}
+}
+
 int CHttpRequestOpData::SubcommandResult(int, COpData const&)
 {
 	if (opState & request_wait_connect) {
@@ -351,8 +360,9 @@ int CHttpRequestOpData::ParseReceiveBuffer(bool eof)
 				size = static_cast<size_t>(read_state_.responseContentLength_ - read_state_.receivedData_);
 			}
 
-			int res = ProcessData(recv_buffer_.get(), size);
-			recv_buffer_.consume(size);
+			unsigned int len = static_cast<unsigned int>(size);
+			int res = ProcessData(recv_buffer_.get(), len);
+			recv_buffer_.consume(len);
 			return res;
 		}
 	}
@@ -360,24 +370,37 @@ int CHttpRequestOpData::ParseReceiveBuffer(bool eof)
 	return FZ_REPLY_INTERNALERROR;
 }
 
-int CHttpRequestOpData::OnReceive()
+int CHttpRequestOpData::OnReceive(bool repeatedProcessing)
 {
 	while (controlSocket_.socket_) {
-		int error;
-		size_t const recv_size = 1024 * 64;
-		int read = controlSocket_.m_pBackend->Read(recv_buffer_.get(recv_size), recv_size, error);
-		if (read <= -1) {
-			if (error != EAGAIN) {
-				LogMessage(MessageType::Error, _("Could not read from socket: %s"), fz::socket_error_description(error));
-				return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;
-			}
+		if (read_state_.paused_) {
+			// Leave the data in the socket, this way the server
+			// gets throttled if we cannot keep up with it.
 			return FZ_REPLY_WOULDBLOCK;
 		}
-		recv_buffer_.add(static_cast<size_t>(read));
 
-		controlSocket_.SetActive(CFileZillaEngine::recv);
+		bool eof{};
+		if (!repeatedProcessing) {
+			int error;
+			size_t const recv_size = 1024 * 64;
+			int read = controlSocket_.m_pBackend->Read(recv_buffer_.get(recv_size), recv_size, error);
+			if (read <= -1) {
+				if (error != EAGAIN) {
+					LogMessage(MessageType::Error, _("Could not read from socket: %s"), fz::socket_error_description(error));
+					return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;
+				}
+				return FZ_REPLY_WOULDBLOCK;
+			}
+			recv_buffer_.add(static_cast<size_t>(read));
+
+			controlSocket_.SetActive(CFileZillaEngine::recv);
 
-		bool const eof = read == 0;
+			eof = read == 0;
+		}
+		else {
+			// First process what is still in the receive buffer
+			repeatedProcessing = false;
+		}
 
 		while (!requests_.empty()) {
 			assert(!requests_.empty());
@@ -393,6 +416,9 @@ int CHttpRequestOpData::OnReceive()
 				--send_pos_;
 
 				bool keep_alive = read_state_.keep_alive_;
+				if (read_state_.discard_rest_) {
+					recv_buffer_.clear();
+				}
 				if (!keep_alive || eof) {
 					if (!recv_buffer_.empty()) {
 						LogMessage(MessageType::Error, _("Malformed response: %s"), _("Server sent too much data."));
@@ -420,6 +446,11 @@ int CHttpRequestOpData::OnReceive()
 					opState = request_init | request_reading;
 					return FZ_REPLY_CONTINUE;
 				}
+
+				if (!send_pos_ && (opState & request_send_wait_for_read)) {
+					// Next request can go out on this connection now
+					controlSocket_.send_event<fz::socket_event>(controlSocket_.m_pBackend, fz::socket_event_flag::write, 0);
+				}
 			}
 			else if (res != FZ_REPLY_CONTINUE) {
 				return res;
@@ -435,6 +466,106 @@ int CHttpRequestOpData::OnReceive()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+int CHttpRequestOpData::ResumeReading()
+{
+	if (!read_state_.paused_) {
+		return FZ_REPLY_WOULDBLOCK;
+	}
+	read_state_.paused_ = false;
+
+	return OnReceive(true);
+}
+
+bool AddHeaderLine(HttpHeaders & headers, char const* line, size_t len)
+{
+	char const* const end = line + len;
+
+	char const* const delim = static_cast<char const*>(memchr(line, ':', len));
+	if (!delim || delim == line) {
+		return false;
+	}
+
+	char const* value = delim + 1;
+	char const* value_end = end;
+	while (value != value_end && (*value == ' ' || *value == '\t')) {
+		++value;
+	}
+	while (value_end != value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+		--value_end;
+	}
+
+	auto & header = headers[std::string(line, delim)];
+	if (header.empty()) {
+		header.assign(value, value_end);
+	}
+	else if (value != value_end) {
+		header += ", ";
+		header.append(value, value_end);
+	}
+
+	return true;
+}
+
+line_result FindLineEnd(unsigned char const* buf, size_t size, size_t & scanned, size_t & len)
+{
+	size_t i = scanned;
+	if (i > size) {
+		i = 0;
+	}
+	for (; i < size; ++i) {
+		if (buf[i] == '\r') {
+			if (i + 1 == size) {
+				break;
+			}
+			if (buf[i + 1] != '\n') {
+				return line_bad_ending;
+			}
+			scanned = 0;
+			len = i;
+			return line_ok;
+		}
+		if (!buf[i]) {
+			return line_null;
+		}
+	}
+	scanned = i;
+
+	size_t const max_line_size = 8192;
+	if (size >= max_line_size) {
+		return line_too_long;
+	}
+	return line_incomplete;
+}
+
+bool ParseChunkSize(unsigned char const* line, size_t len, uint64_t & size)
+{
+	size = 0;
+
+	size_t i = 0;
+	for (; i < len && line[i] != ';' && line[i] != ' ' && line[i] != '\t'; ++i) {
+		if (size >> 60) {
+			// Would overflow
+			return false;
+		}
+		size *= 16;
+		unsigned char const c = line[i];
+		if (c >= '0' && c <= '9') {
+			size += c - '0';
+		}
+		else if (c >= 'A' && c <= 'F') {
+			size += c - 'A' + 10;
+		}
+		else if (c >= 'a' && c <= 'f') {
+			size += c - 'a' + 10;
+		}
+		else {
+			return false;
+		}
+	}
+
+	return i != 0;
+}
+
 int CHttpRequestOpData::ParseHeader()
 {
 	LogMessage(MessageType::Debug_Verbose, L"CHttpRequestOpData::ParseHeader()");
@@ -442,37 +573,34 @@ int CHttpRequestOpData::ParseHeader()
 	// Parse the HTTP header.
 	// We do just the neccessary parsing and silently ignore most header fields
 	// The calling operation is responsible for things like redirect parsing.
+	// Lines are parsed in place in the receive buffer.
 	for (;;) {
-		// Find line ending
-		size_t i = 0;
-		for (i = 0; (i + 1) < recv_buffer_.size(); ++i) {
-			if (recv_buffer_[i] == '\r') {
-				if (recv_buffer_[i + 1] != '\n') {
-					LogMessage(MessageType::Error, _("Malformed response header: %s"), _("Server not sending proper line endings"));
-					return FZ_REPLY_ERROR;
-				}
-				break;
-			}
-			if (!recv_buffer_[i]) {
-				LogMessage(MessageType::Error, _("Malformed response header: %s"), _("Null character in line"));
-				return FZ_REPLY_ERROR;
-			}
-		}
-		if ((i + 1) >= recv_buffer_.size()) {
-			size_t const max_line_size = 8192;
-			if (recv_buffer_.size() >= max_line_size) {
-				LogMessage(MessageType::Error, _("Too long header line"));
-				return FZ_REPLY_ERROR;
-			}
+		size_t i{};
+		switch (FindLineEnd(i)) {
+		case line_ok:
+			break;
+		case line_incomplete:
 			return FZ_REPLY_WOULDBLOCK;
+		case line_bad_ending:
+			LogMessage(MessageType::Error, _("Malformed response header: %s"), _("Server not sending proper line endings"));
+			return FZ_REPLY_ERROR;
+		case line_null:
+			LogMessage(MessageType::Error, _("Malformed response header: %s"), _("Null character in line"));
+			return FZ_REPLY_ERROR;
+		case line_too_long:
+			LogMessage(MessageType::Error, _("Too long header line"));
+			return FZ_REPLY_ERROR;
 		}
 
-		std::wstring wline = fz::to_wstring_from_utf8(reinterpret_cast<char const*>(recv_buffer_.get()), i);
-		if (wline.empty()) {
-			wline = fz::to_wstring(std::string(recv_buffer_.get(), recv_buffer_.get() + i));
-		}
-		if (!wline.empty()) {
-			controlSocket_.LogMessageRaw(MessageType::Response, wline);
+		char const* const line = reinterpret_cast<char const*>(recv_buffer_.get());
+		if (controlSocket_.ShouldLog(MessageType::Response)) {
+			std::wstring wline = fz::to_wstring_from_utf8(line, i);
+			if (wline.empty()) {
+				wline = fz::to_wstring(std::string(line, i));
+			}
+			if (!wline.empty()) {
+				controlSocket_.LogMessageRaw(MessageType::Response, wline);
+			}
 		}
 
 		auto & response = requests_.front()->response();
@@ -503,28 +631,10 @@ int CHttpRequestOpData::ParseHeader()
 				return ProcessCompleteHeader();
 			}
 
-			std::string line(recv_buffer_.get(), recv_buffer_.get() + i);
-
-			auto delim_pos = line.find(':');
-			if (delim_pos == std::string::npos || !delim_pos) {
+			if (!AddHeaderLine(response.headers_, line, i)) {
 				LogMessage(MessageType::Error, _("Malformed response header: %s"), _("Invalid line"));
 				return FZ_REPLY_ERROR;
 			}
-
-			std::string value;
-			auto value_start = line.find_first_not_of(" \t", delim_pos + 1);
-			if (value_start != std::string::npos) {
-				int value_stop = line.find_last_not_of(" \t"); // Cannot fail
-				value = line.substr(value_start, value_stop - value_start + 1);
-			}
-
-			auto & header = response.headers_[line.substr(0, delim_pos)];
-			if (header.empty()) {
-				header = value;
-			}
-			else if (!value.empty()) {
-				header += ", " + value;
-			}
 		}
 
 		recv_buffer_.consume(i + 2);
@@ -569,7 +679,7 @@ int CHttpRequestOpData::ProcessCompleteHeader()
 	
 
 	int64_t length{-1};
-	auto const cl = response.get_header("Content-Length");
+	auto const& cl = response.get_header("Content-Length");
 	if (!cl.empty()) {
 		length = fz::to_integral<int64_t>(cl, -1);
 		if (length < 0) {
@@ -616,45 +726,40 @@ int CHttpRequestOpData::ParseChunkedData()
 {
 	while (!recv_buffer_.empty()) {
 		if (read_state_.chunk_data_.size != 0) {
-			size_t dataLen = recv_buffer_.size();
+			unsigned int dataLen = static_cast<unsigned int>(recv_buffer_.size());
 			if (read_state_.chunk_data_.size < recv_buffer_.size()) {
-				dataLen = static_cast<size_t>(read_state_.chunk_data_.size);
+				dataLen = static_cast<unsigned int>(read_state_.chunk_data_.size);
 			}
 			int res = ProcessData(recv_buffer_.get(), dataLen);
-			if (res != FZ_REPLY_CONTINUE) {
-				return res;
-			}
 			recv_buffer_.consume(dataLen);
 			read_state_.chunk_data_.size -= dataLen;
 
 			if (read_state_.chunk_data_.size == 0) {
 				read_state_.chunk_data_.terminateChunk = true;
 			}
-		}
 
-		// Find line ending
-		size_t i = 0;
-		for (i = 0; (i + 1) < recv_buffer_.size(); ++i) {
-			if (recv_buffer_[i] == '\r') {
-				if (recv_buffer_[i + 1] != '\n') {
-					LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Wrong line endings"));
-					return FZ_REPLY_ERROR;
-				}
-				break;
-			}
-			if (!recv_buffer_[i]) {
-				LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Null character in line"));
-				return FZ_REPLY_ERROR;
+			if (res != FZ_REPLY_CONTINUE) {
+				return res;
 			}
 		}
-		if ((i + 1) >= recv_buffer_.size()) {
-			size_t const max_line_size = 8192;
-			if (recv_buffer_.size() >= max_line_size) {
-				LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Line length exceeded"));
-				return FZ_REPLY_ERROR;
-			}
+
+		size_t i{};
+		auto const lr = FindLineEnd(i);
+		if (lr == line_incomplete) {
 			break;
 		}
+		else if (lr == line_bad_ending) {
+			LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Wrong line endings"));
+			return FZ_REPLY_ERROR;
+		}
+		else if (lr == line_null) {
+			LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Null character in line"));
+			return FZ_REPLY_ERROR;
+		}
+		else if (lr == line_too_long) {
+			LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Line length exceeded"));
+			return FZ_REPLY_ERROR;
+		}
 
 		if (read_state_.chunk_data_.terminateChunk) {
 			if (i) {
@@ -682,23 +787,9 @@ int CHttpRequestOpData::ParseChunkedData()
 		}
 		else {
 			// Read chunk size
-			unsigned char const* end = recv_buffer_.get() + i;
-			for (unsigned char* q = recv_buffer_.get(); q != end && *q != ';' && *q != ' '; ++q) {
-				read_state_.chunk_data_.size *= 16;
-				if (*q >= '0' && *q <= '9') {
-					read_state_.chunk_data_.size += *q - '0';
-				}
-				else if (*q >= 'A' && *q <= 'F') {
-					read_state_.chunk_data_.size += *q - 'A' + 10;
-				}
-				else if (*q >= 'a' && *q <= 'f') {
-					read_state_.chunk_data_.size += *q - 'a' + 10;
-				}
-				else {
-					// Invalid size
-					LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Invalid chunk size"));
-					return FZ_REPLY_ERROR;
-				}
+			if (!ParseChunkSize(recv_buffer_.get(), i, read_state_.chunk_data_.size)) {
+				LogMessage(MessageType::Error, _("Malformed chunk data: %s"), _("Invalid chunk size"));
+				return FZ_REPLY_ERROR;
 			}
 			if (!read_state_.chunk_data_.size) {
 				read_state_.chunk_data_.getTrailer = true;
@@ -711,10 +802,8 @@ int CHttpRequestOpData::ParseChunkedData()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
-int CHttpRequestOpData::ProcessData(unsigned char* data, unsigned int len)
+int CHttpRequestOpData::ProcessData(unsigned char* data, unsigned int & len)
 {
-	read_state_.receivedData_ += len;
-
 	int res = FZ_REPLY_CONTINUE;
 
 	auto & shared_response = requests_.front();
@@ -732,10 +821,38 @@ int CHttpRequestOpData::ProcessData(unsigned char* data, unsigned int len)
 		}
 
 		if (on_data) {
+			unsigned int const available = len;
 			res = (*on_data)(data, len);
+			if (res == FZ_REPLY_WOULDBLOCK) {
+				if (len > available) {
+					LogMessage(MessageType::Debug_Warning, L"on_data_ consumed more data than available");
+					return FZ_REPLY_INTERNALERROR;
+				}
+				read_state_.paused_ = true;
+			}
+			else if (res == FZ_REPLY_OK) {
+				if (len > available) {
+					LogMessage(MessageType::Debug_Warning, L"on_data_ consumed more data than available");
+					return FZ_REPLY_INTERNALERROR;
+				}
+				read_state_.receivedData_ += len;
+				response.flags_ |= HttpResponse::flag_got_body;
+				if (read_state_.receivedData_ != read_state_.responseContentLength_) {
+					// The remainder of the body is of no interest, the connection cannot be reused
+					LogMessage(MessageType::Debug_Info, L"Discarding remainder of the response body");
+					read_state_.keep_alive_ = false;
+					read_state_.discard_rest_ = true;
+				}
+				return FZ_REPLY_OK;
+			}
+			else if (res == FZ_REPLY_CONTINUE) {
+				len = available;
+			}
 		}
 	}
 
+	read_state_.receivedData_ += len;
+
 	if (res == FZ_REPLY_CONTINUE && read_state_.receivedData_ == read_state_.responseContentLength_) {
 		if (shared_response) {
 			shared_response->response().flags_ |= HttpResponse::flag_got_body;
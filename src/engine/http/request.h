@@ -7,6 +7,32 @@
 
 class CServerPath;
 
+// Adds a "name: value" header field line, without line ending, to the headers.
+// Repeated fields get combined into a comma-separated list.
+// Returns false if the line is malformed.
+bool AddHeaderLine(HttpHeaders & headers, char const* line, size_t len);
+
+enum line_result
+{
+	line_ok,
+	line_incomplete,
+	line_bad_ending,
+	line_null,
+	line_too_long
+};
+
+// Looks for the CRLF ending the line at the start of the buffer.
+// scanned is the number of bytes already known not to contain a line
+// ending. It is updated if the line is incomplete, so a line arriving
+// in pieces does not get rescanned, and reset once the line is complete.
+// On success, len is the length of the line without the line ending.
+line_result FindLineEnd(unsigned char const* buf, size_t size, size_t & scanned, size_t & len);
+
+// Parses the hexadecimal size at the start of a chunk size line, without
+// line ending. Chunk extensions are ignored.
+// Returns false if the size is missing or invalid.
+bool ParseChunkSize(unsigned char const* line, size_t len, uint64_t & size);
+
 enum requestStates
 {
 	request_done = 0,
@@ -33,14 +59,25 @@ public:
 
 	void AddRequest(std::shared_ptr<HttpRequestResponseInterface> const& rr);
 
-	int OnReceive();
+	int OnReceive(bool repeatedProcessing = false);
+
+	// Continues after on_data_ has returned FZ_REPLY_WOULDBLOCK
+	int ResumeReading();
 
 private:
 	int ParseReceiveBuffer(bool eof);
+
+	// Looks for the CRLF ending the line at the start of the receive buffer.
+	line_result FindLineEnd(size_t & len) {
+		return ::FindLineEnd(recv_buffer_.get(), recv_buffer_.size(), read_state_.line_scanned_, len);
+	}
 	int ParseHeader();
 	int ProcessCompleteHeader();
 	int ParseChunkedData();
-	int ProcessData(unsigned char* data, unsigned int len);
+	int ProcessData(unsigned char* data, unsigned int & len);
+
+	// After a request has been sent and there are more to send
+	void SetNextSendState(HttpRequest const& req);
 
 	std::deque<std::shared_ptr<HttpRequestResponseInterface>> requests_;
 
@@ -66,10 +103,20 @@ private:
 			uint64_t size{};
 		} chunk_data_;
 
+		// Bytes at the start of the receive buffer already known not
+		// to contain a line ending, avoids rescanning partial lines.
+		size_t line_scanned_{};
+
 		int64_t responseContentLength_{-1};
 		int64_t receivedData_{};
 
 		bool keep_alive_{};
+
+		// The consumer of the body cannot take any more data for now
+		bool paused_{};
+
+		// The consumer of the body does not want the rest of it
+		bool discard_rest_{};
 	};
 	read_state read_state_;
 
@@ -1,10 +1,13 @@
 #include <filezilla.h>
 
 #include "iothread.h"
+#include "metrics.h"
 
+#include <libfilezilla/encode.hpp>
 #include <libfilezilla/file.hpp>
 
 #include <assert.h>
+#include <zlib.h>
 
 CIOThread::CIOThread()
 {
@@ -29,7 +32,7 @@ void CIOThread::Close()
 	if (m_pFile) {
 		// The file might have been preallocated and the transfer stopped before being completed
 		// so always truncate the file to the actually written size before closing it.
-		if (!m_read) {
+		if (!m_read && m_truncate) {
 			m_pFile->truncate();
 		}
 
@@ -47,6 +50,21 @@ bool CIOThread::Create(fz::thread_pool& pool, std::unique_ptr<fz::file> && pFile
 	m_read = read;
 	m_binary = binary;
 
+	hash_.reset();
+	crc_ = crc32(0, nullptr, 0);
+	if (!binary) {
+		hash_type_ = TransferHash::none;
+	}
+	else if (hash_type_ == TransferHash::md5) {
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::md5);
+	}
+	else if (hash_type_ == TransferHash::sha1) {
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha1);
+	}
+	else if (hash_type_ == TransferHash::sha256) {
+		hash_ = std::make_unique<fz::hash_accumulator>(fz::hash_algorithm::sha256);
+	}
+
 	if (read) {
 		m_curAppBuf = BUFFERCOUNT - 1;
 		m_curThreadBuf = 0;
@@ -86,7 +104,7 @@ void CIOThread::entry()
 					m_running = false;
 					break;
 				}
-				m_appWaiting = false;
+				EndAppWait();
 				m_evtHandler->send_event<CIOThreadEvent>();
 			}
 
@@ -151,7 +169,7 @@ void CIOThread::entry()
 					m_running = false;
 					break;
 				}
-				m_appWaiting = false;
+				EndAppWait();
 				m_evtHandler->send_event<CIOThreadEvent>();
 			}
 
@@ -180,7 +198,7 @@ int CIOThread::GetNextWriteBuffer(char** pBuffer)
 
 	int newBuf = (m_curAppBuf + 1) % BUFFERCOUNT;
 	if (newBuf == m_curThreadBuf) {
-		m_appWaiting = true;
+		StartAppWait();
 		return IO_Again;
 	}
 
@@ -247,7 +265,7 @@ int CIOThread::GetNextReadBuffer(char** pBuffer)
 			return IO_Success;
 		}
 		else {
-			m_appWaiting = true;
+			StartAppWait();
 			return IO_Again;
 		}
 	}
@@ -296,7 +314,9 @@ int64_t CIOThread::ReadFromFile(char* pBuffer, int64_t maxLen)
 	if (m_binary)
 #endif
 	{
-		return m_pFile->read(pBuffer, maxLen);
+		auto len = m_pFile->read(pBuffer, maxLen);
+		UpdateHash(pBuffer, len);
+		return len;
 	}
 
 #ifndef FZ_WINDOWS
@@ -403,6 +423,7 @@ bool CIOThread::DoWrite(const char* pBuffer, int64_t len)
 {
 	auto written = m_pFile->write(pBuffer, len);
 	if (written == len) {
+		UpdateHash(pBuffer, len);
 		return true;
 	}
 
@@ -422,8 +443,73 @@ std::wstring CIOThread::GetError()
 	return m_error_description;
 }
 
+bool CIOThread::Fsync()
+{
+	return m_pFile && m_pFile->fsync();
+}
+
 void CIOThread::SetEventHandler(fz::event_handler* handler)
 {
 	fz::scoped_lock locker(m_mutex);
 	m_evtHandler = handler;
 }
+
+void CIOThread::SetHash(TransferHash hash)
+{
+	hash_type_ = hash;
+}
+
+void CIOThread::SetMetrics(CMetrics & metrics)
+{
+	stalls_ = &metrics.ioThreadStalls_;
+	stallTime_ = &metrics.ioThreadStallTime_;
+}
+
+void CIOThread::StartAppWait()
+{
+	if (m_appWaiting) {
+		return;
+	}
+
+	m_appWaiting = true;
+	if (stalls_) {
+		stalls_->Add();
+		m_appWaitStart = fz::monotonic_clock::now();
+	}
+}
+
+void CIOThread::EndAppWait()
+{
+	m_appWaiting = false;
+	if (stallTime_) {
+		stallTime_->Observe(fz::monotonic_clock::now() - m_appWaitStart);
+	}
+}
+
+void CIOThread::UpdateHash(char const* pBuffer, int64_t len)
+{
+	if (len <= 0 || !m_binary) {
+		return;
+	}
+
+	if (hash_type_ == TransferHash::crc32) {
+		crc_ = crc32(crc_, reinterpret_cast<Bytef const*>(pBuffer), static_cast<uInt>(len));
+	}
+	else if (hash_) {
+		hash_->update(reinterpret_cast<uint8_t const*>(pBuffer), static_cast<size_t>(len));
+	}
+}
+
+std::wstring CIOThread::GetHash()
+{
+	fz::scoped_lock locker(m_mutex);
+
+	if (hash_type_ == TransferHash::crc32) {
+		return fz::sprintf(L"%08x", static_cast<uint32_t>(crc_));
+	}
+	else if (hash_) {
+		return fz::hex_encode<std::wstring>(hash_->digest());
+	}
+
+	return std::wstring();
+}
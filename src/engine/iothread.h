@@ -2,7 +2,9 @@
 #define FILEZILLA_ENGINE_IOTHREAD_HEADER
 
 #include <libfilezilla/event.hpp>
+#include <libfilezilla/hash.hpp>
 #include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
 
 #define BUFFERCOUNT 8
 #define BUFFERSIZE 256*1024
@@ -22,10 +24,23 @@ enum IORet
 	IO_Again = -1
 };
 
+enum class TransferHash
+{
+	none,
+	crc32,
+	md5,
+	sha1,
+	sha256
+};
+
 namespace fz {
 class file;
 }
 
+class CMetricCounter;
+class CMetricHistogram;
+class CMetrics;
+
 class CIOThread final
 {
 public:
@@ -58,6 +73,25 @@ public:
 
 	std::wstring GetError();
 
+	// Flushes the written data to disk. Only call after Finalize.
+	bool Fsync();
+
+	// Hashes all data read from or written to the file in the IO thread.
+	// Call before Create, has no effect in ASCII mode.
+	void SetHash(TransferHash hash);
+
+	// Lowercase hex digest, only valid after the transfer has completed.
+	std::wstring GetHash();
+
+	// Call before Create. By default files written to get truncated to the
+	// written size when closed. That is not wanted if several writers fill
+	// in different parts of a preallocated file.
+	void SetTruncate(bool truncate) { m_truncate = truncate; }
+
+	// Call before Create. Records how often and how long the caller has to
+	// wait for the thread to catch up with reading or writing the file.
+	void SetMetrics(CMetrics & metrics);
+
 private:
 	void Close();
 
@@ -67,10 +101,17 @@ private:
 	bool WriteToFile(char* pBuffer, int64_t len);
 	bool DoWrite(const char* pBuffer, int64_t len);
 
+	void UpdateHash(char const* pBuffer, int64_t len);
+
+	// Mutex must be locked
+	void StartAppWait();
+	void EndAppWait();
+
 	fz::event_handler* m_evtHandler{};
 
 	bool m_read{};
 	bool m_binary{};
+	bool m_truncate{true};
 	std::unique_ptr<fz::file> m_pFile;
 
 	char* m_buffers[BUFFERCOUNT];
@@ -86,9 +127,17 @@ private:
 	bool m_running{};
 	bool m_threadWaiting{};
 	bool m_appWaiting{};
+	fz::monotonic_clock m_appWaitStart;
+
+	CMetricCounter* stalls_{};
+	CMetricHistogram* stallTime_{};
 
 	bool m_wasCarriageReturn{};
 
+	TransferHash hash_type_{TransferHash::none};
+	std::unique_ptr<fz::hash_accumulator> hash_;
+	unsigned long crc_{};
+
 	std::wstring m_error_description;
 
 #ifdef SIMULATE_IO
@@ -0,0 +1,529 @@
+#include <filezilla.h>
+
+#include "logfile_writer.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef FZ_WINDOWS
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+namespace {
+uint64_t const no_sequence = static_cast<uint64_t>(-1);
+}
+
+// Single producer, single consumer ring buffer. Head and tail are
+// monotonically increasing, the capacity is a power of two.
+struct logfile_ring final
+{
+	explicit logfile_ring(size_t capacity)
+		: data_(new unsigned char[capacity])
+		, capacity_(capacity)
+	{}
+
+	void read(size_t pos, void* out, size_t len) const
+	{
+		pos &= capacity_ - 1;
+		size_t const first = std::min(len, capacity_ - pos);
+		memcpy(out, data_.get() + pos, first);
+		memcpy(static_cast<unsigned char*>(out) + first, data_.get(), len - first);
+	}
+
+	void write(size_t pos, void const* in, size_t len)
+	{
+		pos &= capacity_ - 1;
+		size_t const first = std::min(len, capacity_ - pos);
+		memcpy(data_.get() + pos, in, first);
+		memcpy(data_.get(), static_cast<unsigned char const*>(in) + first, len - first);
+	}
+
+	std::unique_ptr<unsigned char[]> const data_;
+	size_t const capacity_;
+
+	// Written by the producer
+	std::atomic<size_t> head_{};
+
+	// Written by the writer thread
+	std::atomic<size_t> tail_{};
+
+	// Set by the producer if it waits for space in the buffer
+	std::atomic<bool> waiting_{};
+
+	// Set once the producing thread has exited
+	std::atomic<bool> abandoned_{};
+
+	// Lower bound of the sequence number of the record the producer is
+	// about to publish, no_sequence otherwise.
+	std::atomic<uint64_t> pending_{no_sequence};
+
+	fz::mutex mtx_{false};
+	fz::condition cond_;
+};
+
+namespace {
+size_t const ring_capacity = 256 * 1024;
+
+// Upper limit of data collected by the writer thread before it writes to the file
+size_t const max_batch_size = 1024 * 1024;
+
+struct record_header final
+{
+	uint64_t sequence;
+	int64_t time;
+	unsigned int engineId;
+	unsigned int type;
+	size_t size;
+};
+
+struct local_ring final
+{
+	~local_ring()
+	{
+		if (ring_) {
+			ring_->abandoned_ = true;
+		}
+	}
+
+	std::shared_ptr<logfile_ring> ring_;
+	uint64_t generation_{};
+};
+
+thread_local local_ring current_ring;
+
+std::atomic<uint64_t> next_generation{};
+}
+
+CLogFileWriter::CLogFileWriter(fz::native_string const& file, file_handle fd, int64_t maxSize, std::string const* prefixes)
+	: file_(file)
+	, fd_(fd)
+	, maxSize_(maxSize)
+	, generation_(++next_generation)
+{
+	for (int i = 0; i < static_cast<int>(MessageType::count); ++i) {
+		prefixes_[i] = prefixes[i];
+	}
+
+#if FZ_WINDOWS
+	pid_ = std::to_string(GetCurrentProcessId());
+#else
+	pid_ = std::to_string(getpid());
+#endif
+
+	run();
+}
+
+CLogFileWriter::~CLogFileWriter()
+{
+	{
+		fz::scoped_lock l(mtx_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	join();
+
+#ifdef FZ_WINDOWS
+	if (fd_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(fd_);
+	}
+#else
+	if (fd_ != -1) {
+		close(fd_);
+	}
+#endif
+}
+
+logfile_ring& CLogFileWriter::GetRing()
+{
+	if (!current_ring.ring_ || current_ring.generation_ != generation_) {
+		if (current_ring.ring_) {
+			// Belongs to a previous writer
+			current_ring.ring_->abandoned_ = true;
+		}
+
+		auto ring = std::make_shared<logfile_ring>(ring_capacity);
+		{
+			fz::scoped_lock l(mtx_);
+			rings_.push_back(ring);
+		}
+		current_ring.ring_ = std::move(ring);
+		current_ring.generation_ = generation_;
+	}
+
+	return *current_ring.ring_;
+}
+
+void CLogFileWriter::Wakeup()
+{
+	if (!signalled_.exchange(true)) {
+		fz::scoped_lock l(mtx_);
+		cond_.signal(l);
+	}
+}
+
+void CLogFileWriter::Log(MessageType nMessageType, unsigned int engineId, std::wstring const& msg)
+{
+	if (failed_) {
+		return;
+	}
+
+	std::string const utf8 = fz::to_utf8(msg);
+
+	logfile_ring& r = GetRing();
+
+	record_header h;
+	h.time = fz::datetime::now().get_time_t();
+	h.engineId = engineId;
+	h.type = static_cast<unsigned int>(nMessageType);
+	h.size = std::min(utf8.size(), r.capacity_ - sizeof(h));
+
+	size_t const needed = sizeof(h) + h.size;
+	size_t const head = r.head_.load(std::memory_order_relaxed);
+	if (r.capacity_ - (head - r.tail_) < needed) {
+		// Writer thread cannot keep up, wait for it.
+		r.waiting_ = true;
+		Wakeup();
+
+		fz::scoped_lock l(r.mtx_);
+		while (r.capacity_ - (head - r.tail_) < needed && !failed_) {
+			r.cond_.wait(l, fz::duration::from_milliseconds(100));
+		}
+		r.waiting_ = false;
+
+		// Still no room if the writer has given up, the message is lost
+		if (r.capacity_ - (head - r.tail_) < needed) {
+			return;
+		}
+	}
+
+	// Announced before the sequence number is taken, so that the writer
+	// thread never writes lines logged after this one before it. The number
+	// is taken as late as possible so that the lines of different threads
+	// are written in the order they were logged.
+	r.pending_ = nextSequence_.load();
+	h.sequence = nextSequence_++;
+
+	r.write(head, &h, sizeof(h));
+	r.write(head + sizeof(h), utf8.c_str(), h.size);
+	r.head_.store(head + needed, std::memory_order_release);
+	r.pending_ = no_sequence;
+
+	Wakeup();
+}
+
+std::wstring CLogFileWriter::TakeError()
+{
+	fz::scoped_lock l(mtx_);
+	std::wstring ret;
+	std::swap(ret, error_);
+	return ret;
+}
+
+void CLogFileWriter::Fail(std::wstring const& error)
+{
+	{
+		fz::scoped_lock l(mtx_);
+		error_ = error;
+	}
+	failed_ = true;
+}
+
+void CLogFileWriter::entry()
+{
+	std::vector<std::shared_ptr<logfile_ring>> rings;
+
+	bool quit = false;
+	while (!quit) {
+		{
+			fz::scoped_lock l(mtx_);
+			while (!quit_ && !signalled_) {
+				cond_.wait(l);
+			}
+			quit = quit_;
+
+			// Anything logged after this point triggers another round
+			signalled_ = false;
+
+			// Producers that have exited and whose data has been written can be forgotten
+			rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](std::shared_ptr<logfile_ring> const& r) {
+				return r->abandoned_ && r->head_ == r->tail_;
+			}), rings_.end());
+			rings = rings_;
+		}
+
+		Drain(rings, quit);
+	}
+}
+
+void CLogFileWriter::Drain(std::vector<std::shared_ptr<logfile_ring>> const& rings, bool flush)
+{
+	bool more = true;
+	while (more) {
+		more = false;
+
+		// Every line with a sequence number below the watermark has been
+		// published once the heads are loaded below. Lines at or above it may
+		// still be preceded by a line another thread has yet to publish, they
+		// are kept until the next round. Producers announce a lower bound of
+		// their sequence number before taking it, so reading the next number
+		// first and the announcements afterwards cannot miss any.
+		uint64_t watermark = flush ? no_sequence : nextSequence_.load();
+		for (auto const& r : rings) {
+			watermark = std::min(watermark, r->pending_.load());
+		}
+
+		size_t read = 0;
+		for (auto const& r : rings) {
+			size_t tail = r->tail_.load(std::memory_order_relaxed);
+			size_t const head = r->head_.load(std::memory_order_acquire);
+			while (tail != head && read < max_batch_size) {
+				record_header h;
+				r->read(tail, &h, sizeof(h));
+				if (head - tail < sizeof(h) || head - tail - sizeof(h) < h.size) {
+					// Cannot happen unless the ring has been corrupted, don't read past the head
+					tail = head;
+					break;
+				}
+				tail += sizeof(h);
+				read += sizeof(h) + h.size;
+
+				if (!failed_) {
+					lines_.push_back(line{h.sequence, formatted_.size(), 0});
+
+					if (h.time != cachedTime_) {
+						cachedTime_ = h.time;
+						timestamp_ = fz::datetime(static_cast<time_t>(h.time), fz::datetime::seconds).format("%Y-%m-%d %H:%M:%S", fz::datetime::local);
+					}
+					formatted_ += timestamp_;
+					formatted_ += ' ';
+					formatted_ += pid_;
+					formatted_ += ' ';
+					formatted_ += std::to_string(h.engineId);
+					formatted_ += ' ';
+					formatted_ += prefixes_[h.type];
+					formatted_ += ' ';
+
+					size_t const offset = formatted_.size();
+					formatted_.resize(offset + h.size);
+					r->read(tail, &formatted_[offset], h.size);
+#ifdef FZ_WINDOWS
+					formatted_ += "\r\n";
+#else
+					formatted_ += '\n';
+#endif
+					lines_.back().size = formatted_.size() - lines_.back().offset;
+				}
+				tail += h.size;
+			}
+			if (tail != head) {
+				more = true;
+
+				// Lines logged after the first one left in the buffer have to wait
+				record_header h;
+				r->read(tail, &h, sizeof(h));
+				watermark = std::min(watermark, h.sequence);
+			}
+			r->tail_ = tail;
+
+			if (r->waiting_) {
+				fz::scoped_lock l(r->mtx_);
+				r->cond_.signal(l);
+			}
+		}
+
+		Write(watermark);
+	}
+}
+
+void CLogFileWriter::Write(uint64_t watermark)
+{
+	if (failed_) {
+		lines_.clear();
+		formatted_.clear();
+		return;
+	}
+
+	std::sort(lines_.begin(), lines_.end(), [](line const& lhs, line const& rhs) { return lhs.sequence < rhs.sequence; });
+	auto const end = std::lower_bound(lines_.begin(), lines_.end(), watermark, [](line const& l, uint64_t sequence) { return l.sequence < sequence; });
+
+	out_.clear();
+	for (auto it = lines_.begin(); it != end; ++it) {
+		out_.append(formatted_, it->offset, it->size);
+	}
+
+	// Keep the lines that wait for earlier ones
+	held_.clear();
+	auto dest = lines_.begin();
+	for (auto it = end; it != lines_.end(); ++it, ++dest) {
+		size_t const offset = held_.size();
+		held_.append(formatted_, it->offset, it->size);
+		*dest = line{it->sequence, offset, it->size};
+	}
+	lines_.erase(dest, lines_.end());
+	std::swap(formatted_, held_);
+
+	if (out_.empty()) {
+		return;
+	}
+
+	// Rotation is checked once per batch rather than for each line
+	if (maxSize_ && !Rotate()) {
+		return;
+	}
+
+#ifdef FZ_WINDOWS
+	DWORD len = static_cast<DWORD>(out_.size());
+	DWORD written;
+	BOOL res = WriteFile(fd_, out_.c_str(), len, &written, nullptr);
+	if (!res || written != len) {
+		DWORD err = GetLastError();
+		CloseHandle(fd_);
+		fd_ = INVALID_HANDLE_VALUE;
+		Fail(fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err)));
+	}
+#else
+	size_t written = write(fd_, out_.c_str(), out_.size());
+	if (written != out_.size()) {
+		int err = errno;
+		close(fd_);
+		fd_ = -1;
+		Fail(fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err)));
+	}
+#endif
+}
+
+bool CLogFileWriter::Rotate()
+{
+#ifdef FZ_WINDOWS
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fd_, &size) || size.QuadPart > maxSize_) {
+		CloseHandle(fd_);
+		fd_ = INVALID_HANDLE_VALUE;
+
+		// fd_ might no longer be the original file.
+		// Recheck on a new handle. Proteced with a mutex against other processes
+		HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
+		if (!hMutex) {
+			DWORD err = GetLastError();
+			Fail(fz::sprintf(_("Could not create logging mutex: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+
+		HANDLE hFile = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE) {
+			DWORD err = GetLastError();
+
+			// Oh dear..
+			ReleaseMutex(hMutex);
+			CloseHandle(hMutex);
+
+			Fail(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+
+		DWORD err{};
+		if (GetFileSizeEx(hFile, &size) && size.QuadPart > maxSize_) {
+			CloseHandle(hFile);
+
+			// MoveFileEx can fail if trying to access a deleted file for which another process still has
+			// a handle. Move it far away first.
+			// Todo: Handle the case in which logdir and tmpdir are on different volumes.
+			// (Why is everthing so needlessly complex on MSW?)
+
+			wchar_t tempDir[MAX_PATH + 1];
+			DWORD res = GetTempPath(MAX_PATH, tempDir);
+			if (res && res <= MAX_PATH) {
+				tempDir[MAX_PATH] = 0;
+
+				wchar_t tempFile[MAX_PATH + 1];
+				res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
+				if (res) {
+					tempFile[MAX_PATH] = 0;
+					MoveFileExW((file_ + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
+					DeleteFileW(tempFile);
+				}
+			}
+			MoveFileExW(file_.c_str(), (file_ + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
+			fd_ = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (fd_ == INVALID_HANDLE_VALUE) {
+				// If this function would return bool, I'd return FILE_NOT_FOUND here.
+				err = GetLastError();
+			}
+		}
+		else {
+			fd_ = hFile;
+		}
+
+		if (hMutex) {
+			ReleaseMutex(hMutex);
+			CloseHandle(hMutex);
+		}
+
+		if (err) {
+			Fail(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+	}
+#else
+	struct stat buf;
+	int rc = fstat(fd_, &buf);
+	while (!rc && buf.st_size > maxSize_) {
+		struct flock lock = {};
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0;
+		lock.l_len = 1;
+
+		// Retry through signals
+		while ((rc = fcntl(fd_, F_SETLKW, &lock)) == -1 && errno == EINTR);
+
+		// Ignore any other failures
+		int fd = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd == -1) {
+			int err = errno;
+
+			close(fd_);
+			fd_ = -1;
+
+			Fail(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+		struct stat buf2;
+		rc = fstat(fd, &buf2);
+
+		// Different files
+		if (!rc && buf.st_ino != buf2.st_ino) {
+			close(fd_); // Releases the lock
+			fd_ = fd;
+			buf = buf2;
+			continue;
+		}
+
+		// The file is indeed the log file and we are holding a lock on it.
+
+		// Rename it
+		rc = rename(file_.c_str(), (file_ + ".1").c_str());
+		close(fd_);
+		close(fd);
+
+		// Get the new file
+		fd_ = open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd_ == -1) {
+			int err = errno;
+			Fail(fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err)));
+			return false;
+		}
+
+		if (!rc) {
+			// Rename didn't fail
+			rc = fstat(fd_, &buf);
+		}
+	}
+#endif
+
+	return true;
+}
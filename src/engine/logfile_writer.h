@@ -0,0 +1,99 @@
+#ifndef FILEZILLA_ENGINE_LOGFILE_WRITER_HEADER
+#define FILEZILLA_ENGINE_LOGFILE_WRITER_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct logfile_ring;
+
+// Writes the log file on behalf of all engines.
+//
+// Each logging thread has its own ring buffer into which it copies the raw
+// messages without taking any locks. A single background thread drains the
+// buffers, formats the lines, writes them out in batches and rotates the
+// file once it exceeds the size limit. Logging threads only ever block if
+// their buffer is full.
+//
+// Lines of different threads are written in the order they were logged. A
+// line is held back until every line logged before it has been read from
+// the buffers.
+class CLogFileWriter final : protected fz::thread
+{
+public:
+#ifdef FZ_WINDOWS
+	typedef HANDLE file_handle;
+#else
+	typedef int file_handle;
+#endif
+
+	// Takes ownership of the already opened file. Prefixes holds one entry per message type.
+	CLogFileWriter(fz::native_string const& file, file_handle fd, int64_t maxSize, std::string const* prefixes);
+
+	// Writes out everything that has been logged so far
+	virtual ~CLogFileWriter();
+
+	CLogFileWriter(CLogFileWriter const&) = delete;
+	CLogFileWriter& operator=(CLogFileWriter const&) = delete;
+
+	void Log(MessageType nMessageType, unsigned int engineId, std::wstring const& msg);
+
+	// Once the log file could not be written, nothing gets logged to it anymore.
+	bool Failed() const { return failed_; }
+
+	// Returns the reason for the failure exactly once, an empty string afterwards.
+	std::wstring TakeError();
+
+private:
+	virtual void entry() override;
+
+	logfile_ring& GetRing();
+	void Wakeup();
+
+	// Once flushing, everything read gets written without waiting for
+	// lines that are still being logged.
+	void Drain(std::vector<std::shared_ptr<logfile_ring>> const& rings, bool flush);
+	void Write(uint64_t watermark);
+	bool Rotate();
+
+	void Fail(std::wstring const& error);
+
+	fz::native_string const file_;
+	file_handle fd_;
+	int64_t const maxSize_;
+	std::string prefixes_[static_cast<int>(MessageType::count)];
+	std::string pid_;
+
+	uint64_t const generation_;
+
+	fz::mutex mtx_{false};
+	fz::condition cond_;
+	std::vector<std::shared_ptr<logfile_ring>> rings_;
+	bool quit_{};
+	std::wstring error_;
+
+	std::atomic<bool> signalled_{};
+	std::atomic<bool> failed_{};
+	std::atomic<uint64_t> nextSequence_{};
+
+	// Only accessed by the writer thread
+	struct line final
+	{
+		uint64_t sequence;
+		size_t offset;
+		size_t size;
+	};
+	std::vector<line> lines_;
+	std::string formatted_;
+	std::string held_;
+	std::string out_;
+
+	int64_t cachedTime_{-1};
+	std::string timestamp_;
+};
+
+#endif
@@ -4,8 +4,13 @@
 #include "engineprivate.h"
 #include <libfilezilla/format.hpp>
 #include <libfilezilla/mutex.hpp>
+
+#include <atomic>
+#include <memory>
 #include <utility>
 
+class CLogFileWriter;
+
 class CLogging
 {
 public:
@@ -53,16 +58,8 @@ private:
 	bool InitLogFile(fz::scoped_lock& l) const;
 	void LogToFile(MessageType nMessageType, std::wstring const& msg) const;
 
-	static bool m_logfile_initialized;
-#ifdef FZ_WINDOWS
-	static HANDLE m_log_fd;
-#else
-	static int m_log_fd;
-#endif
-	static std::string m_prefixes[static_cast<int>(MessageType::count)];
-	static unsigned int m_pid;
-	static int m_max_size;
-	static fz::native_string m_file;
+	static std::atomic<bool> m_logfile_initialized;
+	static std::unique_ptr<CLogFileWriter> m_writer;
 
 	static int m_refcount;
 
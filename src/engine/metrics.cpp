@@ -0,0 +1,286 @@
+#include <filezilla.h>
+
+#include "metrics.h"
+
+#include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/file.hpp>
+
+#include <algorithm>
+#include <locale>
+#include <sstream>
+
+#include <assert.h>
+#include <stdio.h>
+
+namespace {
+struct metrics_options_changed_event_type{};
+typedef fz::simple_event<metrics_options_changed_event_type> CMetricsOptionsChangedEvent;
+
+// In seconds
+std::vector<double> const latency_bounds = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+std::vector<double> const short_duration_bounds = { 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5 };
+
+// In bytes per second, 1 KiB/s to 1 GiB/s
+std::vector<double> rate_bounds()
+{
+	std::vector<double> ret;
+	for (double b = 1024; b <= 1024 * 1024 * 1024; b *= 4) {
+		ret.push_back(b);
+	}
+	return ret;
+}
+
+// Independent of the locale, Prometheus wants a dot as decimal separator
+std::string format_double(double v)
+{
+	std::ostringstream s;
+	s.imbue(std::locale::classic());
+	s << v;
+	return s.str();
+}
+
+std::string series(std::string const& name, std::string const& labels, std::string const& extra = std::string())
+{
+	std::string ret = name;
+	if (!labels.empty() || !extra.empty()) {
+		ret += '{';
+		ret += labels;
+		if (!labels.empty() && !extra.empty()) {
+			ret += ',';
+		}
+		ret += extra;
+		ret += '}';
+	}
+	return ret;
+}
+}
+
+CMetricHistogram::CMetricHistogram(std::vector<double> const& bounds)
+	: bounds_(bounds)
+	, buckets_(new std::atomic<uint64_t>[bounds.size() + 1])
+{
+	for (size_t i = 0; i <= bounds_.size(); ++i) {
+		buckets_[i] = 0;
+	}
+}
+
+void CMetricHistogram::Observe(double value)
+{
+	size_t const bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+	++buckets_[bucket];
+
+	double sum = sum_.load(std::memory_order_relaxed);
+	while (!sum_.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+	}
+}
+
+CMetrics::CMetrics()
+	: controlRtt_(AddHistogram("filezilla_control_rtt_seconds", "Round trip time of FTP control connections, from sending a command to the first line of its reply", latency_bounds))
+	, transferredBytes_(AddCounter("filezilla_transferred_bytes_total", "Bytes transferred in file transfers and directory listings"))
+	, activeTransfers_(AddGauge("filezilla_transfers_active", "Number of transfers in progress"))
+	, transferRate_(AddHistogram("filezilla_transfer_rate_bytes_per_second", "Average speed of finished transfers", rate_bounds()))
+	, pathCacheHits_(AddCounter("filezilla_path_cache_lookups_total", "Lookups in the cache of canonicalized remote paths", "result=\"hit\""))
+	, pathCacheMisses_(AddCounter("filezilla_path_cache_lookups_total", "Lookups in the cache of canonicalized remote paths", "result=\"miss\""))
+	, directoryCacheHits_(AddCounter("filezilla_directory_cache_lookups_total", "Lookups in the directory listing cache", "result=\"hit\""))
+	, directoryCacheMisses_(AddCounter("filezilla_directory_cache_lookups_total", "Lookups in the directory listing cache", "result=\"miss\""))
+	, listingParseTime_(AddHistogram("filezilla_listing_parse_seconds", "Time spent parsing a directory listing", short_duration_bounds))
+	, ioThreadStalls_(AddCounter("filezilla_iothread_stalls_total", "Number of times a transfer had to wait for the thread reading or writing the local file"))
+	, ioThreadStallTime_(AddHistogram("filezilla_iothread_stall_seconds", "Time a transfer waited for the thread reading or writing the local file", short_duration_bounds))
+{
+	char const* const directions[] = { "direction=\"inbound\"", "direction=\"outbound\"" };
+	for (int i = 0; i < 2; ++i) {
+		rateLimitWaits_[i] = &AddCounter("filezilla_ratelimit_waits_total", "Number of times a connection had to wait for the speed limit", directions[i]);
+		rateLimitWaitTime_[i] = &AddHistogram("filezilla_ratelimit_wait_seconds", "Time a connection waited for the speed limit", short_duration_bounds, directions[i]);
+	}
+}
+
+CMetrics::metric& CMetrics::Add(metric_type type, std::string const& name, std::string const& help, std::string const& labels)
+{
+	metric & m = metrics_[std::make_pair(name, labels)];
+	if (m.help.empty()) {
+		m.type = type;
+		m.help = help;
+	}
+	assert(m.type == type);
+
+	return m;
+}
+
+CMetricCounter& CMetrics::AddCounter(std::string const& name, std::string const& help, std::string const& labels)
+{
+	fz::scoped_lock l(mutex_);
+
+	metric & m = Add(metric_type::counter, name, help, labels);
+	if (!m.counter) {
+		m.counter = std::make_unique<CMetricCounter>();
+	}
+	return *m.counter;
+}
+
+CMetricGauge& CMetrics::AddGauge(std::string const& name, std::string const& help, std::string const& labels)
+{
+	fz::scoped_lock l(mutex_);
+
+	metric & m = Add(metric_type::gauge, name, help, labels);
+	if (!m.gauge) {
+		m.gauge = std::make_unique<CMetricGauge>();
+	}
+	return *m.gauge;
+}
+
+CMetricHistogram& CMetrics::AddHistogram(std::string const& name, std::string const& help, std::vector<double> const& bounds, std::string const& labels)
+{
+	fz::scoped_lock l(mutex_);
+
+	metric & m = Add(metric_type::histogram, name, help, labels);
+	if (!m.histogram) {
+		m.histogram = std::make_unique<CMetricHistogram>(bounds);
+	}
+	return *m.histogram;
+}
+
+std::string CMetrics::Format() const
+{
+	std::string ret;
+
+	fz::scoped_lock l(mutex_);
+
+	std::string const* last{};
+	for (auto const& it : metrics_) {
+		std::string const& name = it.first.first;
+		std::string const& labels = it.first.second;
+		metric const& m = it.second;
+
+		if (!last || *last != name) {
+			last = &name;
+			ret += "# HELP " + name + " " + m.help + "\n";
+			ret += "# TYPE " + name + " ";
+			switch (m.type) {
+			case metric_type::counter:
+				ret += "counter\n";
+				break;
+			case metric_type::gauge:
+				ret += "gauge\n";
+				break;
+			case metric_type::histogram:
+				ret += "histogram\n";
+				break;
+			}
+		}
+
+		if (m.counter) {
+			ret += series(name, labels) + " " + std::to_string(m.counter->Get()) + "\n";
+		}
+		else if (m.gauge) {
+			ret += series(name, labels) + " " + std::to_string(m.gauge->Get()) + "\n";
+		}
+		else if (m.histogram) {
+			CMetricHistogram const& h = *m.histogram;
+
+			// Bucket counts are cumulative in the output
+			uint64_t cumulative{};
+			for (size_t i = 0; i < h.bounds_.size(); ++i) {
+				cumulative += h.buckets_[i];
+				ret += series(name + "_bucket", labels, "le=\"" + format_double(h.bounds_[i]) + "\"") + " " + std::to_string(cumulative) + "\n";
+			}
+			cumulative += h.buckets_[h.bounds_.size()];
+			ret += series(name + "_bucket", labels, "le=\"+Inf\"") + " " + std::to_string(cumulative) + "\n";
+			ret += series(name + "_sum", labels) + " " + format_double(h.sum_) + "\n";
+
+			// Consistent with the +Inf bucket even if observations happen while formatting
+			ret += series(name + "_count", labels) + " " + std::to_string(cumulative) + "\n";
+		}
+	}
+
+	return ret;
+}
+
+bool CMetrics::WriteToFile(fz::native_string const& file) const
+{
+	std::string const data = Format();
+
+	// Readers must never see a partially written file
+	fz::native_string const tmp = file + fzT(".tmp");
+	{
+		fz::file f(tmp, fz::file::writing, fz::file::empty);
+		if (!f.opened()) {
+			return false;
+		}
+		if (f.write(data.c_str(), static_cast<int64_t>(data.size())) != static_cast<int64_t>(data.size())) {
+			return false;
+		}
+	}
+
+#ifdef FZ_WINDOWS
+	return MoveFileExW(tmp.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(tmp.c_str(), file.c_str()) == 0;
+#endif
+}
+
+CMetricsWriter::CMetricsWriter(CMetrics & metrics, COptionsBase & options, fz::event_loop & loop)
+	: fz::event_handler(loop)
+	, metrics_(metrics)
+	, options_(options)
+{
+	RegisterOption(OPTION_METRICS_FILE);
+	RegisterOption(OPTION_METRICS_INTERVAL);
+	send_event<CMetricsOptionsChangedEvent>();
+}
+
+CMetricsWriter::~CMetricsWriter()
+{
+	remove_handler();
+}
+
+void CMetricsWriter::OnOptionsChanged(changed_options_t const& options)
+{
+	if (options.test(OPTION_METRICS_FILE) || options.test(OPTION_METRICS_INTERVAL)) {
+		send_event<CMetricsOptionsChangedEvent>();
+	}
+}
+
+void CMetricsWriter::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::timer_event, CMetricsOptionsChangedEvent>(ev, this,
+		&CMetricsWriter::OnTimer,
+		&CMetricsWriter::OnOptions);
+}
+
+void CMetricsWriter::OnOptions()
+{
+	stop_timer(timer_);
+	timer_ = 0;
+
+	file_ = fz::to_native(options_.GetOption(OPTION_METRICS_FILE));
+	if (!file_.empty()) {
+		timer_ = add_timer(fz::duration::from_seconds(options_.GetOptionVal(OPTION_METRICS_INTERVAL)), false);
+	}
+}
+
+void CMetricsWriter::OnTimer(fz::timer_id)
+{
+	if (file_.empty()) {
+		return;
+	}
+
+	if (metrics_.WriteToFile(file_)) {
+		failed_ = false;
+	}
+	else if (!failed_) {
+		// Only reported once until writing succeeds again, there is no
+		// point in repeating it every interval.
+		failed_ = true;
+
+		fz::scoped_lock l(mutex_);
+		error_ = fz::sprintf(_("Could not write metrics file \"%s\""), fz::to_wstring(file_));
+	}
+}
+
+std::wstring CMetricsWriter::TakeError()
+{
+	fz::scoped_lock l(mutex_);
+	std::wstring ret;
+	std::swap(ret, error_);
+	return ret;
+}
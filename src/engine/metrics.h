@@ -0,0 +1,160 @@
+#ifndef FILEZILLA_ENGINE_METRICS_HEADER
+#define FILEZILLA_ENGINE_METRICS_HEADER
+
+#include "option_change_event_handler.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Monotonically increasing value
+class CMetricCounter final
+{
+public:
+	void Add(int64_t v = 1) { value_ += v; }
+	int64_t Get() const { return value_; }
+
+private:
+	std::atomic<int64_t> value_{};
+};
+
+// Value that can go up and down
+class CMetricGauge final
+{
+public:
+	void Add(int64_t v) { value_ += v; }
+	void Set(int64_t v) { value_ = v; }
+	int64_t Get() const { return value_; }
+
+private:
+	std::atomic<int64_t> value_{};
+};
+
+// Counts observed values in buckets with the given upper bounds,
+// values larger than the last bound end up in an implicit +Inf bucket.
+class CMetricHistogram final
+{
+public:
+	explicit CMetricHistogram(std::vector<double> const& bounds);
+
+	void Observe(double value);
+
+	// In seconds
+	void Observe(fz::duration const& d) { Observe(d.get_microseconds() / 1000000.0); }
+
+private:
+	friend class CMetrics;
+
+	std::vector<double> const bounds_;
+
+	// Not cumulative, one more than there are bounds
+	std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+
+	std::atomic<double> sum_{};
+};
+
+// Registry of performance counters shared by all engines.
+//
+// Updating a metric only needs atomic operations. Registration takes a lock,
+// so metrics should be registered once and the returned reference kept
+// around. Registering a name and label combination again returns the
+// existing metric.
+class CMetrics final
+{
+private:
+	enum class metric_type
+	{
+		counter,
+		gauge,
+		histogram
+	};
+
+	struct metric final
+	{
+		metric_type type{};
+		std::string help;
+		std::unique_ptr<CMetricCounter> counter;
+		std::unique_ptr<CMetricGauge> gauge;
+		std::unique_ptr<CMetricHistogram> histogram;
+	};
+
+	// Mutex must be locked
+	metric& Add(metric_type type, std::string const& name, std::string const& help, std::string const& labels);
+
+	// Declared before the engine metrics, which get registered in the constructor
+	mutable fz::mutex mutex_;
+
+	// Keyed by name and labels, so that all series of a metric are adjacent
+	std::map<std::pair<std::string, std::string>, metric> metrics_;
+
+public:
+	CMetrics();
+
+	CMetrics(CMetrics const&) = delete;
+	CMetrics& operator=(CMetrics const&) = delete;
+
+	// Labels are in the form of key="value",key2="value2"
+	CMetricCounter& AddCounter(std::string const& name, std::string const& help, std::string const& labels = std::string());
+	CMetricGauge& AddGauge(std::string const& name, std::string const& help, std::string const& labels = std::string());
+	CMetricHistogram& AddHistogram(std::string const& name, std::string const& help, std::vector<double> const& bounds, std::string const& labels = std::string());
+
+	// All metrics in the Prometheus text exposition format
+	std::string Format() const;
+
+	// Writes the formatted metrics to the given file, replacing it atomically.
+	bool WriteToFile(fz::native_string const& file) const;
+
+	// Metrics maintained by the engine
+	CMetricHistogram & controlRtt_;
+	CMetricCounter & transferredBytes_;
+	CMetricGauge & activeTransfers_;
+	CMetricHistogram & transferRate_;
+	CMetricCounter & pathCacheHits_;
+	CMetricCounter & pathCacheMisses_;
+	CMetricCounter & directoryCacheHits_;
+	CMetricCounter & directoryCacheMisses_;
+	CMetricHistogram & listingParseTime_;
+	CMetricCounter & ioThreadStalls_;
+	CMetricHistogram & ioThreadStallTime_;
+
+	// Indexed by CRateLimiter::rate_direction
+	CMetricCounter * rateLimitWaits_[2];
+	CMetricHistogram * rateLimitWaitTime_[2];
+};
+
+// Periodically writes the metrics to the file set in OPTION_METRICS_FILE
+class CMetricsWriter final : public fz::event_handler, COptionChangeEventHandler
+{
+public:
+	CMetricsWriter(CMetrics & metrics, COptionsBase & options, fz::event_loop & loop);
+	virtual ~CMetricsWriter();
+
+	// Returns the reason the file could not be written exactly once, an
+	// empty string afterwards. Set again only after a successful write.
+	std::wstring TakeError();
+
+private:
+	virtual void OnOptionsChanged(changed_options_t const& options) override;
+
+	virtual void operator()(fz::event_base const& ev) override;
+	void OnOptions();
+	void OnTimer(fz::timer_id);
+
+	CMetrics & metrics_;
+	COptionsBase & options_;
+
+	fz::native_string file_;
+	fz::timer_id timer_{};
+	bool failed_{};
+
+	fz::mutex mutex_;
+	std::wstring error_;
+};
+
+#endif
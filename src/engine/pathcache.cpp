@@ -1,9 +1,11 @@
 #include <filezilla.h>
 #include "pathcache.h"
+#include "metrics.h"
 
 #include <assert.h>
 
-CPathCache::CPathCache()
+CPathCache::CPathCache(CMetrics & metrics)
+	: metrics_(metrics)
 {
 }
 
@@ -37,19 +39,18 @@ CServerPath CPathCache::Lookup(CServer const& server, CServerPath const& source,
 
 	const tCacheConstIterator iter = m_cache.find(server);
 	if (iter == m_cache.end()) {
+		metrics_.pathCacheMisses_.Add();
 		return CServerPath();
 	}
 
 	CServerPath result = Lookup(iter->second, source, subdir);
 
-#ifndef NDEBUG
 	if (result.empty()) {
-		m_misses++;
+		metrics_.pathCacheMisses_.Add();
 	}
 	else {
-		m_hits++;
+		metrics_.pathCacheHits_.Add();
 	}
-#endif
 
 	return result;
 }
@@ -3,10 +3,12 @@
 
 #include <libfilezilla/mutex.hpp>
 
+class CMetrics;
+
 class CPathCache final
 {
 public:
-	CPathCache();
+	explicit CPathCache(CMetrics & metrics);
 	~CPathCache();
 
 	CPathCache(CPathCache const&) = delete;
@@ -51,10 +53,7 @@ protected:
 	CServerPath Lookup(tServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir);
 	void InvalidatePath(tServerCache & serverCache, CServerPath const& path, std::wstring const& subdir = std::wstring());
 
-#ifndef NDEBUG
-	int m_hits{};
-	int m_misses{};
-#endif
+	CMetrics & metrics_;
 };
 
 #endif
@@ -1,5 +1,6 @@
 #include <filezilla.h>
 #include "ratelimiter.h"
+#include "metrics.h"
 
 #include <libfilezilla/event_handler.hpp>
 
@@ -7,9 +8,10 @@
 
 static int const tickDelay = 250;
 
-CRateLimiter::CRateLimiter(fz::event_loop& loop, COptionsBase& options)
+CRateLimiter::CRateLimiter(fz::event_loop& loop, COptionsBase& options, CMetrics& metrics)
 	: event_handler(loop)
 	, options_(options)
+	, metrics_(metrics)
 {
 	RegisterOption(OPTION_SPEEDLIMIT_ENABLE);
 	RegisterOption(OPTION_SPEEDLIMIT_INBOUND);
@@ -227,6 +229,9 @@ void CRateLimiter::WakeupWaitingObjects(fz::scoped_lock & l)
 			assert(pObject->bytesAvailable_[i] != 0);
 			pObject->waiting_[i] = false;
 
+			metrics_.rateLimitWaits_[i]->Add();
+			metrics_.rateLimitWaitTime_[i]->Observe(fz::monotonic_clock::now() - pObject->waitStart_[i]);
+
 			l.unlock(); // Do not hold while executing callback
 			pObject->OnRateAvailable((rate_direction)i);
 			l.lock();
@@ -294,6 +299,7 @@ void CRateLimiterObject::Wait(CRateLimiter::rate_direction direction)
 	assert(0 <= direction && direction <= 1);
 	assert(bytesAvailable_[direction] == 0);
 	waiting_[direction] = true;
+	waitStart_[direction] = fz::monotonic_clock::now();
 }
 
 bool CRateLimiterObject::IsWaiting(CRateLimiter::rate_direction direction) const
@@ -3,6 +3,9 @@
 
 #include <option_change_event_handler.h>
 
+#include <libfilezilla/time.hpp>
+
+class CMetrics;
 class COptionsBase;
 
 class CRateLimiterObject;
@@ -11,7 +14,7 @@ class CRateLimiterObject;
 class CRateLimiter final : protected fz::event_handler, COptionChangeEventHandler
 {
 public:
-	CRateLimiter(fz::event_loop& loop, COptionsBase& options);
+	CRateLimiter(fz::event_loop& loop, COptionsBase& options, CMetrics& metrics);
 	~CRateLimiter();
 
 	enum rate_direction
@@ -37,6 +40,7 @@ private:
 	int64_t tokenDebt_[2]{0, 0};
 
 	COptionsBase& options_;
+	CMetrics& metrics_;
 
 	void WakeupWaitingObjects(fz::scoped_lock & l);
 
@@ -71,6 +75,7 @@ protected:
 
 private:
 	bool waiting_[2]{};
+	fz::monotonic_clock waitStart_[2];
 	int64_t bytesAvailable_[2]{-1, -1};
 };
 
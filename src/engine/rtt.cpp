@@ -23,7 +23,7 @@ bool CLatencyMeasurement::Start()
 	return true;
 }
 
-bool CLatencyMeasurement::Stop()
+bool CLatencyMeasurement::Stop(fz::duration * rtt)
 {
 	fz::scoped_lock lock(m_sync);
 	if (!m_start) {
@@ -40,6 +40,10 @@ bool CLatencyMeasurement::Stop()
 	m_summed_latency += diff.get_milliseconds();
 	++m_measurements;
 
+	if (rtt) {
+		*rtt = diff;
+	}
+
 	return true;
 }
 
@@ -11,8 +11,9 @@ public:
 	// a measurement already running
 	bool Start();
 
-	// Returns false if there was no measurement running
-	bool Stop();
+	// Returns false if there was no measurement running. Otherwise the
+	// measured time is stored in rtt if given.
+	bool Stop(fz::duration * rtt = nullptr);
 
 	// In ms, returns -1 if no data is available.
 	int GetLatency() const;
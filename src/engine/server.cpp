@@ -827,6 +827,18 @@ std::vector<ParameterTraits> const& ExtraServerParameterTraits(ServerProtocol pr
 			}();
 			return ret;
 		}
+	case SFTP:
+		{
+			static std::vector<ParameterTraits> ret = []() {
+				std::vector<ParameterTraits> ret;
+				ret.emplace_back(ParameterTraits{"xfer_window", ParameterSection::extra, ParameterTraits::optional | ParameterTraits::numeric, std::wstring(), _("Automatic")});
+				ret.emplace_back(ParameterTraits{"xfer_blocksize", ParameterSection::extra, ParameterTraits::optional | ParameterTraits::numeric, std::wstring(), _("Default")});
+				ret.emplace_back(ParameterTraits{"compression", ParameterSection::extra, ParameterTraits::optional | ParameterTraits::numeric, std::wstring(), _("Use global setting")});
+				ret.emplace_back(ParameterTraits{"channels_per_connection", ParameterSection::extra, ParameterTraits::optional | ParameterTraits::numeric, std::wstring(), _("Do not share connections")});
+				return ret;
+			}();
+			return ret;
+		}
 	case SWIFT:
 		{
 			static std::vector<ParameterTraits> ret = []() {
@@ -28,6 +28,8 @@ enum capabilityNames
 	list_hidden_support, // LIST -a command
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
+	hash_command, // HASH command, option is the algorithm to use
+	xhash_command, // XSHA256, XSHA1, XMD5 or XCRC, option is the command to use
 
 	// FTPS and HTTPS
 	tls_resume, // Does the server support resuming of TLS sessions?
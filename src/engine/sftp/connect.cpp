@@ -3,10 +3,37 @@
 #include "connect.h"
 #include "event.h"
 #include "input_thread.h"
+#include "process_pool.h"
 #include "proxy.h"
 
+#include <libfilezilla/encode.hpp>
+#include <libfilezilla/hash.hpp>
 #include <libfilezilla/process.hpp>
 
+#include <algorithm>
+
+namespace {
+// Sessions may only share a connection they could have established themselves,
+// so everything that affects connecting and authenticating goes into the key.
+std::wstring GetShareKey(CServer const& server, Credentials const& credentials, std::vector<std::wstring> const& keyfiles, COptionsBase & options)
+{
+	std::wstring key = fz::sprintf(L"%s@%s:%d\n%d\n%s\n", server.GetUser(), server.GetHost(), server.GetPort(),
+		static_cast<int>(credentials.logonType_), credentials.GetPass());
+	for (auto const& keyfile : keyfiles) {
+		key += keyfile + L"\n";
+	}
+	key += server.GetExtraParameter("compression") + L"\n";
+	if (options.GetOptionVal(OPTION_PROXY_TYPE) && !server.GetBypassProxy()) {
+		key += fz::sprintf(L"%d %s %d %s %s", options.GetOptionVal(OPTION_PROXY_TYPE),
+			options.GetOption(OPTION_PROXY_HOST), options.GetOptionVal(OPTION_PROXY_PORT),
+			options.GetOption(OPTION_PROXY_USER), options.GetOption(OPTION_PROXY_PASS));
+	}
+
+	// Hashed, the pool has no business keeping the credentials around
+	return fz::hex_encode<std::wstring>(fz::sha256(fz::to_utf8(key)));
+}
+}
+
 int CSftpConnectOpData::Send()
 {
 	switch (opState)
@@ -23,7 +50,8 @@ int CSftpConnectOpData::Send()
 			if (engine_.GetOptions().GetOptionVal(OPTION_SFTP_COMPRESSION)) {
 				args.push_back(fzT("-C"));
 			}
-			if (!controlSocket_.process_->spawn(executable, args)) {
+			controlSocket_.process_ = engine_.GetContext().GetSftpProcessPool().Take(executable, args);
+			if (!controlSocket_.process_) {
 				LogMessage(MessageType::Debug_Warning, L"Could not create process");
 				return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;;
 			}
@@ -74,6 +102,24 @@ int CSftpConnectOpData::Send()
 		break;
 	case connect_keys:
 		return controlSocket_.SendCommand(L"keyfile \"" + *(keyfile_++) + L"\"");
+	case connect_share:
+		{
+			size_t const channels = fz::to_integral<size_t>(currentServer_.GetExtraParameter("channels_per_connection"));
+			controlSocket_.shareKey_ = GetShareKey(currentServer_, credentials_, keyfiles_, engine_.GetOptions());
+			controlSocket_.shareGroup_ = engine_.GetContext().GetSftpProcessPool().JoinShareGroup(controlSocket_.shareKey_, channels);
+			return controlSocket_.SendCommand(L"share \"" + controlSocket_.shareGroup_ + L"\"");
+		}
+	case connect_compression:
+		{
+			int const level = fz::to_integral<int>(currentServer_.GetExtraParameter("compression"), -1);
+			return controlSocket_.SendCommand(fz::sprintf(L"compression %d", std::min(std::max(level, 0), 9)));
+		}
+	case connect_xfersettings:
+		{
+			int const window = fz::to_integral<int>(currentServer_.GetExtraParameter("xfer_window"));
+			int const blocksize = fz::to_integral<int>(currentServer_.GetExtraParameter("xfer_blocksize"));
+			return controlSocket_.SendCommand(fz::sprintf(L"xfersettings %d %d", std::max(window, 0), std::max(blocksize, 0)));
+		}
 	case connect_open:
 		{
 			std::wstring user = (credentials_.logonType_ == LogonType::anonymous) ? L"anonymous" : currentServer_.GetUser();
@@ -107,7 +153,7 @@ int CSftpConnectOpData::ParseResponse()
 			opState = connect_keys;
 		}
 		else {
-			opState = connect_open;
+			opState = NextStateAfter(connect_keys);
 		}
 		break;
 	case connect_proxy:
@@ -115,14 +161,23 @@ int CSftpConnectOpData::ParseResponse()
 			opState = connect_keys;
 		}
 		else {
-			opState = connect_open;
+			opState = NextStateAfter(connect_keys);
 		}
 		break;
 	case connect_keys:
 		if (keyfile_ == keyfiles_.cend()) {
-			opState = connect_open;
+			opState = NextStateAfter(connect_keys);
 		}
 		break;
+	case connect_share:
+		opState = NextStateAfter(connect_share);
+		break;
+	case connect_compression:
+		opState = NextStateAfter(connect_compression);
+		break;
+	case connect_xfersettings:
+		opState = connect_open;
+		break;
 	case connect_open:
 		engine_.AddNotification(new CSftpEncryptionNotification(controlSocket_.m_sftpEncryptionDetails));
 		return FZ_REPLY_OK;
@@ -134,6 +189,29 @@ int CSftpConnectOpData::ParseResponse()
 	return FZ_REPLY_CONTINUE;
 }
 
+int CSftpConnectOpData::NextStateAfter(int state) const
+{
+	switch (state) {
+	case connect_keys:
+		if (fz::to_integral<int>(currentServer_.GetExtraParameter("channels_per_connection")) > 1) {
+			return connect_share;
+		}
+		// Fall-through
+	case connect_share:
+		if (!currentServer_.GetExtraParameter("compression").empty()) {
+			return connect_compression;
+		}
+		// Fall-through
+	case connect_compression:
+		if (!currentServer_.GetExtraParameter("xfer_window").empty() || !currentServer_.GetExtraParameter("xfer_blocksize").empty()) {
+			return connect_xfersettings;
+		}
+		// Fall-through
+	default:
+		return connect_open;
+	}
+}
+
 int CSftpConnectOpData::Reset(int result)
 {
 	if (opState == connect_init && (result & FZ_REPLY_CANCELED) != FZ_REPLY_CANCELED) {
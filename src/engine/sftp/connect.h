@@ -8,6 +8,9 @@ enum connectStates
 	connect_init,
 	connect_proxy,
 	connect_keys,
+	connect_share,
+	connect_compression,
+	connect_xfersettings,
 	connect_open
 };
 
@@ -25,6 +28,9 @@ public:
 	virtual int ParseResponse() override;
 	virtual int Reset(int result) override;
 
+	// Skips optional states that do not apply to the site
+	int NextStateAfter(int state) const;
+
 	std::wstring lastChallenge;
 	CInteractiveLoginNotification::type lastChallengeType{ CInteractiveLoginNotification::interactive };
 	bool criticalFailure{};
@@ -3,36 +3,71 @@
 #include "delete.h"
 #include "directorycache.h"
 
+namespace {
+// Upper limit of files deleted by a single rmmany command. fzsftp
+// itself limits the number of outstanding requests.
+size_t const max_batch_size = 256;
+}
+
 int CSftpDeleteOpData::Send()
 {
-	std::wstring const& file = files_.front();
-	if (file.empty()) {
-		LogMessage(MessageType::Debug_Info, L"Empty filename");
-		return FZ_REPLY_INTERNALERROR;
+	if (time_.empty()) {
+		time_ = fz::datetime::now();
 	}
 
-	std::wstring filename = path_.FormatFilename(file);
-	if (filename.empty()) {
-		LogMessage(MessageType::Error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-		return FZ_REPLY_ERROR;
-	}
+	if (files_.size() == 1) {
+		std::wstring const& file = files_.front();
+		if (file.empty()) {
+			LogMessage(MessageType::Debug_Info, L"Empty filename");
+			return FZ_REPLY_INTERNALERROR;
+		}
 
-	if (time_.empty()) {
-		time_ = fz::datetime::now();
+		std::wstring filename = path_.FormatFilename(file);
+		if (filename.empty()) {
+			LogMessage(MessageType::Error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
+			return FZ_REPLY_ERROR;
+		}
+
+		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+
+		sent_.push_back(file);
+		files_.pop_front();
+
+		return controlSocket_.SendCommand(L"rm " + controlSocket_.WildcardEscape(controlSocket_.QuoteFilename(filename)), L"rm " + controlSocket_.QuoteFilename(filename));
 	}
 
-	engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+	// Delete many files with a single command. fzsftp keeps multiple
+	// requests in flight and reports the result of each file in order.
+	std::wstring cmd = L"rmmany " + controlSocket_.QuoteFilename(path_.GetPath());
+	while (!files_.empty() && sent_.size() < max_batch_size) {
+		std::wstring const& file = files_.front();
+		if (file.empty() || file.find('/') != std::wstring::npos) {
+			LogMessage(MessageType::Debug_Info, L"Invalid filename");
+			return FZ_REPLY_INTERNALERROR;
+		}
+
+		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+
+		cmd += L" " + controlSocket_.QuoteFilename(file);
+		sent_.push_back(file);
+		files_.pop_front();
+	}
 
-	return controlSocket_.SendCommand(L"rm " + controlSocket_.WildcardEscape(controlSocket_.QuoteFilename(filename)), L"rm " + controlSocket_.QuoteFilename(filename));
+	return controlSocket_.SendCommand(cmd);
 }
 
 int CSftpDeleteOpData::ParseResponse()
 {
+	if (sent_.empty()) {
+		LogMessage(MessageType::Debug_Warning, L"Reply without pending delete request");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
 	if (controlSocket_.result_ != FZ_REPLY_OK) {
 		deleteFailed_ = true;
 	}
 	else {
-		std::wstring const& file = files_.front();
+		std::wstring const& file = sent_.front();
 
 		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
 
@@ -47,7 +82,12 @@ int CSftpDeleteOpData::ParseResponse()
 		}
 	}
 
-	files_.pop_front();
+	sent_.pop_front();
+
+	if (!sent_.empty()) {
+		// More results of the current batch to come
+		return FZ_REPLY_WOULDBLOCK;
+	}
 
 	if (!files_.empty()) {
 		return FZ_REPLY_CONTINUE;
@@ -19,6 +19,10 @@ public:
 	CServerPath path_;
 	std::deque<std::wstring> files_;
 
+	// Files for which the delete command has been sent
+	// but whose result has not been received yet.
+	std::deque<std::wstring> sent_;
+
 	// Set to fz::datetime::Now initially and after
 	// sending an updated listing to the UI.
 	fz::datetime time_;
@@ -1,7 +1,7 @@
 #ifndef FILEZILLA_ENGINE_SFTP_EVENT_HEADER
 #define FILEZILLA_ENGINE_SFTP_EVENT_HEADER
 
-#define FZSFTP_PROTOCOL_VERSION 8
+#define FZSFTP_PROTOCOL_VERSION 13
 
 enum class sftpEvent {
 	Unknown = -1,
@@ -44,11 +44,29 @@ struct sftp_message
 struct sftp_event_type;
 typedef fz::simple_event<sftp_event_type, sftp_message> CSftpEvent;
 
+// Attributes of a listing entry as sent by the server, see struct fxp_attrs in src/putty/sftp.h
+struct sftp_attributes
+{
+	enum flags : uint64_t {
+		size = 0x1,
+		uidgid = 0x2,
+		permissions = 0x4,
+		acmodtime = 0x8
+	};
+
+	uint64_t flags_{};
+	uint64_t size_{};
+	uint64_t permissions_{};
+	uint64_t uid_{};
+	uint64_t gid_{};
+};
+
 struct sftp_list_message
 {
 	mutable std::wstring text;
 	mutable std::wstring name;
 	uint64_t mtime;
+	sftp_attributes attributes;
 };
 
 struct sftp_list_event_type;
@@ -6,9 +6,13 @@
 
 #include <libfilezilla/process.hpp>
 
+#include <algorithm>
+
+#include <string.h>
+
 CSftpInputThread::CSftpInputThread(CSftpControlSocket& owner, fz::process& proc)
 	: process_(proc)
-	, owner_(owner)
+	, owner_(&owner)
 {
 }
 
@@ -25,6 +29,23 @@ bool CSftpInputThread::spawn(fz::thread_pool & pool)
 	return thread_.operator bool();
 }
 
+void CSftpInputThread::Detach()
+{
+	fz::scoped_lock l(mutex_);
+	owner_ = nullptr;
+}
+
+void CSftpInputThread::Post(fz::event_base* ev)
+{
+	fz::scoped_lock l(mutex_);
+	if (owner_) {
+		owner_->send_event(ev);
+	}
+	else {
+		delete ev;
+	}
+}
+
 uint64_t CSftpInputThread::ReadUInt(std::wstring &error)
 {
 	uint64_t ret{};
@@ -60,54 +81,95 @@ uint64_t CSftpInputThread::ReadUInt(std::wstring &error)
 	return 0;
 }
 
-std::wstring CSftpInputThread::ReadLine(std::wstring &error)
+void CSftpInputThread::ReadUInts(std::wstring &error, uint64_t* values, size_t count)
 {
-	int len = 0;
-	const int buffersize = 4096;
-	char buffer[buffersize];
+	size_t n{};
+	for (size_t i = 0; i < count; ++i) {
+		values[i] = 0;
+	}
 
 	while (true) {
 		if (!readFromProcess(error, true)) {
-			return std::wstring();
+			return;
 		}
 
 		auto const* p = recv_buffer_.get();
 		size_t i;
 		for (i = 0; i < recv_buffer_.size(); ++i) {
 			unsigned char const c = p[i];
-
 			if (c == '\n') {
 				recv_buffer_.consume(i + 1);
-
-				while (len && buffer[len - 1] == '\r') {
-					--len;
+				if (n + 1 != count) {
+					error = L"Unexpected number of values";
 				}
-
-				std::wstring const line = owner_.ConvToLocal(buffer, len);
-				if (len && line.empty()) {
-					error = L"Failed to convert reply to local character set.";
-				}
-
-				return line;
+				return;
 			}
-
-			if (len >= buffersize - 1) {
-				// Cap string length
+			if (c == '\r') {
+				continue;
+			}
+			if (c == ' ') {
+				++n;
 				continue;
 			}
 
-			buffer[len++] = c;
+			if (c < '0' || c > '9' || n >= count) {
+				error = L"Unexpected character";
+				return;
+			}
+			values[n] *= 10;
+			values[n] += c - '0';
+		}
+		recv_buffer_.clear();
+	}
+}
+
+std::wstring CSftpInputThread::ReadLine(std::wstring &error)
+{
+	// Longer lines get truncated
+	size_t const max_line_length = 4095;
+
+	std::string line;
+	while (true) {
+		if (!readFromProcess(error, true)) {
+			return std::wstring();
+		}
+
+		auto const* p = recv_buffer_.get();
+		auto const* end = static_cast<unsigned char const*>(memchr(p, '\n', recv_buffer_.size()));
+		size_t const len = end ? static_cast<size_t>(end - p) : recv_buffer_.size();
+		if (line.size() < max_line_length) {
+			line.append(reinterpret_cast<char const*>(p), std::min(len, max_line_length - line.size()));
+		}
+
+		if (end) {
+			recv_buffer_.consume(len + 1);
+			break;
 		}
 		recv_buffer_.clear();
 	}
 
-	return std::wstring();
+	while (!line.empty() && line.back() == '\r') {
+		line.pop_back();
+	}
+
+	std::wstring ret;
+	{
+		fz::scoped_lock l(mutex_);
+		ret = owner_ ? owner_->ConvToLocal(line.c_str(), line.size()) : fz::to_wstring_from_utf8(line);
+	}
+	if (!line.empty() && ret.empty()) {
+		error = L"Failed to convert reply to local character set.";
+	}
+
+	return ret;
 }
 
 bool CSftpInputThread::readFromProcess(std::wstring & error, bool eof_is_error)
 {
 	if (recv_buffer_.empty()) {
-		int read = process_.read(reinterpret_cast<char *>(recv_buffer_.get(1024)), 1024);
+		// Grab as much as possible at once, transfers produce lots of small messages
+		size_t const chunk_size = 64 * 1024;
+		int read = process_.read(reinterpret_cast<char *>(recv_buffer_.get(chunk_size)), chunk_size);
 		if (read > 0) {
 			recv_buffer_.add(read);
 		}
@@ -174,8 +236,16 @@ void CSftpInputThread::processEvent(sftpEvent eventType, std::wstring & error)
 			message.mtime = ReadUInt(error);
 			message.name = ReadLine(error);
 
+			uint64_t values[5];
+			ReadUInts(error, values, 5);
+			message.attributes.flags_ = values[0];
+			message.attributes.size_ = values[1];
+			message.attributes.permissions_ = values[2];
+			message.attributes.uid_ = values[3];
+			message.attributes.gid_ = values[4];
+
 			if (error.empty()) {
-				owner_.send_event(msg);
+				Post(msg);
 			}
 			else {
 				delete msg;
@@ -196,7 +266,7 @@ void CSftpInputThread::processEvent(sftpEvent eventType, std::wstring & error)
 		return;
 	}
 
-	owner_.send_event(msg);
+	Post(msg);
 }
 
 void CSftpInputThread::entry()
@@ -222,5 +292,6 @@ void CSftpInputThread::entry()
 		processEvent(eventType, error);
 	}
 
-	owner_.send_event<CTerminateEvent>(error);
+	Post(new CTerminateEvent(error));
+	finished_ = true;
 }
@@ -4,8 +4,11 @@
 class CSftpControlSocket;
 
 #include <libfilezilla/buffer.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/thread_pool.hpp>
 
+#include <atomic>
+
 namespace fz {
 class process;
 }
@@ -18,20 +21,35 @@ public:
 
 	bool spawn(fz::thread_pool & pool);
 
+	// Stops delivering events to the owner, from then on the output of the
+	// process is read and discarded until it exits.
+	void Detach();
+
+	// Whether the process has exited
+	bool finished() const { return finished_; }
+
 protected:
 
 	bool readFromProcess(std::wstring & error, bool eof_is_error);
 	std::wstring ReadLine(std::wstring & error);
 	uint64_t ReadUInt(std::wstring & error);
 
+	// Reads a line of count space-separated unsigned integers
+	void ReadUInts(std::wstring & error, uint64_t* values, size_t count);
+
 	void entry();
 
 	void processEvent(sftpEvent eventType, std::wstring & error);
 
+	void Post(fz::event_base* ev);
+
 	fz::process& process_;
-	CSftpControlSocket& owner_;
+
+	fz::mutex mutex_;
+	CSftpControlSocket* owner_;
 
 	fz::async_task thread_;
+	std::atomic<bool> finished_{};
 
 	fz::buffer recv_buffer_;
 };
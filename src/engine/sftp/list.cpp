@@ -1,8 +1,12 @@
 #include <filezilla.h>
 
 #include "directorycache.h"
+#include "metrics.h"
 #include "list.h"
 
+#include <algorithm>
+#include <cwchar>
+
 enum listStates
 {
 	list_init = 0,
@@ -76,6 +80,7 @@ int CSftpListOpData::ParseResponse()
 		}
 
 		directoryListing_ = listing_parser_->Parse(currentPath_);
+		engine_.GetContext().GetMetrics().listingParseTime_.Observe(listing_parser_->GetParseTime());
 		engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
 		controlSocket_.SendDirectoryListingNotification(currentPath_, false);
 
@@ -112,7 +117,88 @@ int CSftpListOpData::SubcommandResult(int prevResult, COpData const&)
 	return FZ_REPLY_CONTINUE;
 }
 
-int CSftpListOpData::ParseEntry(std::wstring && entry, uint64_t mtime, std::wstring && name)
+namespace {
+// Formats the mode the way ls -l does. Returns an empty string if the server did not include the file type.
+std::wstring FormatPermissions(uint64_t mode)
+{
+	wchar_t type;
+	switch (mode & 0170000) {
+	case 0040000:
+		type = 'd';
+		break;
+	case 0120000:
+		type = 'l';
+		break;
+	case 0100000:
+		type = '-';
+		break;
+	case 0020000:
+		type = 'c';
+		break;
+	case 0060000:
+		type = 'b';
+		break;
+	case 0010000:
+		type = 'p';
+		break;
+	case 0140000:
+		type = 's';
+		break;
+	default:
+		return std::wstring();
+	}
+
+	std::wstring ret(10, '-');
+	ret[0] = type;
+	for (int i = 0; i < 9; ++i) {
+		if (mode & (0400 >> i)) {
+			ret[i + 1] = L"rwx"[i % 3];
+		}
+	}
+	if (mode & 04000) {
+		ret[3] = (mode & 0100) ? 's' : 'S';
+	}
+	if (mode & 02000) {
+		ret[6] = (mode & 0010) ? 's' : 'S';
+	}
+	if (mode & 01000) {
+		ret[9] = (mode & 0001) ? 't' : 'T';
+	}
+
+	return ret;
+}
+
+// SFTP v3 only has numeric uid and gid, the names are just part of the longname.
+// Returns an empty string unless the longname looks like ls -l output.
+std::wstring ExtractOwnerGroup(std::wstring const& longname)
+{
+	// Start and end of the first four fields
+	size_t fields[4][2];
+	size_t pos = 0;
+	for (auto & field : fields) {
+		pos = longname.find_first_not_of(' ', pos);
+		if (pos == std::wstring::npos) {
+			return std::wstring();
+		}
+		field[0] = pos;
+		pos = std::min(longname.find(' ', pos), longname.size());
+		field[1] = pos;
+	}
+
+	if (fields[0][1] - fields[0][0] < 10 || !wcschr(L"-bcdlps", longname[fields[0][0]])) {
+		return std::wstring();
+	}
+	for (size_t i = fields[1][0]; i < fields[1][1]; ++i) {
+		if (longname[i] < '0' || longname[i] > '9') {
+			return std::wstring();
+		}
+	}
+
+	return longname.substr(fields[2][0], fields[2][1] - fields[2][0]) + L" " + longname.substr(fields[3][0], fields[3][1] - fields[3][0]);
+}
+}
+
+int CSftpListOpData::ParseEntry(std::wstring && entry, uint64_t mtime, std::wstring && name, sftp_attributes const& attributes)
 {
 	if (opState != list_list) {
 		controlSocket_.LogMessageRaw(MessageType::RawList, entry);
@@ -130,7 +216,42 @@ int CSftpListOpData::ParseEntry(std::wstring && entry, uint64_t mtime, std::wstr
 	if (mtime) {
 		time = fz::datetime(static_cast<time_t>(mtime), fz::datetime::seconds);
 	}
-	listing_parser_->AddLine(std::move(entry), std::move(name), time);
+
+	std::wstring permissions;
+	if (attributes.flags_ & sftp_attributes::permissions) {
+		permissions = FormatPermissions(attributes.permissions_);
+	}
+	if (permissions.empty()) {
+		// Can't tell files from directories, leave it to the longname
+		listing_parser_->AddLine(std::move(entry), std::move(name), time);
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	CDirentry direntry;
+	direntry.name = std::move(name);
+	direntry.size = (attributes.flags_ & sftp_attributes::size) ? static_cast<int64_t>(attributes.size_) : -1;
+	direntry.time = time;
+	direntry.flags = 0;
+	if (permissions[0] == 'd') {
+		direntry.flags |= CDirentry::flag_dir;
+	}
+	else if (permissions[0] == 'l') {
+		// Whether the target is a directory is only known after following the link
+		direntry.flags |= CDirentry::flag_dir | CDirentry::flag_link;
+
+		std::wstring const arrow = L" " + direntry.name + L" -> ";
+		size_t pos = entry.rfind(arrow);
+		if (pos != std::wstring::npos) {
+			direntry.target = fz::sparse_optional<std::wstring>(entry.substr(pos + arrow.size()));
+		}
+	}
+
+	std::wstring ownerGroup = ExtractOwnerGroup(entry);
+	if (ownerGroup.empty() && (attributes.flags_ & sftp_attributes::uidgid)) {
+		ownerGroup = fz::sprintf(L"%d %d", attributes.uid_, attributes.gid_);
+	}
+
+	listing_parser_->AddEntry(entry, std::move(direntry), permissions, ownerGroup);
 
 	return FZ_REPLY_WOULDBLOCK;
 }
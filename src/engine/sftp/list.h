@@ -2,6 +2,7 @@
 #define FILEZILLA_ENGINE_SFTP_LIST_HEADER
 
 #include "directorylistingparser.h"
+#include "event.h"
 #include "sftpcontrolsocket.h"
 
 class CSftpListOpData final : public COpData, public CSftpOpData
@@ -19,7 +20,7 @@ public:
 	virtual int ParseResponse() override;
 	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
 
-	int ParseEntry(std::wstring && entry, uint64_t mtime, std::wstring && name);
+	int ParseEntry(std::wstring && entry, uint64_t mtime, std::wstring && name, sftp_attributes const& attributes);
 
 private:
 	std::unique_ptr<CDirectoryListingParser> listing_parser_;
@@ -0,0 +1,234 @@
+#include <filezilla.h>
+
+#include "event.h"
+#include "input_thread.h"
+#include "process_pool.h"
+
+#include <libfilezilla/process.hpp>
+#include <libfilezilla/util.hpp>
+
+fz::duration const CSftpProcessPool::spare_idle_timeout_ = fz::duration::from_seconds(60);
+
+CSftpProcessPool::CSftpProcessPool(fz::thread_pool& pool)
+	: pool_(pool)
+	, shareInstance_(static_cast<int>(fz::random_number(0, 0x7fffffff)))
+{
+}
+
+CSftpProcessPool::~CSftpProcessPool()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	task_.join();
+
+	// Destroying the processes kills them
+	spares_.clear();
+
+	for (auto & r : retired_) {
+		r.process_->kill();
+		r.thread_.reset();
+	}
+	retired_.clear();
+}
+
+std::unique_ptr<fz::process> CSftpProcessPool::Take(fz::native_string const& executable, std::vector<fz::native_string> const& args)
+{
+	std::unique_ptr<fz::process> ret;
+	std::vector<std::unique_ptr<fz::process>> stale;
+	std::vector<retiree> finished;
+
+	bool replenish{};
+	{
+		fz::scoped_lock l(mutex_);
+		Reap(finished);
+
+		if (executable != executable_ || args != args_) {
+			executable_ = executable;
+			args_ = args;
+			stale = std::move(spares_);
+			spares_.clear();
+		}
+		else if (!spares_.empty()) {
+			ret = std::move(spares_.back());
+			spares_.pop_back();
+		}
+
+		lastTake_ = fz::monotonic_clock::now();
+		if (replenishing_) {
+			cond_.signal(l);
+		}
+		else if (!quit_) {
+			replenishing_ = true;
+			replenish = true;
+		}
+	}
+
+	if (replenish) {
+		// Not running anymore, so joining does not block
+		task_.join();
+		task_ = pool_.spawn([this]() { Replenish(); });
+		if (!task_) {
+			fz::scoped_lock l(mutex_);
+			replenishing_ = false;
+		}
+	}
+
+	if (!ret) {
+		ret = std::make_unique<fz::process>();
+		if (!ret->spawn(executable, args)) {
+			ret.reset();
+		}
+	}
+
+	return ret;
+}
+
+void CSftpProcessPool::Replenish()
+{
+	std::vector<std::unique_ptr<fz::process>> expired;
+
+	fz::scoped_lock l(mutex_);
+	bool fill = true;
+	while (!quit_) {
+		while (fill && !quit_ && spares_.size() < max_spares_) {
+			auto const executable = executable_;
+			auto const args = args_;
+
+			l.unlock();
+			auto process = std::make_unique<fz::process>();
+			bool const spawned = process->spawn(executable, args);
+			l.lock();
+
+			if (!spawned) {
+				// Not retrying until the next process is taken, Take falls
+				// back to starting processes itself
+				break;
+			}
+			if (executable == executable_ && args == args_) {
+				spares_.emplace_back(std::move(process));
+			}
+		}
+
+		if (quit_ || spares_.empty()) {
+			break;
+		}
+
+		fz::duration const idle = fz::monotonic_clock::now() - lastTake_;
+		if (idle >= spare_idle_timeout_) {
+			expired = std::move(spares_);
+			spares_.clear();
+			break;
+		}
+
+		// Only refill if woken up by Take
+		fill = cond_.wait(l, spare_idle_timeout_ - idle);
+	}
+	replenishing_ = false;
+	l.unlock();
+
+	// Destroying the processes kills them
+	expired.clear();
+}
+
+std::wstring CSftpProcessPool::JoinShareGroup(std::wstring const& key, size_t channels)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto it = shareGroups_.find(key);
+	if (it == shareGroups_.end()) {
+		it = shareGroups_.emplace(key, share_key()).first;
+		it->second.id_ = nextShareKey_++;
+	}
+
+	auto & groups = it->second.groups_;
+	size_t group = 0;
+	while (group < groups.size() && groups[group] >= channels) {
+		++group;
+	}
+	if (group == groups.size()) {
+		groups.push_back(0);
+	}
+	++groups[group];
+
+	// fzsftp makes this part of the name of the sharing socket, so
+	// sessions with different keys never end up on the same connection.
+	return fz::sprintf(L"%d-%d-%d", shareInstance_, it->second.id_, group);
+}
+
+size_t CSftpProcessPool::LeaveShareGroup(std::wstring const& key, std::wstring const& group)
+{
+	fz::scoped_lock l(mutex_);
+
+	auto it = shareGroups_.find(key);
+	if (it == shareGroups_.end()) {
+		return 0;
+	}
+
+	auto const pos = group.rfind('-');
+	if (pos == std::wstring::npos) {
+		return 0;
+	}
+	size_t const index = fz::to_integral<size_t>(group.substr(pos + 1), static_cast<size_t>(-1));
+	auto & groups = it->second.groups_;
+	size_t remaining{};
+	if (index < groups.size() && groups[index]) {
+		remaining = --groups[index];
+	}
+
+	while (!groups.empty() && !groups.back()) {
+		groups.pop_back();
+	}
+	if (groups.empty()) {
+		shareGroups_.erase(it);
+	}
+
+	return remaining;
+}
+
+void CSftpProcessPool::Retire(std::unique_ptr<fz::process> && process, std::unique_ptr<CSftpInputThread> && thread)
+{
+	std::vector<retiree> finished;
+
+	thread->Detach();
+
+	// -u: No more quota requests, the detached input thread cannot answer them
+	// -a: Abort the transfer in progress, if any
+	// Once quit, the process keeps serving other sessions sharing its
+	// connection and exits after the last one has closed.
+	if (!process->write("-u\n-a\nquit\n")) {
+		process->kill();
+		thread.reset();
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+	Reap(finished);
+	if (quit_) {
+		l.unlock();
+		process->kill();
+		thread.reset();
+		return;
+	}
+
+	retiree r;
+	r.process_ = std::move(process);
+	r.thread_ = std::move(thread);
+	retired_.emplace_back(std::move(r));
+}
+
+void CSftpProcessPool::Reap(std::vector<retiree> & finished)
+{
+	for (size_t i = 0; i < retired_.size(); ) {
+		if (retired_[i].thread_->finished()) {
+			finished.emplace_back(std::move(retired_[i]));
+			retired_[i] = std::move(retired_.back());
+			retired_.pop_back();
+		}
+		else {
+			++i;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef FILEZILLA_ENGINE_SFTP_PROCESS_POOL_HEADER
+#define FILEZILLA_ENGINE_SFTP_PROCESS_POOL_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/string.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace fz {
+class process;
+}
+
+class CSftpInputThread;
+
+// Starting fzsftp costs a process creation on every SFTP connection. If many
+// connections get established at once, e.g. when the queue fills all its slots,
+// this adds up.
+//
+// Once the first process has been requested, a few spare processes are kept
+// running in the background. Connections take a spare process if it has been
+// started with the same executable and arguments, the pool then replenishes
+// itself from a worker thread. If no process has been taken for a while, the
+// spares are stopped until the next one is requested.
+//
+// The pool also keeps track of sessions sharing SSH connections. Sessions
+// with the same sharing key are split into groups of a limited size, each
+// group sharing one SSH connection. The process owning the connection may
+// still serve other sessions when its own session ends, such processes
+// are retired into the pool until they exit. A retired process never
+// asks for speed limit quota, nobody would be left to answer.
+class CSftpProcessPool final
+{
+public:
+	explicit CSftpProcessPool(fz::thread_pool& pool);
+	~CSftpProcessPool();
+
+	CSftpProcessPool(CSftpProcessPool const&) = delete;
+	CSftpProcessPool& operator=(CSftpProcessPool const&) = delete;
+
+	// Returns a running process, either a spare one or a newly started one.
+	// Returns null if the process could not be started.
+	std::unique_ptr<fz::process> Take(fz::native_string const& executable, std::vector<fz::native_string> const& args);
+
+	// Returns the group a new session should join. Groups are unique per key,
+	// the key must cover everything that affects how the connection is
+	// established. Pass the same key and group to LeaveShareGroup once the
+	// session has ended, it returns the number of sessions left in the group.
+	std::wstring JoinShareGroup(std::wstring const& key, size_t channels);
+	size_t LeaveShareGroup(std::wstring const& key, std::wstring const& group);
+
+	// Aborts the current command of a process, turns off its speed limit
+	// quota requests and tells it to quit. The process is kept until it has
+	// exited, which it only does once the other sessions sharing its
+	// connection are gone.
+	void Retire(std::unique_ptr<fz::process> && process, std::unique_ptr<CSftpInputThread> && thread);
+
+private:
+	// Runs on the worker thread until the spares have expired
+	void Replenish();
+
+	struct retiree final
+	{
+		std::unique_ptr<fz::process> process_;
+		std::unique_ptr<CSftpInputThread> thread_;
+	};
+
+	// Frees retired processes that have exited, call with mutex held
+	void Reap(std::vector<retiree> & finished);
+
+	static size_t const max_spares_{2};
+
+	// Spares are stopped if no process has been taken for this long
+	static fz::duration const spare_idle_timeout_;
+
+	fz::thread_pool& pool_;
+
+	fz::mutex mutex_;
+
+	// Wakes the worker if a process has been taken or the pool gets destroyed
+	fz::condition cond_;
+
+	fz::monotonic_clock lastTake_;
+
+	// Command line the spares have been started with. If it changes,
+	// existing spares are discarded.
+	fz::native_string executable_;
+	std::vector<fz::native_string> args_;
+
+	std::vector<std::unique_ptr<fz::process>> spares_;
+
+	struct share_key final
+	{
+		int id_{};
+
+		// Number of sessions in each group
+		std::vector<size_t> groups_;
+	};
+	std::map<std::wstring, share_key> shareGroups_;
+	int nextShareKey_{};
+
+	// Distinguishes the groups of this instance from those of other instances
+	int shareInstance_{};
+
+	std::vector<retiree> retired_;
+
+	fz::async_task task_;
+	bool replenishing_{};
+	bool quit_{};
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "filetransfer.h"
 #include "list.h"
 #include "input_thread.h"
+#include "process_pool.h"
 #include "mkd.h"
 #include "pathcache.h"
 #include "proxy.h"
@@ -75,8 +76,6 @@ void CSftpControlSocket::Connect(CServer const& server, Credentials const& crede
 
 	pData->keyfile_ = pData->keyfiles_.cbegin();
 
-	process_ = std::make_unique<fz::process>();
-
 	engine_.GetRateLimiter().AddObject(this);
 	Push(std::move(pData));
 }
@@ -298,7 +297,7 @@ void CSftpControlSocket::OnSftpListEvent(sftp_list_message const& message)
 		return;
 	}
 	else {
-		int res = static_cast<CSftpListOpData&>(*operations_.back()).ParseEntry(std::move(message.text), message.mtime, std::move(message.name));
+		int res = static_cast<CSftpListOpData&>(*operations_.back()).ParseEntry(std::move(message.text), message.mtime, std::move(message.name), message.attributes);
 		if (res != FZ_REPLY_WOULDBLOCK) {
 			ResetOperation(res);
 		}
@@ -521,12 +520,31 @@ int CSftpControlSocket::DoClose(int nErrorCode)
 {
 	engine_.GetRateLimiter().RemoveObject(this);
 
-	if (process_) {
+	auto & processPool = engine_.GetContext().GetSftpProcessPool();
+
+	// A process with a shared connection is left to exit on its own, other
+	// sessions may still be using its connection. Even if busy, unless it has
+	// not even finished connecting yet.
+	bool retire{};
+	if (!shareGroup_.empty()) {
+		size_t const remaining = processPool.LeaveShareGroup(shareKey_, shareGroup_);
+		shareGroup_.clear();
+
+		bool const connected = operations_.empty() || operations_.front()->opId != Command::connect;
+		retire = process_ && input_thread_ && connected && (operations_.empty() || remaining);
+	}
+
+	if (process_ && !retire) {
 		process_->kill();
 	}
 
 	if (input_thread_) {
-		input_thread_.reset();
+		if (retire) {
+			processPool.Retire(std::move(process_), std::move(input_thread_));
+		}
+		else {
+			input_thread_.reset();
+		}
 
 		auto threadEventsFilter = [&](fz::event_loop::Events::value_type const& ev) -> bool {
 			if (ev.first != this) {
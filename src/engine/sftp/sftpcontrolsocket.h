@@ -58,6 +58,10 @@ protected:
 	std::unique_ptr<fz::process> process_;
 	std::unique_ptr<CSftpInputThread> input_thread_;
 
+	// Set if the SSH connection is shared with other sessions
+	std::wstring shareKey_;
+	std::wstring shareGroup_;
+
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnSftpEvent(sftp_message const& message);
 	void OnSftpListEvent(sftp_list_message const& message);
@@ -23,9 +23,22 @@
   #if !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE)
     #include <signal.h>
   #endif
+  #if HAVE_LINUX_TLS_H
+    #include <linux/tls.h>
+  #endif
   #undef mutex
 #endif
 
+#if HAVE_LINUX_TLS_H
+  // Not always declared by the C library headers
+  #ifndef SOL_TLS
+    #define SOL_TLS 282
+  #endif
+  #ifndef TCP_ULP
+    #define TCP_ULP 31
+  #endif
+#endif
+
 #include <string.h>
 
 // Fixups needed on FreeBSD
@@ -1639,6 +1652,141 @@ void socket::retrigger(socket_event_flag event)
 	}
 }
 
+int socket::set_ktls(bool send, void const* info, unsigned int len)
+{
+#if HAVE_LINUX_TLS_H
+	if (fd_ == -1) {
+		return ENOTCONN;
+	}
+
+#ifndef TLS_RX
+	if (!send) {
+		return EOPNOTSUPP;
+	}
+#endif
+
+	if (!ktls_) {
+		// Fails with ENOENT if the tls module is not available
+		if (setsockopt(fd_, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+			return last_socket_error();
+		}
+		ktls_ = true;
+	}
+
+#ifdef TLS_RX
+	int const direction = send ? TLS_TX : TLS_RX;
+#else
+	int const direction = TLS_TX;
+#endif
+	if (setsockopt(fd_, SOL_TLS, direction, info, len) != 0) {
+		return last_socket_error();
+	}
+
+	return 0;
+#else
+	(void)send;
+	(void)info;
+	(void)len;
+	return EOPNOTSUPP;
+#endif
+}
+
+int socket::read_tls_record(unsigned char& type, void* buffer, unsigned int size, int& error)
+{
+#if HAVE_LINUX_TLS_H && defined(TLS_GET_RECORD_TYPE)
+	char control[CMSG_SPACE(sizeof(unsigned char))];
+
+	iovec iov{};
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	int res = recvmsg(fd_, &msg, 0);
+
+	if (res == -1) {
+		error = last_socket_error();
+		if (error == EAGAIN) {
+			if (socket_thread_) {
+				scoped_lock l(socket_thread_->mutex_);
+				if (!(socket_thread_->waiting_ & WAIT_READ)) {
+					socket_thread_->waiting_ |= WAIT_READ;
+					socket_thread_->wakeup_thread(l);
+				}
+			}
+		}
+	}
+	else {
+		error = 0;
+
+		// Application data unless told otherwise
+		type = 23;
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_level == SOL_TLS && cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+			type = *reinterpret_cast<unsigned char*>(CMSG_DATA(cmsg));
+		}
+	}
+
+	return res;
+#else
+	type = 23;
+	return read(buffer, size, error);
+#endif
+}
+
+int socket::write_tls_record(unsigned char type, void const* buffer, unsigned int size, int& error)
+{
+#if HAVE_LINUX_TLS_H && defined(TLS_SET_RECORD_TYPE)
+	char control[CMSG_SPACE(sizeof(unsigned char))]{};
+
+	iovec iov{};
+	iov.iov_base = const_cast<void*>(buffer);
+	iov.iov_len = size;
+
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*reinterpret_cast<unsigned char*>(CMSG_DATA(cmsg)) = type;
+
+	int res = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+
+	if (res == -1) {
+		error = last_socket_error();
+		if (error == EAGAIN) {
+			if (socket_thread_) {
+				scoped_lock l(socket_thread_->mutex_);
+				if (!(socket_thread_->waiting_ & WAIT_WRITE)) {
+					socket_thread_->waiting_ |= WAIT_WRITE;
+					socket_thread_->wakeup_thread(l);
+				}
+			}
+		}
+	}
+	else {
+		error = 0;
+	}
+
+	return res;
+#else
+	(void)type;
+	(void)buffer;
+	(void)size;
+	error = EOPNOTSUPP;
+	return -1;
+#endif
+}
+
 int socket::shutdown()
 {
 #ifdef FZ_WINDOWS
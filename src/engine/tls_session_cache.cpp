@@ -0,0 +1,77 @@
+#include <filezilla.h>
+
+#include "tls_session_cache.h"
+
+namespace {
+size_t const max_entries = 64;
+
+// Servers forget about sessions eventually, no point in trying after that
+fz::duration const max_age = fz::duration::from_hours(1);
+}
+
+std::vector<unsigned char> TlsSessionCache::Get(std::string const& host, unsigned int port, int protocol)
+{
+	fz::scoped_lock l(mutex_);
+
+	++stats_.lookups_;
+
+	auto const now = fz::monotonic_clock::now();
+	for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+		if (it->host_ != host || it->port_ != port || it->protocol_ != protocol) {
+			continue;
+		}
+
+		if (now - it->stored_ > max_age) {
+			entries_.erase(it);
+			break;
+		}
+
+		++stats_.found_;
+		entries_.splice(entries_.begin(), entries_, it);
+		return entries_.front().data_;
+	}
+
+	return std::vector<unsigned char>();
+}
+
+void TlsSessionCache::Store(std::string const& host, unsigned int port, int protocol, std::vector<unsigned char> && data)
+{
+	if (data.empty()) {
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+
+	for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+		if (it->host_ == host && it->port_ == port && it->protocol_ == protocol) {
+			entries_.erase(it);
+			break;
+		}
+	}
+
+	entry e;
+	e.host_ = host;
+	e.port_ = port;
+	e.protocol_ = protocol;
+	e.data_ = std::move(data);
+	e.stored_ = fz::monotonic_clock::now();
+	entries_.push_front(std::move(e));
+
+	if (entries_.size() > max_entries) {
+		entries_.pop_back();
+	}
+}
+
+void TlsSessionCache::RecordResumption(bool resumed)
+{
+	if (resumed) {
+		fz::scoped_lock l(mutex_);
+		++stats_.resumed_;
+	}
+}
+
+TlsSessionCache::statistics TlsSessionCache::GetStatistics() const
+{
+	fz::scoped_lock l(mutex_);
+	return stats_;
+}
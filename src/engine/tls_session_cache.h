@@ -0,0 +1,59 @@
+#ifndef FILEZILLA_ENGINE_TLS_SESSION_CACHE_HEADER
+#define FILEZILLA_ENGINE_TLS_SESSION_CACHE_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <list>
+#include <string>
+#include <vector>
+
+// Remembers the TLS session data of recent connections, so that new
+// connections to the same server, be it from another engine or after a
+// reconnect, can resume the session instead of doing a full handshake.
+//
+// Shared by all engines. The number of entries is bounded, the least
+// recently used ones get evicted first.
+class TlsSessionCache final
+{
+public:
+	TlsSessionCache() = default;
+
+	TlsSessionCache(TlsSessionCache const&) = delete;
+	TlsSessionCache& operator=(TlsSessionCache const&) = delete;
+
+	// Returns empty data if there is no recent session for the server
+	std::vector<unsigned char> Get(std::string const& host, unsigned int port, int protocol);
+
+	void Store(std::string const& host, unsigned int port, int protocol, std::vector<unsigned char> && data);
+
+	// Call after a handshake using data from Get
+	void RecordResumption(bool resumed);
+
+	struct statistics final
+	{
+		uint64_t lookups_{};
+		uint64_t found_{};
+		uint64_t resumed_{};
+	};
+	statistics GetStatistics() const;
+
+private:
+	struct entry final
+	{
+		std::string host_;
+		unsigned int port_{};
+		int protocol_{};
+		std::vector<unsigned char> data_;
+		fz::monotonic_clock stored_;
+	};
+
+	mutable fz::mutex mutex_;
+
+	// Most recently used first
+	std::list<entry> entries_;
+
+	statistics stats_;
+};
+
+#endif
@@ -26,6 +26,11 @@ void CTlsSocket::Uninit()
 	return impl_->Uninit();
 }
 
+void CTlsSocket::SetKernelOffload(bool enable)
+{
+	impl_->SetKernelOffload(enable);
+}
+
 int CTlsSocket::Handshake(CTlsSocket const* pPrimarySocket, bool try_resume)
 {
 	return impl_->Handshake(pPrimarySocket ? pPrimarySocket->impl_.get() : nullptr, try_resume);
@@ -25,6 +25,10 @@ public:
 	bool Init();
 	void Uninit();
 
+	// If enabled, the connection is handed to the kernel after the handshake
+	// if the platform and the negotiated cipher allow it. Call before Handshake.
+	void SetKernelOffload(bool enable);
+
 	int Handshake(const CTlsSocket* pPrimarySocket = nullptr, bool try_resume = 0);
 
 	virtual int Read(void *buffer, unsigned int size, int& error) override;
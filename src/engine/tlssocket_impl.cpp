@@ -3,6 +3,7 @@
 #include "socket_errors.h"
 #include "tlssocket.h"
 #include "tlssocket_impl.h"
+#include "tls_session_cache.h"
 #include "tls_system_trust_store_impl.h"
 #include "ControlSocket.h"
 
@@ -10,6 +11,10 @@
 
 #include <gnutls/x509.h>
 
+#if HAVE_LINUX_TLS_H
+#include <linux/tls.h>
+#endif
+
 #include <algorithm>
 
 #include <string.h>
@@ -279,6 +284,12 @@ void CTlsSocketImpl::Uninit()
 
 void CTlsSocketImpl::UninitSession()
 {
+	LogStatistics();
+	statRecords_ = 0;
+	statWrites_ = 0;
+	statBytes_ = 0;
+	sendBuffer_.clear();
+
 	if (m_session) {
 		gnutls_deinit(m_session);
 		m_session = nullptr;
@@ -330,7 +341,8 @@ void CTlsSocketImpl::LogError(int code, std::wstring const& function, MessageTyp
 
 void CTlsSocketImpl::PrintAlert(MessageType logLevel)
 {
-	gnutls_alert_description_t last_alert = gnutls_alert_get(m_session);
+	// With kernel TLS for receiving, GnuTLS does not see the alerts
+	gnutls_alert_description_t last_alert = (ktlsAlert_ >= 0) ? static_cast<gnutls_alert_description_t>(ktlsAlert_) : gnutls_alert_get(m_session);
 	const char* alert = gnutls_alert_get_name(last_alert);
 	if (alert) {
 		m_pOwner->LogMessage(logLevel, _("Received TLS alert from the server: %s (%d)"), alert, last_alert);
@@ -360,7 +372,45 @@ ssize_t CTlsSocketImpl::PushFunction(const void* data, size_t len)
 		return -1;
 	}
 
-	int error;
+	int error{};
+	if (m_tlsState == CTlsSocket::TlsState::conn) {
+		size_t const coalesce_limit = 64 * 1024;
+		if (sendBuffer_.size() + len > coalesce_limit) {
+			error = FlushSendBuffer();
+			if (error && error != EAGAIN) {
+				gnutls_transport_set_errno(m_session, error);
+				return -1;
+			}
+			if (sendBuffer_.size() >= coalesce_limit) {
+				gnutls_transport_set_errno(m_session, EAGAIN);
+				return -1;
+			}
+		}
+
+		sendBuffer_.append(static_cast<unsigned char const*>(data), len);
+		++statRecords_;
+
+		if (!flushPending_) {
+			flushPending_ = true;
+			tlsSocket_.send_event<CTlsFlushEvent>();
+		}
+
+#if TLSDEBUG
+		m_pOwner->LogMessage(MessageType::Debug_Debug, L"  collected, returning %d", len);
+#endif
+		return static_cast<ssize_t>(len);
+	}
+
+	// During handshake and shutdown there is no point in waiting, but
+	// anything collected before needs to go out first.
+	if (sendBuffer_) {
+		error = FlushSendBuffer();
+		if (error) {
+			gnutls_transport_set_errno(m_session, error);
+			return -1;
+		}
+	}
+
 	int written = socketBackend_->Write(data, static_cast<unsigned int>(len), error);
 
 	if (written < 0) {
@@ -375,6 +425,10 @@ ssize_t CTlsSocketImpl::PushFunction(const void* data, size_t len)
 		return -1;
 	}
 
+	++statRecords_;
+	++statWrites_;
+	statBytes_ += static_cast<uint64_t>(written);
+
 #if TLSDEBUG
 	m_pOwner->LogMessage(MessageType::Debug_Debug, L"  returning %d", written);
 #endif
@@ -382,6 +436,56 @@ ssize_t CTlsSocketImpl::PushFunction(const void* data, size_t len)
 	return written;
 }
 
+int CTlsSocketImpl::FlushSendBuffer()
+{
+	while (sendBuffer_) {
+		if (!m_canWriteToSocket) {
+			return EAGAIN;
+		}
+
+		int error;
+		int written = socketBackend_->Write(sendBuffer_.get(), static_cast<unsigned int>(sendBuffer_.size()), error);
+		if (written < 0) {
+			m_canWriteToSocket = false;
+			if (error != EAGAIN) {
+				m_socket_error = error;
+			}
+			return error;
+		}
+
+		++statWrites_;
+		statBytes_ += static_cast<uint64_t>(written);
+		sendBuffer_.consume(static_cast<size_t>(written));
+	}
+
+	return 0;
+}
+
+void CTlsSocketImpl::OnFlush()
+{
+	flushPending_ = false;
+
+	if (!m_session) {
+		return;
+	}
+
+	int error = FlushSendBuffer();
+	if (error && error != EAGAIN) {
+		Failure(GNUTLS_E_PUSH_ERROR, true);
+	}
+}
+
+void CTlsSocketImpl::LogStatistics()
+{
+	if (!statBytes_ || !m_pOwner->ShouldLog(MessageType::Debug_Info)) {
+		return;
+	}
+
+	uint64_t const mb = 1024 * 1024;
+	m_pOwner->LogMessage(MessageType::Debug_Info, L"TLS output: %u records in %u socket writes for %u bytes, %u records and %u writes per MiB",
+		statRecords_, statWrites_, statBytes_, statRecords_ * mb / statBytes_, statWrites_ * mb / statBytes_);
+}
+
 ssize_t CTlsSocketImpl::PullFunction(void* data, size_t len)
 {
 #if TLSDEBUG
@@ -420,7 +524,9 @@ ssize_t CTlsSocketImpl::PullFunction(void* data, size_t len)
 
 void CTlsSocketImpl::operator()(fz::event_base const& ev)
 {
-	fz::dispatch<fz::socket_event>(ev, this, &CTlsSocketImpl::OnSocketEvent);
+	fz::dispatch<fz::socket_event, CTlsFlushEvent>(ev, this,
+		&CTlsSocketImpl::OnSocketEvent,
+		&CTlsSocketImpl::OnFlush);
 }
 
 void CTlsSocketImpl::OnSocketEvent(fz::socket_event_source*, fz::socket_event_flag t, int error)
@@ -486,6 +592,16 @@ void CTlsSocketImpl::OnSend()
 		return;
 	}
 
+	if (sendBuffer_) {
+		int error = FlushSendBuffer();
+		if (error) {
+			if (error != EAGAIN) {
+				Failure(GNUTLS_E_PUSH_ERROR, true);
+			}
+			return;
+		}
+	}
+
 	const int direction = gnutls_record_get_direction(m_session);
 	if (!direction && !m_lastWriteFailed) {
 		return;
@@ -528,6 +644,49 @@ bool CTlsSocketImpl::CopySessionData(const CTlsSocketImpl* pPrimarySocket)
 	return true;
 }
 
+void CTlsSocketImpl::ResumeFromCache()
+{
+	auto & cache = m_pOwner->GetEngine().GetContext().GetTlsSessionCache();
+	auto const data = cache.Get(fz::to_utf8(hostname_), port_, m_pOwner->GetCurrentServer().GetProtocol());
+	if (data.empty()) {
+		return;
+	}
+
+	int res = gnutls_session_set_data(m_session, data.data(), data.size());
+	if (res) {
+		LogError(res, L"gnutls_session_set_data", MessageType::Debug_Info);
+		return;
+	}
+
+	usedCachedSession_ = true;
+	m_pOwner->LogMessage(MessageType::Debug_Info, L"Trying to resume TLS session from session cache.");
+}
+
+void CTlsSocketImpl::StoreSessionInCache()
+{
+	if (!cacheSession_ || !m_session || m_tlsState != CTlsSocket::TlsState::conn) {
+		return;
+	}
+
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+	if (gnutls_protocol_get_version(m_session) == GNUTLS_TLS1_3 && !(gnutls_session_get_flags(m_session) & GNUTLS_SFLAGS_SESSION_TICKET)) {
+		// With TLS 1.3 the session can only be resumed once the server has sent a ticket
+		return;
+	}
+#endif
+
+	cacheSession_ = false;
+
+	datum_holder d;
+	int res = gnutls_session_get_data2(m_session, &d);
+	if (res || !d.data || !d.size) {
+		return;
+	}
+
+	auto & cache = m_pOwner->GetEngine().GetContext().GetTlsSessionCache();
+	cache.Store(fz::to_utf8(hostname_), port_, m_pOwner->GetCurrentServer().GetProtocol(), std::vector<unsigned char>(d.data, d.data + d.size));
+}
+
 bool CTlsSocketImpl::ResumedSession() const
 {
 	return gnutls_session_is_resumed(m_session) != 0;
@@ -566,6 +725,10 @@ int CTlsSocketImpl::Handshake(const CTlsSocketImpl* pPrimarySocket, bool try_res
 		}
 
 		hostname_ = pPrimarySocket->m_socket.peer_host();
+		if (hostname_.empty()) {
+			// The primary connection may already be closed
+			hostname_ = m_socket.peer_host();
+		}
 
 		int port, tmp;
 		port = m_socket.remote_port(tmp);
@@ -583,6 +746,9 @@ int CTlsSocketImpl::Handshake(const CTlsSocketImpl* pPrimarySocket, bool try_res
 			return FZ_REPLY_ERROR;
 		}
 		port_ = port;
+
+		ResumeFromCache();
+		cacheSession_ = true;
 	}
 
 	if (!hostname_.empty() && fz::get_address_type(hostname_) == fz::address_type::unknown) {
@@ -622,6 +788,14 @@ int CTlsSocketImpl::ContinueHandshake()
 			m_pOwner->LogMessage(MessageType::Debug_Info, L"TLS Session resumed");
 		}
 
+		if (usedCachedSession_) {
+			auto & cache = m_pOwner->GetEngine().GetContext().GetTlsSessionCache();
+			cache.RecordResumption(ResumedSession());
+
+			auto const stats = cache.GetStatistics();
+			m_pOwner->LogMessage(MessageType::Debug_Info, L"TLS session cache: %u lookups, %u found, %u resumed", stats.lookups_, stats.found_, stats.resumed_);
+		}
+
 		std::wstring const protocol = GetProtocolName();
 		std::wstring const keyExchange = GetKeyExchange();
 		std::wstring const cipherName = GetCipherName();
@@ -681,11 +855,15 @@ int CTlsSocketImpl::Read(void *buffer, unsigned int len, int& error)
 	int res = DoCallGnutlsRecordRecv(buffer, len);
 	if (res >= 0) {
 		if (res > 0) {
+			if (cacheSession_) {
+				// A session ticket may have arrived along with the data
+				StoreSessionInCache();
+			}
 			TriggerEvents();
 		}
 		else {
 			// Peer did already initiate a shutdown, reply to it
-			gnutls_bye(m_session, GNUTLS_SHUT_WR);
+			DoCallGnutlsBye();
 			// Note: Theoretically this could return a write error.
 			// But we ignore it, since it is perfectly valid for peer
 			// to close the connection after sending its shutdown
@@ -739,10 +917,10 @@ int CTlsSocketImpl::Write(const void *buffer, unsigned int len, int& error)
 	len -= m_writeSkip;
 	buffer = (char*)buffer + m_writeSkip;
 
-	ssize_t res = gnutls_record_send(m_session, buffer, len);
+	ssize_t res = DoCallGnutlsRecordSend(buffer, len);
 
 	while ((res == GNUTLS_E_INTERRUPTED || res == GNUTLS_E_AGAIN) && m_canWriteToSocket) {
-		res = gnutls_record_send(m_session, nullptr, 0);
+		res = DoCallGnutlsRecordSend(nullptr, 0);
 	}
 
 	if (res >= 0) {
@@ -796,7 +974,7 @@ void CTlsSocketImpl::CheckResumeFailedReadWrite()
 	if (m_lastWriteFailed) {
 		ssize_t res = GNUTLS_E_AGAIN;
 		while ((res == GNUTLS_E_INTERRUPTED || res == GNUTLS_E_AGAIN) && m_canWriteToSocket) {
-			res = gnutls_record_send(m_session, nullptr, 0);
+			res = DoCallGnutlsRecordSend(nullptr, 0);
 		}
 
 		if (res == GNUTLS_E_INTERRUPTED || res == GNUTLS_E_AGAIN) {
@@ -823,6 +1001,10 @@ void CTlsSocketImpl::CheckResumeFailedReadWrite()
 
 		peekBuffer_.add(static_cast<size_t>(res));
 
+		if (cacheSession_) {
+			StoreSessionInCache();
+		}
+
 		m_lastReadFailed = false;
 		m_canTriggerRead = true;
 	}
@@ -908,9 +1090,9 @@ int CTlsSocketImpl::Shutdown()
 
 	m_tlsState = CTlsSocket::TlsState::closing;
 
-	int res = gnutls_bye(m_session, GNUTLS_SHUT_WR);
+	int res = DoCallGnutlsBye();
 	while ((res == GNUTLS_E_INTERRUPTED || res == GNUTLS_E_AGAIN) && m_canWriteToSocket) {
-		res = gnutls_bye(m_session, GNUTLS_SHUT_WR);
+		res = DoCallGnutlsBye();
 	}
 	if (!res) {
 		m_tlsState = CTlsSocket::TlsState::closed;
@@ -929,9 +1111,9 @@ void CTlsSocketImpl::ContinueShutdown()
 {
 	m_pOwner->LogMessage(MessageType::Debug_Verbose, L"CTlsSocketImpl::ContinueShutdown()");
 
-	int res = gnutls_bye(m_session, GNUTLS_SHUT_WR);
+	int res = DoCallGnutlsBye();
 	while ((res == GNUTLS_E_INTERRUPTED || res == GNUTLS_E_AGAIN) && m_canWriteToSocket) {
-		res = gnutls_bye(m_session, GNUTLS_SHUT_WR);
+		res = DoCallGnutlsBye();
 	}
 	if (!res) {
 		m_tlsState = CTlsSocket::TlsState::closed;
@@ -959,6 +1141,9 @@ void CTlsSocketImpl::TrustCurrentCert(bool trusted)
 		if (m_lastWriteFailed) {
 			m_lastWriteFailed = false;
 		}
+
+		TryKernelOffload();
+		StoreSessionInCache();
 		CheckResumeFailedReadWrite();
 
 		if (m_tlsState == CTlsSocket::TlsState::conn) {
@@ -1601,6 +1786,63 @@ std::string CTlsSocketImpl::ListTlsCiphers(std::string priority)
 
 int CTlsSocketImpl::DoCallGnutlsRecordRecv(void* data, size_t len)
 {
+	if (ktlsRecv_) {
+		// The kernel has decrypted the data already, only the record type
+		// needs to be looked at.
+		while (true) {
+			if (!m_canReadFromSocket) {
+				return GNUTLS_E_AGAIN;
+			}
+
+			unsigned char type{};
+			int error;
+			int read = socketBackend_->ReadTlsRecord(type, data, static_cast<unsigned int>(len), error);
+			if (read < 0) {
+				m_canReadFromSocket = false;
+				if (error == EAGAIN) {
+					return GNUTLS_E_AGAIN;
+				}
+				m_socket_error = error;
+				return GNUTLS_E_PULL_ERROR;
+			}
+			if (!read) {
+				m_socket_eof = true;
+#ifdef GNUTLS_E_PREMATURE_TERMINATION
+				return GNUTLS_E_PREMATURE_TERMINATION;
+#else
+				return GNUTLS_E_UNEXPECTED_PACKET_LENGTH;
+#endif
+			}
+
+			unsigned char const* p = static_cast<unsigned char const*>(data);
+			if (type == 23) {
+				// Application data
+				return read;
+			}
+			else if (type == 21) {
+				// Alert
+				if (read >= 2 && p[1] == 0) {
+					// close_notify
+					return 0;
+				}
+				ktlsAlert_ = (read >= 2) ? p[1] : 255;
+				return GNUTLS_E_FATAL_ALERT_RECEIVED;
+			}
+			else if (type == 22) {
+				// Post-handshake messages such as new session tickets are of
+				// no use on data connections. Key updates cannot be followed
+				// as the keys are in the kernel.
+				if (p[0] == 24) {
+					m_pOwner->LogMessage(MessageType::Debug_Warning, L"Server sent key update on connection using kernel TLS");
+					return GNUTLS_E_UNEXPECTED_HANDSHAKE_PACKET;
+				}
+				continue;
+			}
+
+			return GNUTLS_E_UNEXPECTED_PACKET;
+		}
+	}
+
 	ssize_t res = gnutls_record_recv(m_session, data, len);
 	while( (res == GNUTLS_E_AGAIN || res == GNUTLS_E_INTERRUPTED) && m_canReadFromSocket && !gnutls_record_get_direction(m_session)) {
 		// Spurious EAGAIN. Can happen if GnuTLS gets a partial
@@ -1616,6 +1858,214 @@ int CTlsSocketImpl::DoCallGnutlsRecordRecv(void* data, size_t len)
 	return static_cast<int>(res);
 }
 
+ssize_t CTlsSocketImpl::DoCallGnutlsRecordSend(void const* data, size_t len)
+{
+	if (!ktlsSend_) {
+		return gnutls_record_send(m_session, data, len);
+	}
+
+	if (!data) {
+		// The kernel takes partial writes, nothing is left pending
+		return 0;
+	}
+
+	if (!m_canWriteToSocket) {
+		return GNUTLS_E_AGAIN;
+	}
+
+	int error;
+	int written = socketBackend_->Write(data, static_cast<unsigned int>(len), error);
+	if (written < 0) {
+		m_canWriteToSocket = false;
+		if (error == EAGAIN) {
+			return GNUTLS_E_AGAIN;
+		}
+		m_socket_error = error;
+		return GNUTLS_E_PUSH_ERROR;
+	}
+
+	return written;
+}
+
+int CTlsSocketImpl::DoCallGnutlsBye()
+{
+	if (!ktlsSend_) {
+		return gnutls_bye(m_session, GNUTLS_SHUT_WR);
+	}
+
+	if (!m_canWriteToSocket) {
+		return GNUTLS_E_AGAIN;
+	}
+
+	// The sequence numbers are known only to the kernel, send the
+	// close_notify alert through it.
+	unsigned char const alert[2] = { GNUTLS_AL_WARNING, GNUTLS_A_CLOSE_NOTIFY };
+	int error;
+	int written = m_socket.write_tls_record(21, alert, sizeof(alert), error);
+	if (written < 0) {
+		m_canWriteToSocket = false;
+		if (error == EAGAIN) {
+			return GNUTLS_E_AGAIN;
+		}
+		m_socket_error = error;
+		return GNUTLS_E_PUSH_ERROR;
+	}
+
+	return 0;
+}
+
+#if HAVE_LINUX_TLS_H
+namespace {
+template<typename Info>
+bool fill_ktls_info(Info & info, unsigned short version, unsigned short cipher, gnutls_datum_t const& key, unsigned char const* seq)
+{
+	if (key.size != sizeof(info.key)) {
+		return false;
+	}
+
+	info.info.version = version;
+	info.info.cipher_type = cipher;
+	memcpy(info.key, key.data, sizeof(info.key));
+	memcpy(info.rec_seq, seq, sizeof(info.rec_seq));
+
+	return true;
+}
+
+template<typename Info>
+bool fill_ktls_gcm_info(Info & info, unsigned short version, unsigned short cipher, gnutls_datum_t const& key, gnutls_datum_t const& iv, unsigned char const* seq)
+{
+	if (!fill_ktls_info(info, version, cipher, key, seq)) {
+		return false;
+	}
+
+#ifdef TLS_1_3_VERSION
+	if (version == TLS_1_3_VERSION) {
+		// Full static IV, the nonce is derived from it and the sequence number
+		if (iv.size != sizeof(info.salt) + sizeof(info.iv)) {
+			return false;
+		}
+		memcpy(info.salt, iv.data, sizeof(info.salt));
+		memcpy(info.iv, iv.data + sizeof(info.salt), sizeof(info.iv));
+		return true;
+	}
+#endif
+
+	// Implicit part of the nonce, the explicit part is the sequence number
+	if (iv.size != sizeof(info.salt)) {
+		return false;
+	}
+	memcpy(info.salt, iv.data, sizeof(info.salt));
+	memcpy(info.iv, seq, sizeof(info.iv));
+	return true;
+}
+}
+#endif
+
+bool CTlsSocketImpl::EnableKernelOffload(bool send)
+{
+#if HAVE_LINUX_TLS_H
+	unsigned short version{};
+	switch (gnutls_protocol_get_version(m_session)) {
+	case GNUTLS_TLS1_2:
+		version = TLS_1_2_VERSION;
+		break;
+#if defined(TLS_1_3_VERSION) && GNUTLS_VERSION_NUMBER >= 0x030603
+	case GNUTLS_TLS1_3:
+		version = TLS_1_3_VERSION;
+		break;
+#endif
+	default:
+		return false;
+	}
+
+	gnutls_datum_t mac_key{};
+	gnutls_datum_t iv{};
+	gnutls_datum_t cipher_key{};
+	unsigned char seq[8];
+	int res = gnutls_record_get_state(m_session, send ? 0 : 1, &mac_key, &iv, &cipher_key, seq);
+	if (res) {
+		LogError(res, L"gnutls_record_get_state", MessageType::Debug_Info);
+		return false;
+	}
+
+	union
+	{
+		tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+#ifdef TLS_CIPHER_AES_GCM_256
+		tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+		tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+#endif
+	} info{};
+	unsigned int size{};
+
+	bool filled{};
+	switch (gnutls_cipher_get(m_session)) {
+	case GNUTLS_CIPHER_AES_128_GCM:
+		filled = fill_ktls_gcm_info(info.aes_gcm_128, version, TLS_CIPHER_AES_GCM_128, cipher_key, iv, seq);
+		size = sizeof(info.aes_gcm_128);
+		break;
+#ifdef TLS_CIPHER_AES_GCM_256
+	case GNUTLS_CIPHER_AES_256_GCM:
+		filled = fill_ktls_gcm_info(info.aes_gcm_256, version, TLS_CIPHER_AES_GCM_256, cipher_key, iv, seq);
+		size = sizeof(info.aes_gcm_256);
+		break;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case GNUTLS_CIPHER_CHACHA20_POLY1305:
+		filled = fill_ktls_info(info.chacha20_poly1305, version, TLS_CIPHER_CHACHA20_POLY1305, cipher_key, seq);
+		if (filled) {
+			if (iv.size == sizeof(info.chacha20_poly1305.iv)) {
+				memcpy(info.chacha20_poly1305.iv, iv.data, sizeof(info.chacha20_poly1305.iv));
+			}
+			else {
+				filled = false;
+			}
+		}
+		size = sizeof(info.chacha20_poly1305);
+		break;
+#endif
+	default:
+		break;
+	}
+
+	int error = filled ? m_socket.set_ktls(send, &info, size) : EOPNOTSUPP;
+	gnutls_memset(&info, 0, sizeof(info));
+
+	if (error) {
+		m_pOwner->LogMessage(MessageType::Debug_Info, L"Kernel TLS not available for %s: %s", send ? L"sending" : L"receiving", fz::socket_error_description(error));
+		return false;
+	}
+
+	return true;
+#else
+	(void)send;
+	return false;
+#endif
+}
+
+void CTlsSocketImpl::TryKernelOffload()
+{
+	if (!ktlsWanted_ || ktlsSend_ || ktlsRecv_) {
+		return;
+	}
+
+	// Everything GnuTLS has buffered needs to have been handed out
+	if (peekBuffer_ || sendBuffer_ || m_writeSkip || gnutls_record_check_pending(m_session)) {
+		return;
+	}
+
+	// The directions are independent of each other, each one can fall
+	// back to GnuTLS on its own.
+	ktlsRecv_ = EnableKernelOffload(false);
+	ktlsSend_ = EnableKernelOffload(true);
+
+	if (ktlsRecv_ || ktlsSend_) {
+		m_pOwner->LogMessage(MessageType::Debug_Info, L"Using kernel TLS for%s%s", ktlsSend_ ? L" sending" : L"", ktlsRecv_ ? L" receiving" : L"");
+	}
+}
+
 std::wstring CTlsSocketImpl::GetGnutlsVersion()
 {
 	const char* v = gnutls_check_version(nullptr);
@@ -13,6 +13,10 @@ typedef std::make_signed_t<size_t> ssize_t;
 
 class CControlSocket;
 class CTlsSocket;
+
+struct tls_flush_event_type{};
+typedef fz::simple_event<tls_flush_event_type> CTlsFlushEvent;
+
 class CTlsSocketImpl final
 {
 public:
@@ -22,6 +26,8 @@ public:
 	bool Init();
 	void Uninit();
 
+	void SetKernelOffload(bool enable) { ktlsWanted_ = enable; }
+
 	int Handshake(const CTlsSocketImpl* pPrimarySocket = nullptr, bool try_resume = 0);
 
 	int Read(void *buffer, unsigned int size, int& error);
@@ -54,6 +60,11 @@ protected:
 	void UninitSession();
 	bool CopySessionData(CTlsSocketImpl const* pPrimarySocket);
 
+	// For connections that are not data connections of a primary one,
+	// sessions are shared through the engine context's session cache.
+	void ResumeFromCache();
+	void StoreSessionInCache();
+
 	void OnRateAvailable(CRateLimiter::rate_direction direction);
 
 	int ContinueHandshake();
@@ -73,7 +84,15 @@ protected:
 	ssize_t PushFunction(const void* data, size_t len);
 	ssize_t PullFunction(void* data, size_t len);
 
+	// Once a direction has been handed to the kernel, these bypass GnuTLS
+	// for it but keep the GnuTLS return value conventions.
 	int DoCallGnutlsRecordRecv(void* data, size_t len);
+	ssize_t DoCallGnutlsRecordSend(void const* data, size_t len);
+	int DoCallGnutlsBye();
+
+	// Called once the connection has been established
+	void TryKernelOffload();
+	bool EnableKernelOffload(bool send);
 
 	void TriggerEvents();
 
@@ -82,6 +101,13 @@ protected:
 
 	void OnRead();
 	void OnSend();
+	void OnFlush();
+
+	// Writes out the collected records. Returns 0 once all have been
+	// written, otherwise EAGAIN or the socket error.
+	int FlushSendBuffer();
+
+	void LogStatistics();
 
 	bool GetSortedPeerCertificates(gnutls_x509_crt_t *& certs, unsigned int & certs_size);
 
@@ -125,6 +151,17 @@ protected:
 
 	fz::buffer peekBuffer_;
 
+	// Once connected, the records GnuTLS produces are collected and written
+	// to the socket together, either once enough data has been collected or
+	// once the current event has been processed.
+	fz::buffer sendBuffer_;
+	bool flushPending_{};
+
+	// Output statistics, logged once the session ends
+	uint64_t statRecords_{};
+	uint64_t statWrites_{};
+	uint64_t statBytes_{};
+
 	gnutls_datum_t m_implicitTrustedCert;
 
 	bool m_socket_eof{};
@@ -136,6 +173,14 @@ protected:
 	fz::native_string hostname_;
 	unsigned int port_{};
 
+	bool usedCachedSession_{};
+	bool cacheSession_{};
+
+	bool ktlsWanted_{};
+	bool ktlsSend_{};
+	bool ktlsRecv_{};
+	int ktlsAlert_{-1};
+
 };
 
 #endif
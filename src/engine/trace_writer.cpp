@@ -0,0 +1,164 @@
+#include <filezilla.h>
+
+#include "trace_writer.h"
+
+#include <string.h>
+
+namespace {
+// Must be a power of two
+size_t const queue_size = 16 * 1024;
+
+// Unless the queue fills up faster, the writer thread wakes up this often
+fz::duration const write_interval = fz::duration::from_milliseconds(250);
+}
+
+CTraceWriter::CTraceWriter(fz::native_string const& file)
+	: start_(fz::monotonic_clock::now())
+{
+	if (file.empty()) {
+		return;
+	}
+
+	if (!file_.open(file, fz::file::writing, fz::file::empty)) {
+		return;
+	}
+
+	trace_file_header header{};
+	memcpy(header.magic, "FZTRACE", 8);
+	header.version = trace_format_version;
+	header.record_size = sizeof(trace_record);
+	header.start_time = (fz::datetime::now() - fz::datetime(0, fz::datetime::milliseconds)).get_microseconds();
+	if (file_.write(&header, sizeof(header)) != static_cast<int64_t>(sizeof(header))) {
+		file_.close();
+		return;
+	}
+
+	slots_.reset(new slot[queue_size]);
+	for (size_t i = 0; i < queue_size; ++i) {
+		slots_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	batch_.reserve(queue_size);
+
+	enabled_ = true;
+	run();
+}
+
+CTraceWriter::~CTraceWriter()
+{
+	if (!enabled_) {
+		return;
+	}
+
+	{
+		fz::scoped_lock l(mtx_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	join();
+}
+
+void CTraceWriter::Record(unsigned int engine, trace_event event, int op, int reply, int64_t bytes, int64_t value)
+{
+	if (!enabled_) {
+		return;
+	}
+
+	// Bounded multi-producer queue, each slot carries a sequence number telling
+	// whether it is free for the given position or still to be consumed.
+	slot* s{};
+	size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+	while (true) {
+		s = &slots_[pos & (queue_size - 1)];
+		size_t const seq = s->sequence.load(std::memory_order_acquire);
+		intptr_t const diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (!diff) {
+			if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// Full
+			++dropped_;
+			return;
+		}
+		else {
+			pos = enqueuePos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	trace_record & r = s->record;
+	r.time = (fz::monotonic_clock::now() - start_).get_microseconds();
+	r.bytes = bytes;
+	r.value = value;
+	r.engine = engine;
+	r.event = static_cast<uint16_t>(event);
+	r.op = static_cast<uint16_t>(op);
+	r.reply = reply;
+	r.reserved = 0;
+	s->sequence.store(pos + 1, std::memory_order_release);
+
+	if (!(pos & (queue_size / 2 - 1))) {
+		// Half the queue has been filled since the last wakeup
+		fz::scoped_lock l(mtx_);
+		cond_.signal(l);
+	}
+}
+
+bool CTraceWriter::Dequeue(trace_record & record)
+{
+	slot & s = slots_[dequeuePos_ & (queue_size - 1)];
+	if (s.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+		return false;
+	}
+
+	record = s.record;
+	s.sequence.store(dequeuePos_ + queue_size, std::memory_order_release);
+	++dequeuePos_;
+
+	return true;
+}
+
+void CTraceWriter::entry()
+{
+	bool quit = false;
+	while (!quit) {
+		{
+			fz::scoped_lock l(mtx_);
+			if (!quit_) {
+				cond_.wait(l, write_interval);
+			}
+			quit = quit_;
+		}
+
+		Write();
+	}
+}
+
+void CTraceWriter::Write()
+{
+	batch_.clear();
+
+	trace_record record;
+	while (batch_.size() < queue_size && Dequeue(record)) {
+		batch_.push_back(record);
+	}
+
+	uint64_t const dropped = dropped_.exchange(0);
+	if (dropped) {
+		batch_.push_back(trace_record{});
+		trace_record & r = batch_.back();
+		r.time = (fz::monotonic_clock::now() - start_).get_microseconds();
+		r.event = static_cast<uint16_t>(trace_event::dropped);
+		r.value = static_cast<int64_t>(dropped);
+	}
+
+	if (batch_.empty() || !file_.opened()) {
+		return;
+	}
+
+	int64_t const size = static_cast<int64_t>(batch_.size() * sizeof(trace_record));
+	if (file_.write(batch_.data(), size) != size) {
+		// Keep draining the queue so that producers do not pile up drops forever
+		file_.close();
+	}
+}
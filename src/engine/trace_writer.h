@@ -0,0 +1,64 @@
+#ifndef FILEZILLA_ENGINE_TRACE_WRITER_HEADER
+#define FILEZILLA_ENGINE_TRACE_WRITER_HEADER
+
+#include "trace_format.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Writes the binary trace file shared by all engines.
+//
+// Records are put into a bounded lock-free queue and written to the file in
+// batches by a background thread. Adding a record never blocks, if the
+// writer cannot keep up the record is dropped and the loss noted in the trace.
+class CTraceWriter final : protected fz::thread
+{
+public:
+	// Tracing is disabled if the file name is empty or the file cannot be created.
+	explicit CTraceWriter(fz::native_string const& file);
+	virtual ~CTraceWriter();
+
+	CTraceWriter(CTraceWriter const&) = delete;
+	CTraceWriter& operator=(CTraceWriter const&) = delete;
+
+	bool enabled() const { return enabled_; }
+
+	void Record(unsigned int engine, trace_event event, int op, int reply, int64_t bytes, int64_t value);
+
+private:
+	virtual void entry() override;
+
+	bool Dequeue(trace_record & record);
+	void Write();
+
+	struct slot final
+	{
+		std::atomic<size_t> sequence;
+		trace_record record;
+	};
+
+	fz::file file_;
+	bool enabled_{};
+
+	fz::monotonic_clock const start_;
+
+	std::unique_ptr<slot[]> slots_;
+	std::atomic<size_t> enqueuePos_{};
+	std::atomic<uint64_t> dropped_{};
+
+	fz::mutex mtx_{false};
+	fz::condition cond_;
+	bool quit_{};
+
+	// Only accessed by the writer thread
+	size_t dequeuePos_{};
+	std::vector<trace_record> batch_;
+};
+
+#endif
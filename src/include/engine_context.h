@@ -4,10 +4,15 @@
 #include <memory>
 
 class CDirectoryCache;
+class CMetrics;
+class CMetricsWriter;
 class COptionsBase;
 class CPathCache;
 class CRateLimiter;
+class CSftpProcessPool;
+class CTraceWriter;
 class OpLockManager;
+class TlsSessionCache;
 class TlsSystemTrustStore;
 
 namespace fz {
@@ -41,6 +46,11 @@ public:
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
 	TlsSystemTrustStore& GetTlsSystemTrustStore();
+	TlsSessionCache& GetTlsSessionCache();
+	CSftpProcessPool& GetSftpProcessPool();
+	CTraceWriter& GetTraceWriter();
+	CMetrics& GetMetrics();
+	CMetricsWriter& GetMetricsWriter();
 
 protected:
 	COptionsBase& options_;
@@ -45,7 +45,8 @@ enum NotificationId
 	nId_active,				// sent if data gets either received or sent
 	nId_data,				// for memory downloads, indicates that new data is available.
 	nId_sftp_encryption,	// information about key exchange, encryption algorithms and so on for SFTP
-	nId_local_dir_created	// local directory has been created
+	nId_local_dir_created,	// local directory has been created
+	nId_transfer_hash		// hash of a transferred file has been verified against the server
 };
 
 // Async request IDs
@@ -480,6 +481,15 @@ public:
 	CLocalPath dir;
 };
 
+// Sent during a file transfer once the server-side hash of the file
+// matched the hash of the transferred data.
+class CTransferHashNotification final : public CNotificationHelper<nId_transfer_hash>
+{
+public:
+	std::wstring algorithm;
+	std::wstring hash;
+};
+
 class CInsecureFTPNotification final : public CAsyncRequestNotification
 {
 public:
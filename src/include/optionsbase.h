@@ -83,6 +83,31 @@ enum engineOptions
 
 	OPTION_CACHE_TTL,
 
+	OPTION_FTP_PIPELINE_DEPTH,	// Maximum number of outstanding commands for bulk
+								// operations, 1 disables pipelining
+
+	OPTION_FTP_MODEZ_LEVEL,		// Compression level for MODE Z, 0 disables MODE Z
+	OPTION_FTP_MODEZ_SKIP_EXTENSIONS, // Pipe-separated file extensions of
+									  // already compressed files
+
+	OPTION_FTP_VERIFY_HASH,		// Compare hash of transferred files with the one
+								// reported by the server if it supports HASH or XSHA256 and similar
+
+	OPTION_HTTP_IDLE_CONNECTIONS, // Number of idle keep-alive connections kept
+								  // around per engine, 0 disables keep-alive
+	OPTION_HTTP_PIPELINING,		// Send queued requests on a keep-alive connection
+								// without waiting for the previous responses
+	OPTION_HTTP_RANGE_CONNECTIONS,	// Connections used to download a large file in
+									// parts if the server supports it, 1 to disable,
+									// no effect on Windows
+	OPTION_FTP_KTLS,			// Let the kernel encrypt and decrypt FTPS data
+								// connections where supported
+	OPTION_TRACE_FILE,			// Binary trace of operations and transfers is written
+								// to this file, empty to disable. Read on startup.
+	OPTION_METRICS_FILE,		// Engine metrics are periodically written to this
+								// file in Prometheus text format, empty to disable
+	OPTION_METRICS_INTERVAL,	// In seconds
+
 	OPTIONS_ENGINE_NUM
 };
 
@@ -286,9 +286,37 @@ public:
 	 */
 	int shutdown();
 
+	/**
+	 * \brief Hands one direction of a TLS connection to the kernel
+	 *
+	 * Linux only. Once the TLS handshake has been done in user space, the
+	 * record state of a direction can be passed to the kernel which then
+	 * encrypts or decrypts the data in that direction. info is one of the
+	 * tls12_crypto_info_* structures from linux/tls.h.
+	 *
+	 * Afterwards read and write transfer plaintext application data.
+	 *
+	 * \return 0 on success, else an error code. EOPNOTSUPP if the platform
+	 * does not support kernel TLS.
+	 */
+	int set_ktls(bool send, void const* info, unsigned int len);
+
+	/**
+	 * \brief Like read, but also returns the TLS content type of the data
+	 *
+	 * Only of use on a socket with kernel TLS for receiving. Data of
+	 * different record types is never returned in the same call.
+	 */
+	int read_tls_record(unsigned char& type, void *buffer, unsigned int size, int& error);
+
+	/// Sends data as record of the given TLS content type on a socket with kernel TLS for sending.
+	int write_tls_record(unsigned char type, void const* buffer, unsigned int size, int& error);
+
 private:
 	friend class listen_socket;
 	native_string host_;
+
+	bool ktls_{};
 };
 
 #ifdef FZ_WINDOWS
@@ -0,0 +1,74 @@
+#ifndef FILEZILLA_ENGINE_TRACE_FORMAT_HEADER
+#define FILEZILLA_ENGINE_TRACE_FORMAT_HEADER
+
+// Format of the binary trace file written by the engine if OPTION_TRACE_FILE
+// is set. Used by the engine and by the offline tool converting traces.
+//
+// The file starts with a trace_file_header followed by any number of
+// trace_records. All fields are in the byte order of the machine that
+// wrote the trace, readers can detect a mismatch using the magic.
+
+#include <stdint.h>
+
+enum class trace_event : uint16_t
+{
+	// op is the command id
+	operation_start = 1,
+
+	// op is the command id, reply the FZ_REPLY_* code
+	operation_end,
+
+	// bytes is the total size or -1 if unknown, value the start offset
+	transfer_start,
+
+	// bytes is the number of bytes transferred so far
+	transfer_progress,
+
+	// bytes is the number of bytes transferred
+	transfer_end,
+
+	// A command has been sent over the control connection, bytes is its size
+	command_sent,
+
+	// reply is the protocol's reply code, value the time in microseconds
+	// since the corresponding command has been sent or -1 if unknown.
+	// Only the first reply to each command has a time. The final reply
+	// following a preliminary 1yz reply has none, it waited for the
+	// data transfer.
+	reply_received,
+
+	// Records got lost as the writer could not keep up, value is their number
+	dropped
+};
+
+struct trace_file_header final
+{
+	char magic[8]; // "FZTRACE" followed by a zero byte
+	uint32_t version;
+	uint32_t record_size;
+
+	// Wall clock time of the start of the trace in microseconds since 1970-01-01 UTC
+	int64_t start_time;
+};
+
+struct trace_record final
+{
+	// Microseconds since the start of the trace, taken from a monotonic clock
+	int64_t time;
+
+	int64_t bytes;
+	int64_t value;
+
+	uint32_t engine;
+	uint16_t event; // a trace_event
+	uint16_t op;
+	int32_t reply;
+	uint32_t reserved;
+};
+
+uint32_t const trace_format_version = 1;
+
+static_assert(sizeof(trace_file_header) == 24, "Unexpected size of trace_file_header");
+static_assert(sizeof(trace_record) == 40, "Unexpected size of trace_record");
+
+#endif
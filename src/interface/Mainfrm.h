@@ -45,6 +45,7 @@ public:
 
 	CStatusView* GetStatusView() { return m_pStatusView; }
 	CQueueView* GetQueue() { return m_pQueueView; }
+	CAsyncRequestQueue* GetAsyncRequestQueue() { return m_pAsyncRequestQueue; }
 	CQuickconnectBar* GetQuickconnectBar() { return m_pQuickconnectBar; }
 
 	// Window size and position as well as pane sizes
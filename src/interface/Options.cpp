@@ -111,6 +111,17 @@ static const t_Option options[OPTIONS_NUM] =
 	{ "Size decimal places", number, _T("1"), normal },
 	{ "TCP Keepalive Interval", number, _T("15"), normal },
 	{ "Cache TTL", number, _T("600"), normal },
+	{ "FTP pipeline depth", number, _T("1"), normal },
+	{ "FTP MODE Z level", number, _T("0"), normal },
+	{ "FTP MODE Z skip extensions", string, _T("7z|avi|bz2|cab|docx|flac|gif|gz|jar|jpeg|jpg|lz|lzma|m4a|mkv|mov|mp3|mp4|ogg|pdf|png|rar|tbz|tgz|txz|webm|webp|xlsx|xz|zip|zst"), normal },
+	{ "FTP verify hash", number, _T("0"), normal },
+	{ "HTTP idle connections", number, _T("4"), normal },
+	{ "HTTP pipelining", number, _T("0"), normal },
+	{ "HTTP range connections", number, _T("1"), normal },
+	{ "FTP kernel TLS", number, _T("0"), normal },
+	{ "Trace file", string, _T(""), normal },
+	{ "Metrics file", string, _T(""), normal },
+	{ "Metrics interval", number, _T("60"), normal },
 
 	// Interface settings
 	{ "Number of Transfers", number, _T("2"), normal },
@@ -199,6 +210,7 @@ static const t_Option options[OPTIONS_NUM] =
 	{ "Disable update footer", number, _T("0"), normal },
 	{ "Master password encryptor", string, _T(""), normal },
 	{ "Tab data", xml, std::wstring(), normal },
+	{ "Recursive listing connections", number, _T("2"), normal },
 
 	// Default/internal options
 	{ "Config Location", string, _T(""), default_only },
@@ -606,6 +618,30 @@ int COptions::Validate(unsigned int nID, int value)
 			value = 9999;
 		}
 		break;
+	case OPTION_FTP_MODEZ_LEVEL:
+		if (value < 0) {
+			value = 0;
+		}
+		else if (value > 9) {
+			value = 9;
+		}
+		break;
+	case OPTION_FTP_PIPELINE_DEPTH:
+		if (value < 1) {
+			value = 1;
+		}
+		else if (value > 100) {
+			value = 100;
+		}
+		break;
+	case OPTION_RECURSIVE_LISTING_CONNECTIONS:
+		if (value < 0) {
+			value = 0;
+		}
+		else if (value > 10) {
+			value = 10;
+		}
+		break;
 	case OPTION_CACHE_TTL:
 		if (value < 30) {
 			value = 30;
@@ -614,6 +650,30 @@ int COptions::Validate(unsigned int nID, int value)
 			value = 60 * 60 * 24;
 		}
 		break;
+	case OPTION_HTTP_IDLE_CONNECTIONS:
+		if (value < 0) {
+			value = 0;
+		}
+		else if (value > 16) {
+			value = 16;
+		}
+		break;
+	case OPTION_HTTP_RANGE_CONNECTIONS:
+		if (value < 1) {
+			value = 1;
+		}
+		else if (value > 10) {
+			value = 10;
+		}
+		break;
+	case OPTION_METRICS_INTERVAL:
+		if (value < 1) {
+			value = 1;
+		}
+		else if (value > 60 * 60 * 24) {
+			value = 60 * 60 * 24;
+		}
+		break;
 	}
 	return value;
 }
@@ -99,6 +99,7 @@ enum interfaceOptions
 	OPTION_DISABLE_UPDATE_FOOTER,
 	OPTION_MASTERPASSWORDENCRYPTOR,
 	OPTION_TAB_DATA,
+	OPTION_RECURSIVE_LISTING_CONNECTIONS,
 
 	// Default/internal options
 	OPTION_DEFAULT_SETTINGSDIR, // guaranteed to be (back)slash-terminated
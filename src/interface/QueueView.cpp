@@ -504,6 +504,12 @@ void CQueueView::ProcessNotification(t_EngineData* pEngineData, std::unique_ptr<
 			}
 		}
 		break;
+	case nId_transfer_hash:
+		if (pEngineData->pItem && pEngineData->pItem->GetType() == QueueItemType::File) {
+			auto const& hashNotification = static_cast<CTransferHashNotification const&>(*pNotification.get());
+			static_cast<CFileItem*>(pEngineData->pItem)->SetVerifiedHash(hashNotification.algorithm, hashNotification.hash);
+		}
+		break;
 	case nId_listing:
 		{
 			auto const& listingNotification = static_cast<CDirectoryListingNotification const&>(*pNotification.get());
@@ -520,6 +526,18 @@ void CQueueView::ProcessNotification(t_EngineData* pEngineData, std::unique_ptr<
 	}
 }
 
+int CQueueView::GetActiveConnectionCount(CServer const& server) const
+{
+	int count = 0;
+	for (auto const* serverItem : m_serverList) {
+		if (serverItem->GetSite().server == server) {
+			count += serverItem->m_activeCount;
+		}
+	}
+
+	return count;
+}
+
 bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData *&pEngineData)
 {
 	Site const& site = server_item.GetSite();
@@ -539,9 +557,14 @@ bool CQueueView::CanStartTransfer(CServerItem const & server_item, t_EngineData
 		}
 
 		if (browsingSite.server == site.server) {
-			++active_count;
-			browsingStateOnSameServer = pState;
-			break;
+			// Listings prefetched during a recursive operation take connections as well
+			if (pState->GetRemoteRecursiveOperation()) {
+				active_count += static_cast<int>(pState->GetRemoteRecursiveOperation()->GetPrefetchConnectionCount());
+			}
+			if (!browsingStateOnSameServer) {
+				++active_count;
+				browsingStateOnSameServer = pState;
+			}
 		}
 	}
 
@@ -128,6 +128,9 @@ public:
 
 	bool empty() const;
 	int IsActive() const { return m_activeMode; }
+
+	// Number of transfers in progress to the given server
+	int GetActiveConnectionCount(CServer const& server) const;
 	bool SetActive(bool active = true);
 	bool Quit();
 
@@ -71,7 +71,11 @@ void CCommandQueue::ProcessNextCommand()
 		// - Interface cannot obtain listing since not connected
 		// - Yet getting operation successful
 		// To keep things flowing, we need to advance the recursive operation.
-		m_state.GetRemoteRecursiveOperation()->NextOperation();
+		if (m_state.GetRemoteRecursiveOperation()->NextOperation() == FZ_REPLY_WOULDBLOCK && m_CommandList.empty()) {
+			// Not idle, waiting for a listing from a secondary connection
+			--m_inside_commandqueue;
+			return;
+		}
 	}
 
 	while (!m_CommandList.empty()) {
@@ -5,6 +5,9 @@
 
 #include "QueueView.h"
 
+#include <algorithm>
+#include <thread>
+
 BEGIN_EVENT_TABLE(CLocalRecursiveOperation, wxEvtHandler)
 END_EVENT_TABLE()
 
@@ -17,6 +20,37 @@ void local_recursion_root::add_dir_to_visit(CLocalPath const& localPath, CServer
 }
 
 
+namespace {
+size_t enumerator_count()
+{
+	// Enumeration is mostly bound by filesystem latency, not by CPU, so even
+	// on machines with few cores it pays to have several requests in flight.
+	size_t const cores = std::thread::hardware_concurrency();
+	return std::min(std::max(cores, size_t(4)), size_t(16));
+}
+}
+
+class CLocalRecursiveOperation::enumerator final : public fz::thread
+{
+public:
+	explicit enumerator(CLocalRecursiveOperation& op)
+		: op_(op)
+	{}
+
+	virtual ~enumerator()
+	{
+		join();
+	}
+
+private:
+	virtual void entry() override
+	{
+		op_.Enumerate();
+	}
+
+	CLocalRecursiveOperation& op_;
+};
+
 CLocalRecursiveOperation::CLocalRecursiveOperation(CState& state)
 	: CRecursiveOperation(state)
 {
@@ -24,7 +58,18 @@ CLocalRecursiveOperation::CLocalRecursiveOperation(CState& state)
 
 CLocalRecursiveOperation::~CLocalRecursiveOperation()
 {
-	join();
+	{
+		fz::scoped_lock l(mutex_);
+		recursion_roots_.clear();
+		cond_.signal(l);
+	}
+	JoinEnumerators();
+}
+
+void CLocalRecursiveOperation::JoinEnumerators()
+{
+	// Destructor of each enumerator joins its thread
+	enumerators_.clear();
 }
 
 void CLocalRecursiveOperation::AddRecursionRoot(local_recursion_root && root)
@@ -82,7 +127,20 @@ bool CLocalRecursiveOperation::DoStartRecursiveOperation(OperationMode mode, Act
 
 		m_filters = filters;
 
-		if (!run()) {
+		size_t const count = enumerator_count();
+		busy_enumerators_ = 0;
+		running_enumerators_ = count;
+		for (size_t i = 0; i < count; ++i) {
+			auto e = std::make_unique<enumerator>(*this);
+			if (!e->run()) {
+				// Enumerators already running will pick up the work
+				running_enumerators_ -= count - i;
+				break;
+			}
+			enumerators_.emplace_back(std::move(e));
+		}
+
+		if (enumerators_.empty()) {
 			m_operationMode = recursive_none;
 			return false;
 		}
@@ -111,9 +169,11 @@ void CLocalRecursiveOperation::StopRecursiveOperation()
 		m_processedFiles = 0;
 		m_processedDirectories = 0;
 
+		// Waiting enumerators wake each other up in turn until all have exited
+		cond_.signal(l);
 	}
 
-	join();
+	JoinEnumerators();
 	m_listedDirectories.clear();
 
 	m_state.NotifyHandlers(STATECHANGE_LOCAL_RECURSION_STATUS);
@@ -149,6 +209,11 @@ void CLocalRecursiveOperation::EnqueueEnumeratedListing(fz::scoped_lock& l, list
 		root.add_dir_to_visit(localSub, remoteSub);
 	}
 
+	if (!d.dirs.empty()) {
+		// Wake up an idle enumerator to work on the new directories
+		cond_.signal(l);
+	}
+
 	m_listedDirectories.emplace_back(std::move(d));
 
 	// Hand off to GUI thread
@@ -159,8 +224,9 @@ void CLocalRecursiveOperation::EnqueueEnumeratedListing(fz::scoped_lock& l, list
 	}
 }
 
-void CLocalRecursiveOperation::entry()
+void CLocalRecursiveOperation::Enumerate()
 {
+	bool last{};
 	{
 		fz::scoped_lock l(mutex_);
 
@@ -173,7 +239,14 @@ void CLocalRecursiveOperation::entry()
 			{
 				auto& root = recursion_roots_.front();
 				if (root.m_dirsToVisit.empty()) {
+					if (busy_enumerators_) {
+						// Another enumerator may still find subdirectories of this root
+						cond_.wait(l);
+						continue;
+					}
+
 					recursion_roots_.pop_front();
+					cond_.signal(l);
 					continue;
 				}
 
@@ -182,8 +255,14 @@ void CLocalRecursiveOperation::entry()
 				d.remotePath = dir.remotePath;
 
 				root.m_dirsToVisit.pop_front();
+
+				if (!root.m_dirsToVisit.empty()) {
+					cond_.signal(l);
+				}
 			}
 
+			++busy_enumerators_;
+
 			// Do the slow part without holding mutex
 			l.unlock();
 
@@ -233,6 +312,8 @@ void CLocalRecursiveOperation::entry()
 			}
 
 			l.lock();
+			--busy_enumerators_;
+
 			// Check for cancellation
 			if (recursion_roots_.empty()) {
 				break;
@@ -240,13 +321,24 @@ void CLocalRecursiveOperation::entry()
 			if (!sentPartial || !d.files.empty() || !d.dirs.empty()) {
 				EnqueueEnumeratedListing(l, std::move(d));
 			}
+			if (!busy_enumerators_) {
+				// Let a waiting enumerator check whether the root is done
+				cond_.signal(l);
+			}
 		}
 
-		listing d;
-		m_listedDirectories.emplace_back(std::move(d));
+		cond_.signal(l);
+
+		last = !--running_enumerators_;
+		if (last) {
+			listing d;
+			m_listedDirectories.emplace_back(std::move(d));
+		}
 	}
 
-	CallAfter(&CLocalRecursiveOperation::OnListedDirectory);
+	if (last) {
+		CallAfter(&CLocalRecursiveOperation::OnListedDirectory);
+	}
 }
 
 void CLocalRecursiveOperation::OnListedDirectory()
@@ -30,7 +30,7 @@ private:
 	std::deque<new_dir> m_dirsToVisit;
 };
 
-class CLocalRecursiveOperation final : public CRecursiveOperation, private fz::thread, public wxEvtHandler
+class CLocalRecursiveOperation final : public CRecursiveOperation, public wxEvtHandler
 {
 public:
 	class listing final
@@ -64,13 +64,26 @@ protected:
 
 	virtual void OnStateChange(t_statechange_notifications notification, const wxString&, const void* data2);
 
-	virtual void entry();
+	// Directories are enumerated by a small pool of threads, all pulling from
+	// the front recursion root. A root is only finished once its queue is empty
+	// and no enumerator is still listing one of its directories.
+	class enumerator;
+	friend class enumerator;
+
+	void Enumerate();
 
 	void EnqueueEnumeratedListing(fz::scoped_lock& l, listing&& d);
 
+	void JoinEnumerators();
+
 	std::deque<local_recursion_root> recursion_roots_;
 
 	fz::mutex mutex_;
+	fz::condition cond_;
+
+	std::vector<std::unique_ptr<enumerator>> enumerators_;
+	size_t running_enumerators_{};
+	size_t busy_enumerators_{};
 
 	std::deque<listing> m_listedDirectories;
 
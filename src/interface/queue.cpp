@@ -342,6 +342,11 @@ void CFileItem::SetStatusMessage(CFileItem::Status status)
 	m_status = status;
 }
 
+void CFileItem::SetVerifiedHash(std::wstring const& algorithm, std::wstring const& hash)
+{
+	m_verifiedHash = fz::sparse_optional<std::wstring>(algorithm + L" " + hash);
+}
+
 wxString const& CFileItem::GetStatusMessage() const
 {
 	static wxString statusTexts[] = {
@@ -1004,6 +1009,11 @@ wxString CQueueViewBase::OnGetItemText(CQueueItem* pItem, ColumnId column) const
 				return pFileItem->GetStatusMessage();
 			case colTime:
 				return CTimeFormat::FormatDateTime(pItem->GetTime());
+			case colHash:
+				if (pFileItem->GetVerifiedHash()) {
+					return *pFileItem->GetVerifiedHash();
+				}
+				break;
 			default:
 				break;
 			}
@@ -1270,9 +1280,9 @@ void CQueueViewBase::UpdateSelections_ItemRangeRemoved(int removed, int count)
 
 void CQueueViewBase::AddQueueColumn(ColumnId id)
 {
-	const unsigned long widths[8] = { 180, 60, 180, 80, 60, 100, 150, 150 };
-	const int alignment[8] = { wxLIST_FORMAT_LEFT, wxLIST_FORMAT_CENTER, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_RIGHT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT };
-	const wxString names[8] = { _("Server/Local file"), _("Direction"), _("Remote file"), _("Size"), _("Priority"), _("Time"), _("Status"), _("Reason") };
+	const unsigned long widths[9] = { 180, 60, 180, 80, 60, 100, 150, 150, 150 };
+	const int alignment[9] = { wxLIST_FORMAT_LEFT, wxLIST_FORMAT_CENTER, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_RIGHT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT, wxLIST_FORMAT_LEFT };
+	const wxString names[9] = { _("Server/Local file"), _("Direction"), _("Remote file"), _("Size"), _("Priority"), _("Time"), _("Status"), _("Reason"), _("Hash") };
 
 	AddColumn(names[id], alignment[id], widths[id]);
 	m_columns.push_back(id);
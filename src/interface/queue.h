@@ -202,6 +202,11 @@ public:
 
 	void SetTargetFile(wxString const& file);
 
+	// Algorithm and digest, set once the transferred file has been
+	// verified against the hash reported by the server.
+	fz::sparse_optional<std::wstring> const& GetVerifiedHash() const { return m_verifiedHash; }
+	void SetVerifiedHash(std::wstring const& algorithm, std::wstring const& hash);
+
 	enum class Status : unsigned char {
 		none,
 		incorrect_password,
@@ -271,6 +276,7 @@ public:
 protected:
 	std::wstring const m_sourceFile;
 	fz::sparse_optional<std::wstring> m_targetFile;
+	fz::sparse_optional<std::wstring> m_verifiedHash;
 	CLocalPath const m_localPath;
 	CServerPath const m_remotePath;
 	int64_t m_size{};
@@ -316,7 +322,8 @@ public:
 		colPriority,
 		colTime,
 		colTransferStatus,
-		colErrorReason
+		colErrorReason,
+		colHash
 	};
 
 	CQueueViewBase(CQueue* parent, int index, const wxString& title);
@@ -11,7 +11,7 @@ END_EVENT_TABLE()
 CQueueViewSuccessful::CQueueViewSuccessful(CQueue* parent, int index)
 	: CQueueViewFailed(parent, index, _("Successful transfers"))
 {
-	std::vector<ColumnId> extraCols({colTime});
+	std::vector<ColumnId> extraCols({colTime, colHash});
 	CreateColumns(extraCols);
 
 	m_autoClear = COptions::Get()->GetOptionVal(OPTION_QUEUE_SUCCESSFUL_AUTOCLEAR) ? true : false;
@@ -0,0 +1,247 @@
+#include <filezilla.h>
+#include "remote_listing_prefetcher.h"
+#include "asyncrequestqueue.h"
+#include "loginmanager.h"
+#include "Mainfrm.h"
+#include "Options.h"
+#include "StatusView.h"
+
+CRemoteListingPrefetcher::CRemoteListingPrefetcher(CMainFrame& mainFrame, Site const& site, size_t connections, std::function<void()> const& onFinished)
+	: mainFrame_(mainFrame)
+	, site_(site)
+	, onFinished_(onFinished)
+{
+	connections_.resize(connections);
+	for (auto & c : connections_) {
+		c.engine = std::make_unique<CFileZillaEngine>(mainFrame_.GetEngineContext(), *this);
+	}
+}
+
+CRemoteListingPrefetcher::~CRemoteListingPrefetcher()
+{
+	for (auto & c : connections_) {
+		if (mainFrame_.GetAsyncRequestQueue()) {
+			mainFrame_.GetAsyncRequestQueue()->ClearPending(c.engine.get());
+		}
+		c.engine.reset();
+	}
+}
+
+size_t CRemoteListingPrefetcher::GetConnectionCount(Site const& site, int activeTransfers)
+{
+	if (!site) {
+		return 0;
+	}
+
+	// Cannot answer interactive login prompts on secondary connections
+	if (site.credentials.logonType_ == LogonType::interactive) {
+		return 0;
+	}
+
+	int count = COptions::Get()->GetOptionVal(OPTION_RECURSIVE_LISTING_CONNECTIONS);
+
+	// Stay below the connection limit, the primary connection and the
+	// transfers of the queue count as well.
+	int const limit = site.server.MaximumMultipleConnections();
+	if (limit > 0 && count > limit - 1 - activeTransfers) {
+		count = limit - 1 - activeTransfers;
+	}
+
+	return (count > 0) ? static_cast<size_t>(count) : 0;
+}
+
+void CRemoteListingPrefetcher::Prefetch(CServerPath const& path, std::wstring const& subdir, bool link)
+{
+	if (connections_.empty()) {
+		return;
+	}
+
+	key_type key(path, subdir);
+	if (!requested_.insert(key).second) {
+		return;
+	}
+	pending_.insert(key);
+
+	request r;
+	r.path = path;
+	r.subdir = subdir;
+	r.link = link;
+	queue_.emplace_back(std::move(r));
+
+	ProcessNext();
+}
+
+bool CRemoteListingPrefetcher::IsPending(CServerPath const& path, std::wstring const& subdir) const
+{
+	return pending_.find(key_type(path, subdir)) != pending_.cend();
+}
+
+void CRemoteListingPrefetcher::OnEngineEvent(CFileZillaEngine* engine)
+{
+	CallAfter(&CRemoteListingPrefetcher::DoOnEngineEvent, engine);
+}
+
+CRemoteListingPrefetcher::connection* CRemoteListingPrefetcher::GetConnection(CFileZillaEngine const* engine)
+{
+	for (auto & c : connections_) {
+		if (c.engine.get() == engine) {
+			return &c;
+		}
+	}
+	return nullptr;
+}
+
+void CRemoteListingPrefetcher::DoOnEngineEvent(CFileZillaEngine* engine)
+{
+	connection* c = GetConnection(engine);
+	if (!c) {
+		return;
+	}
+
+	std::unique_ptr<CNotification> pNotification = c->engine->GetNextNotification();
+	while (pNotification) {
+		switch (pNotification->GetID())
+		{
+		case nId_logmsg:
+			if (mainFrame_.GetStatusView()) {
+				mainFrame_.GetStatusView()->AddToLog(static_cast<CLogmsgNotification&>(*pNotification.get()));
+			}
+			break;
+		case nId_operation:
+			ProcessReply(*c, static_cast<COperationNotification&>(*pNotification.get()).nReplyCode);
+			break;
+		case nId_asyncrequest:
+			{
+				// Things like trusting a certificate or host key are already
+				// taken care of by the primary connection. Secondary connections
+				// get the same answers without the user being bothered.
+				auto pAsyncRequest = unique_static_cast<CAsyncRequestNotification>(std::move(pNotification));
+				if (mainFrame_.GetAsyncRequestQueue()) {
+					mainFrame_.GetAsyncRequestQueue()->AddRequest(c->engine.get(), std::move(pAsyncRequest));
+				}
+			}
+			break;
+		default:
+			// Listings are not needed, they are put into the cache by the engine
+			break;
+		}
+
+		pNotification = c->engine->GetNextNotification();
+	}
+}
+
+void CRemoteListingPrefetcher::ProcessNext()
+{
+	if (inProcessNext_) {
+		return;
+	}
+	inProcessNext_ = true;
+
+	for (auto & c : connections_) {
+		if (queue_.empty()) {
+			break;
+		}
+		if (c.dead || c.busy) {
+			continue;
+		}
+
+		// Execute may complete synchronously, keep feeding this connection
+		while (!c.busy && !c.dead && !queue_.empty()) {
+			if (!Execute(c)) {
+				break;
+			}
+		}
+	}
+
+	bool alive = false;
+	for (auto const& c : connections_) {
+		if (!c.dead) {
+			alive = true;
+			break;
+		}
+	}
+	if (!alive) {
+		// All secondary connections failed. Primary connection has to do everything.
+		auto queue = std::move(queue_);
+		queue_.clear();
+		for (auto const& r : queue) {
+			Finish(r);
+		}
+	}
+
+	inProcessNext_ = false;
+}
+
+bool CRemoteListingPrefetcher::Execute(connection& c)
+{
+	int res;
+	if (!c.connected) {
+		if (!CLoginManager::Get().GetPassword(site_, true)) {
+			c.dead = true;
+			return false;
+		}
+		res = c.engine->Execute(CConnectCommand(site_.server, site_.Handle(), site_.credentials, false));
+	}
+	else {
+		c.current = queue_.front();
+		queue_.pop_front();
+		res = c.engine->Execute(CListCommand(c.current.path, c.current.subdir, c.current.link ? LIST_FLAG_LINK : 0));
+	}
+
+	c.busy = true;
+	if (res == FZ_REPLY_WOULDBLOCK) {
+		return true;
+	}
+
+	ProcessReply(c, res);
+	return true;
+}
+
+void CRemoteListingPrefetcher::ProcessReply(connection& c, int reply)
+{
+	if (!c.busy) {
+		// Pending events, e.g. a disconnect while idle
+		if (reply & FZ_REPLY_DISCONNECTED) {
+			c.connected = false;
+		}
+		return;
+	}
+	c.busy = false;
+
+	if (!c.connected) {
+		if (reply == FZ_REPLY_OK || reply == FZ_REPLY_ALREADYCONNECTED) {
+			c.connected = true;
+		}
+		else {
+			c.dead = true;
+		}
+	}
+	else {
+		if (reply & FZ_REPLY_DISCONNECTED) {
+			c.connected = false;
+		}
+
+		// Regardless of outcome, if it failed the primary connection will
+		// try again and deal with any errors.
+		Finish(c.current);
+		c.current = request();
+	}
+
+	ProcessNext();
+}
+
+void CRemoteListingPrefetcher::Finish(request const& r)
+{
+	pending_.erase(key_type(r.path, r.subdir));
+
+	// Deferred, the callback may well end up destroying this instance
+	CallAfter(&CRemoteListingPrefetcher::NotifyFinished);
+}
+
+void CRemoteListingPrefetcher::NotifyFinished()
+{
+	auto const onFinished = onFinished_;
+	if (onFinished) {
+		onFinished();
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef FILEZILLA_INTERFACE_REMOTE_LISTING_PREFETCHER_HEADER
+#define FILEZILLA_INTERFACE_REMOTE_LISTING_PREFETCHER_HEADER
+
+#include "serverdata.h"
+
+#include <functional>
+#include <set>
+
+class CMainFrame;
+
+// Obtains directory listings over a few secondary connections ahead of
+// the primary connection walking a directory tree during a recursive operation.
+//
+// The listings are not handed back to the caller directly, they end up in the
+// directory cache shared by all engines. Once the primary connection gets to
+// the prefetched directories, it can use the cached listing instead of having
+// to wait for a full listing round trip. This way the order in which the
+// recursive operation processes directories is unaffected.
+class CRemoteListingPrefetcher final : public wxEvtHandler, public EngineNotificationHandler
+{
+public:
+	// The callback gets invoked each time a prefetch request has been finished.
+	CRemoteListingPrefetcher(CMainFrame& mainFrame, Site const& site, size_t connections, std::function<void()> const& onFinished);
+	virtual ~CRemoteListingPrefetcher();
+
+	CRemoteListingPrefetcher(CRemoteListingPrefetcher const&) = delete;
+	CRemoteListingPrefetcher& operator=(CRemoteListingPrefetcher const&) = delete;
+
+	// Returns the number of connections a prefetcher for the given site would use.
+	// activeTransfers is the number of connections the queue holds to the same server.
+	static size_t GetConnectionCount(Site const& site, int activeTransfers);
+
+	size_t GetActiveConnectionCount() const { return connections_.size(); }
+
+	// Does nothing if the directory has already been requested before
+	void Prefetch(CServerPath const& path, std::wstring const& subdir, bool link);
+
+	// Whether a listing for the directory is queued or in progress
+	bool IsPending(CServerPath const& path, std::wstring const& subdir) const;
+
+	// Upper limit of directories that should be requested ahead of the primary connection
+	size_t GetWindowSize() const { return connections_.size() * 4; }
+
+private:
+	struct request final
+	{
+		CServerPath path;
+		std::wstring subdir;
+		bool link{};
+	};
+
+	struct connection final
+	{
+		std::unique_ptr<CFileZillaEngine> engine;
+		request current;
+		bool connected{};
+		bool busy{};
+		bool dead{};
+	};
+
+	virtual void OnEngineEvent(CFileZillaEngine* engine) override;
+	void DoOnEngineEvent(CFileZillaEngine* engine);
+
+	connection* GetConnection(CFileZillaEngine const* engine);
+
+	void ProcessNext();
+	bool Execute(connection& c);
+	void ProcessReply(connection& c, int reply);
+	void Finish(request const& r);
+	void NotifyFinished();
+
+	CMainFrame& mainFrame_;
+	Site site_;
+
+	std::vector<connection> connections_;
+
+	std::deque<request> queue_;
+
+	typedef std::pair<CServerPath, std::wstring> key_type;
+	std::set<key_type> requested_;
+	std::set<key_type> pending_;
+
+	std::function<void()> onFinished_;
+
+	// Reentrancy guard
+	bool inProcessNext_{};
+};
+
+#endif
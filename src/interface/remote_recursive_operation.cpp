@@ -3,8 +3,10 @@
 #include "commandqueue.h"
 #include "chmoddialog.h"
 #include "filter.h"
+#include "Mainfrm.h"
 #include "Options.h"
 #include "queue.h"
+#include "remote_listing_prefetcher.h"
 
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/recursive_remove.hpp>
@@ -106,15 +108,50 @@ void CRemoteRecursiveOperation::StartRecursiveOperation(OperationMode mode, Acti
 
 	m_filters = filters;
 
+	int const activeTransfers = m_state.GetMainFrame().GetQueue()->GetActiveConnectionCount(m_state.GetSite().server);
+	size_t const connections = CRemoteListingPrefetcher::GetConnectionCount(m_state.GetSite(), activeTransfers);
+	if (connections) {
+		prefetcher_ = std::make_unique<CRemoteListingPrefetcher>(m_state.GetMainFrame(), m_state.GetSite(), connections, [this]() { OnPrefetchFinished(); });
+	}
+
 	NextOperation();
 }
 
-bool CRemoteRecursiveOperation::NextOperation()
+size_t CRemoteRecursiveOperation::GetPrefetchConnectionCount() const
+{
+	return prefetcher_ ? prefetcher_->GetActiveConnectionCount() : 0;
+}
+
+void CRemoteRecursiveOperation::Prefetch(recursion_root const& root)
+{
+	size_t const window = prefetcher_->GetWindowSize();
+
+	size_t requested = 0;
+	for (auto it = ++root.m_dirsToVisit.cbegin(); it != root.m_dirsToVisit.cend() && requested < window; ++it) {
+		if (!it->doVisit) {
+			continue;
+		}
+		prefetcher_->Prefetch(it->parent, it->subdir, it->link != 0);
+		++requested;
+	}
+}
+
+void CRemoteRecursiveOperation::OnPrefetchFinished()
+{
+	if (waitingForPrefetch_) {
+		waitingForPrefetch_ = false;
+		NextOperation();
+	}
+}
+
+int CRemoteRecursiveOperation::NextOperation()
 {
 	if (m_operationMode == recursive_none) {
-		return false;
+		return FZ_REPLY_OK;
 	}
 
+	waitingForPrefetch_ = false;
+
 	while (!recursion_roots_.empty()) {
 		auto & root = recursion_roots_.front();
 		while (!root.m_dirsToVisit.empty()) {
@@ -125,9 +162,19 @@ bool CRemoteRecursiveOperation::NextOperation()
 				continue;
 			}
 
+			if (prefetcher_) {
+				if (prefetcher_->IsPending(dirToVisit.parent, dirToVisit.subdir)) {
+					// Listing is being obtained on a secondary connection. Once it
+					// is done, the listing can be taken from the cache.
+					waitingForPrefetch_ = true;
+					return FZ_REPLY_WOULDBLOCK;
+				}
+				Prefetch(root);
+			}
+
 			CListCommand* cmd = new CListCommand(dirToVisit.parent, dirToVisit.subdir, dirToVisit.link ? LIST_FLAG_LINK : 0);
 			m_state.m_pCommandQueue->ProcessCommand(cmd, CCommandQueue::recursiveOperation);
-			return true;
+			return FZ_REPLY_CONTINUE;
 		}
 
 		recursion_roots_.pop_front();
@@ -139,13 +186,13 @@ bool CRemoteRecursiveOperation::NextOperation()
 		if (!curPath.empty() && (curPath == m_finalDir || m_finalDir.IsParentOf(curPath, false))) {
 			StopRecursiveOperation();
 			m_state.ChangeRemoteDir(m_finalDir, std::wstring(), LIST_FLAG_REFRESH);
-			return false;
+			return FZ_REPLY_OK;
 		}
 	}
 
 	StopRecursiveOperation();
 	m_state.RefreshRemote();
-	return false;
+	return FZ_REPLY_OK;
 }
 
 bool CRemoteRecursiveOperation::BelowRecursionRoot(const CServerPath& path, recursion_root::new_dir &dir)
@@ -413,6 +460,9 @@ void CRemoteRecursiveOperation::StopRecursiveOperation()
 	}
 	recursion_roots_.clear();
 
+	prefetcher_.reset();
+	waitingForPrefetch_ = false;
+
 	if (m_pChmodDlg) {
 		m_pChmodDlg->Destroy();
 		m_pChmodDlg = 0;
@@ -6,6 +6,7 @@
 #include <libfilezilla/optional.hpp>
 
 class CChmodDialog;
+class CRemoteListingPrefetcher;
 
 class recursion_root final
 {
@@ -65,6 +66,9 @@ public:
 
 	virtual void StopRecursiveOperation();
 
+	// Number of secondary connections used to prefetch listings
+	size_t GetPrefetchConnectionCount() const;
+
 protected:
 	void LinkIsNotDir();
 	void ListingFailed(int error);
@@ -72,14 +76,24 @@ protected:
 	// Processes the directory listing in case of a recursive operation
 	void ProcessDirectoryListing(const CDirectoryListing* pDirectoryListing);
 
-	bool NextOperation();
+	// Returns FZ_REPLY_CONTINUE if a command has been queued, FZ_REPLY_OK if
+	// the operation is done. FZ_REPLY_WOULDBLOCK if the next listing is still
+	// being obtained by the prefetcher, it continues once that has finished.
+	int NextOperation();
 
 	virtual void OnStateChange(t_statechange_notifications notification, const wxString&, const void* data2);
 
 	bool BelowRecursionRoot(const CServerPath& path, recursion_root::new_dir &dir);
 
+	// Requests listings of the directories following the front one from the prefetcher
+	void Prefetch(recursion_root const& root);
+	void OnPrefetchFinished();
+
 	std::deque<recursion_root> recursion_roots_;
 
+	std::unique_ptr<CRemoteListingPrefetcher> prefetcher_;
+	bool waitingForPrefetch_{};
+
 	CServerPath m_finalDir;
 
 	// Needed for recursive_chmod
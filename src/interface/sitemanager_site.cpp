@@ -355,6 +355,22 @@ void CSiteManagerSite::SetControlVisibility(ServerProtocol protocol, LogonType t
 		else if (name == "identuser") {
 			label.SetLabel(_("&User:"));
 		}
+		else if (name == "xfer_window") {
+			// @translator: Keep short
+			label.SetLabel(_("Transfer window (KiB):"));
+		}
+		else if (name == "xfer_blocksize") {
+			// @translator: Keep short
+			label.SetLabel(_("Request size (KiB):"));
+		}
+		else if (name == "compression") {
+			// @translator: Keep short
+			label.SetLabel(_("Compression level (0-9):"));
+		}
+		else if (name == "channels_per_connection") {
+			// @translator: Keep short
+			label.SetLabel(_("Sessions per connection:"));
+		}
 		else {
 			label.SetLabel(name);
 		}
@@ -214,6 +214,8 @@ public:
 
 	CStateFilterManager& GetStateFilterManager() { return m_stateFilterManager; }
 
+	CMainFrame& GetMainFrame() { return m_mainFrame; }
+
 protected:
 	void SetSite(Site const& site, CServerPath const& path = CServerPath());
 
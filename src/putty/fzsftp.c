@@ -9,15 +9,49 @@
 int bytesAvailable[2] = { 0, 0 };
 int limit[2] = { 0, 0 };
 
+/* Set once no more quota is to be requested */
+static int quota_disabled = 0;
+
+/*
+ * Set once the process owns a connection other processes share. The
+ * socket then also carries their traffic, which they meter themselves,
+ * so quota is charged for the data of our own SFTP session instead.
+ */
+static int meter_channels = 0;
+
+/* Set once the engine has asked to abort the current transfer */
+static int abort_requested = 0;
+
 char* input_pushback = 0;
 
 #ifndef _WINDOWS
+#include <sys/select.h>
 #include <unistd.h>
 
 char *input_buf = 0;
 int input_buflen = 0, input_bufsize = 0;
 #endif
 
+#ifdef _WINDOWS
+/*
+ * Reads a single line from stdin, one byte at a time so that nothing
+ * past the line gets consumed. Returns the length or -1 on error.
+ */
+static int read_stdin_line(HANDLE hin, char *line, int size)
+{
+    int len = 0;
+    while (len < size - 1) {
+	DWORD read;
+	if (!ReadFile(hin, line + len, 1, &read, 0) || !read)
+	    return -1;
+	if (line[len++] == '\n')
+	    break;
+    }
+    line[len] = 0;
+    return len;
+}
+#endif
+
 static int ReadQuotas(int i)
 {
 #ifdef _WINDOWS
@@ -33,14 +67,11 @@ static int ReadQuotas(int i)
 
     while (bytesAvailable[i] == 0)
     {
-	DWORD read;
-	BOOL r;
-	char buffer[21];
+	char buffer[64];
 
-	r = ReadFile(hin, buffer, 20, &read, 0);
-	if (!r || read == 0)
+	/* Line by line, the engine may have sent several at once */
+	if (read_stdin_line(hin, buffer, sizeof(buffer)) < 0)
 	    fatalbox("ReadFile failed in ReadQuotas");
-	buffer[read] = 0;
 
 	if (buffer[0] != '-')
 	{
@@ -85,8 +116,11 @@ static int ReadQuotas(int i)
     return 1;
 }
 
-int RequestQuota(int i, int bytes)
+static int request_quota(int i, int bytes)
 {
+    if (quota_disabled)
+	return bytes;
+
     if (bytesAvailable[i] < -100)
 	bytesAvailable[i] = 0;
     else if (bytesAvailable[i] < 0)
@@ -110,9 +144,9 @@ int RequestQuota(int i, int bytes)
     return bytesAvailable[i];
 }
 
-void UpdateQuota(int i, int bytes)
+static void update_quota(int i, int bytes)
 {
-    if (bytesAvailable[i] < 0)
+    if (quota_disabled || bytesAvailable[i] < 0)
 	return;
 
     if (bytesAvailable[i] > bytes)
@@ -121,6 +155,37 @@ void UpdateQuota(int i, int bytes)
 	bytesAvailable[i] = 0;
 }
 
+int RequestQuota(int i, int bytes)
+{
+    if (meter_channels)
+	return bytes;
+
+    return request_quota(i, bytes);
+}
+
+void UpdateQuota(int i, int bytes)
+{
+    if (!meter_channels)
+	update_quota(i, bytes);
+}
+
+void fz_meter_channels(void)
+{
+    meter_channels = 1;
+}
+
+void fz_charge_channel_quota(int i, int bytes)
+{
+    if (!meter_channels)
+	return;
+
+    while (bytes > 0 && !quota_disabled) {
+	int granted = request_quota(i, bytes);
+	update_quota(i, granted);
+	bytes -= granted;
+    }
+}
+
 int ProcessQuotaCmd(const char* line)
 {
     int direction = 0, number, pos;
@@ -128,6 +193,15 @@ int ProcessQuotaCmd(const char* line)
     if (line[0] != '-')
 	return 0;
 
+    if (line[1] == 'u') {
+	fz_disable_quota();
+	return 0;
+    }
+    if (line[1] == 'a') {
+	abort_requested = 1;
+	return 0;
+    }
+
     if (line[1] == '0')
 	direction = 0;
     else if (line[1] == '1')
@@ -197,15 +271,57 @@ static void clear_input_buffers(int free)
     input_buflen = 0;
 }
 
+/*
+ * Removes the first complete line from the input buffer and returns
+ * it, including the trailing linebreak.
+ */
+static char* take_input_line(void)
+{
+    char *eol, *line;
+    int len;
+
+    if (!input_buflen)
+	return NULL;
+
+    eol = memchr(input_buf, '\n', input_buflen);
+    if (!eol)
+	return NULL;
+
+    len = eol - input_buf + 1;
+    line = snewn(len + 1, char);
+    memcpy(line, input_buf, len);
+    line[len] = 0;
+
+    input_buflen -= len;
+    memmove(input_buf, input_buf + len, input_buflen);
+
+    return line;
+}
+
+int has_buffered_input_line(void)
+{
+    return input_buflen && memchr(input_buf, '\n', input_buflen) != NULL;
+}
+
+/*
+ * Stdin is read in chunks rather than byte by byte. Since lines read
+ * ahead sit in our buffer rather than in the pipe, callers waiting for
+ * input need to check has_buffered_input_line() before select().
+ */
 char* read_input_line(int force, int* error)
 {
     int ret;
+    char* line;
     do {
-	if (input_buflen >= input_bufsize) {
-	    input_bufsize = input_buflen + 512;
+	line = take_input_line();
+	if (line)
+	    return line;
+
+	if (input_bufsize - input_buflen < 4096) {
+	    input_bufsize = input_buflen + 16384;
 	    input_buf = sresize(input_buf, input_bufsize, char);
 	}
-	ret = read(0, input_buf+input_buflen, 1);
+	ret = read(0, input_buf+input_buflen, input_bufsize - input_buflen);
 	if (ret < 0) {
 	    perror("read");
 	    *error = 1;
@@ -218,19 +334,112 @@ char* read_input_line(int force, int* error)
 	    clear_input_buffers(1);
 	    return NULL;
 	}
-
-	if (input_buf[input_buflen++] == '\n') {
-	    /* we have a full line */
-	    char* buf = input_buf;
-	    clear_input_buffers(0);
-	    return buf;
-	}
+	input_buflen += ret;
     } while(force);
 
-    return NULL;
+    return take_input_line();
 }
 #endif
 
+void fz_disable_quota(void)
+{
+    quota_disabled = 1;
+    bytesAvailable[0] = bytesAvailable[1] = -1;
+    limit[0] = limit[1] = -1;
+}
+
+/*
+ * Handles the control lines that have arrived on stdin without
+ * blocking. The first command line found is kept as pushback and
+ * ends the processing.
+ */
+static void poll_control_input(void)
+{
+#ifdef _WINDOWS
+    HANDLE hin = GetStdHandle(STD_INPUT_HANDLE);
+
+    while (!input_pushback) {
+	DWORD avail = 0;
+	char line[64];
+
+	if (!PeekNamedPipe(hin, NULL, 0, NULL, &avail, NULL)) {
+	    /* The engine is gone */
+	    abort_requested = 1;
+	    return;
+	}
+	if (!avail)
+	    return;
+
+	/* The engine writes whole lines, so this only blocks briefly */
+	if (read_stdin_line(hin, line, sizeof(line)) < 0) {
+	    abort_requested = 1;
+	    return;
+	}
+
+	if (line[0] == '-')
+	    ProcessQuotaCmd(line);
+	else
+	    input_pushback = dupstr(line);
+    }
+#else
+    while (!input_pushback) {
+	char *line;
+
+	if (!has_buffered_input_line()) {
+	    fd_set readfds;
+	    struct timeval tv = { 0, 0 };
+	    int ret;
+
+	    FD_ZERO(&readfds);
+	    FD_SET(0, &readfds);
+	    if (select(1, &readfds, NULL, NULL, &tv) <= 0)
+		return;
+
+	    if (input_bufsize - input_buflen < 4096) {
+		input_bufsize = input_buflen + 16384;
+		input_buf = sresize(input_buf, input_bufsize, char);
+	    }
+	    ret = read(0, input_buf + input_buflen, input_bufsize - input_buflen);
+	    if (ret <= 0) {
+		/* The engine is gone */
+		abort_requested = 1;
+		return;
+	    }
+	    input_buflen += ret;
+	}
+
+	line = take_input_line();
+	if (!line)
+	    continue;
+
+	if (line[0] == '-') {
+	    ProcessQuotaCmd(line);
+	    sfree(line);
+	}
+	else
+	    input_pushback = line;
+    }
+#endif
+}
+
+int fz_abort_requested(void)
+{
+    static unsigned long last = 0;
+    unsigned long now;
+
+    if (abort_requested)
+	return 1;
+
+    /* Polling stdin on every packet would be wasteful */
+    now = GETTICKCOUNT();
+    if (now - last < 100)
+	return 0;
+    last = now;
+
+    poll_control_input();
+    return abort_requested;
+}
+
 void fz_timer_init(_fztimer *timer)
 {
 #ifdef _WINDOWS
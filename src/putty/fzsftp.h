@@ -8,10 +8,33 @@ char* get_input_pushback(void);
 int has_input_pushback(void);
 #ifndef _WINDOWS
 char* read_input_line(int force, int* error);
+int has_buffered_input_line(void);
 #endif
 
 int CurrentSpeedLimit(int direction);
 
+/* Stops requesting quota, all traffic is unlimited from then on */
+void fz_disable_quota(void);
+
+/*
+ * Charges quota for the data of our own SFTP session instead of the
+ * socket traffic, for use by the process other processes share their
+ * connection with.
+ */
+void fz_meter_channels(void);
+
+/*
+ * Waits until the given number of bytes of our own SFTP session may be
+ * transferred. Does nothing unless fz_meter_channels has been called.
+ */
+void fz_charge_channel_quota(int i, int bytes);
+
+/*
+ * Whether the engine wants the current transfer to be aborted. Checks
+ * stdin for control lines, but at most every 100 milliseconds.
+ */
+int fz_abort_requested(void);
+
 #ifdef _WINDOWS
 #include <windows.h>
 typedef FILETIME _fztimer;
@@ -261,6 +261,7 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
     struct fxp_xfer *xfer;
     uint64 offset;
     WFile *file;
+    WFileWriter *writer;
     int ret, shown_err = FALSE;
     struct fxp_attrs attrs;
     _fztimer timer;
@@ -489,8 +490,23 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
      * FIXME: we can use FXP_FSTAT here to get the file size, and
      * thus put up a progress bar.
      */
+    /*
+     * Disk writes happen on a separate thread where possible, so they
+     * overlap with receiving and decrypting data. Files smaller than
+     * one buffer gain nothing from it. If the thread cannot be started,
+     * write synchronously.
+     */
+    writer = NULL;
+    if (file && (!(attrs.flags & SSH_FILEXFER_ATTR_SIZE) ||
+                 uint64_compare(attrs.size, uint64_add32(offset, WFILE_WRITER_BUFFERSIZE)) > 0))
+        writer = wfile_writer_get();
+    if (writer)
+        wfile_writer_begin(writer, file);
+
     ret = 1;
     xfer = xfer_download_init(fh, offset);
+    if (attrs.flags & SSH_FILEXFER_ATTR_SIZE)
+	xfer_download_set_size(xfer, attrs.size);
     while (!xfer_done(xfer)) {
 	void *vbuf;
 	int len;
@@ -513,7 +529,18 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 	    unsigned char *buf = (unsigned char *)vbuf;
 
 	    wpos = 0;
-	    while (file && wpos < len) {
+	    if (writer) {
+		if (wfile_writer_write(writer, buf, len) < 0) {
+		    if (!shown_err) {
+			fzprintf(sftpError, "error while writing local file");
+			shown_err = TRUE;
+		    }
+		    ret = 0;
+		} else {
+		    wpos = len;
+		}
+	    }
+	    while (!writer && file && wpos < len) {
 		wlen = write_to_file(file, buf + wpos, len - wpos);
 		if (wlen <= 0) {
 		    if (!shown_err) {
@@ -538,10 +565,27 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 	    winterval = 0;
 	}
 
+	/* Stop requesting data, the loop ends once the outstanding replies are in */
+	if (fz_abort_requested() && !xfer_done(xfer)) {
+	    if (!shown_err) {
+		fzprintf(sftpError, "transfer aborted");
+		shown_err = TRUE;
+	    }
+	    ret = 0;
+	    xfer_set_error(xfer);
+	}
     }
 
     xfer_cleanup(xfer);
 
+    if (writer && wfile_writer_end(writer) < 0) {
+	if (!shown_err) {
+	    fzprintf(sftpError, "error while writing local file");
+	    shown_err = TRUE;
+	}
+	ret = 0;
+    }
+
     close_wfile(file);
 
     req = fxp_close_send(fh);
@@ -564,6 +608,8 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
     int err = 0, eof;
     struct fxp_attrs attrs;
     long permissions;
+    char *buffer;
+    int blocksize;
 
     /*
      * In recursive mode, see if we're dealing with a directory.
@@ -746,13 +792,14 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
      * thus put up a progress bar.
      */
     xfer = xfer_upload_init(fh, offset);
+    blocksize = xfer_upload_blocksize();
+    buffer = snewn(blocksize, char);
     eof = 0;
     while ((!err && !eof) || !xfer_done(xfer)) {
-	char buffer[4096*4];
 	int len, ret;
 
 	while (xfer_upload_ready(xfer) && !err && !eof) {
-	    len = read_from_file(file, buffer, sizeof(buffer));
+	    len = read_from_file(file, buffer, blocksize);
 	    if (len == -1) {
 		fzprintf(sftpError, "error while reading local file");
 		err = 1;
@@ -765,6 +812,11 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
 	    }
 	}
 
+	if (!err && fz_abort_requested()) {
+	    fzprintf(sftpError, "transfer aborted");
+	    err = 1;
+	}
+
 	if (!xfer_done(xfer)) {
 	    pktin = sftp_recv();
 	    ret = xfer_upload_gotpkt(xfer, pktin);
@@ -780,6 +832,7 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
     }
 
     xfer_cleanup(xfer);
+    sfree(buffer);
 
   cleanup:
     req = fxp_close_send(fh);
@@ -1049,6 +1102,79 @@ int sftp_cmd_keyfile(struct sftp_command *cmd)
     return 1;
 }
 
+/*
+ * Takes the window and the request size for transfers in KiB, 0 for
+ * the defaults.
+ */
+int sftp_cmd_xfersettings(struct sftp_command *cmd)
+{
+    int window, blocksize;
+
+    if (cmd->nwords != 3) {
+	fzprintf(sftpError, "xfersettings: expects a window and a block size");
+	return 0;
+    }
+
+    window = atoi(cmd->words[1]);
+    blocksize = atoi(cmd->words[2]);
+    if (window < 0 || window > 1024*1024 || blocksize < 0 || blocksize > 1024*1024) {
+	fzprintf(sftpError, "xfersettings: invalid arguments");
+	return 0;
+    }
+
+    xfer_set_limits(window * 1024, blocksize * 1024);
+
+    fznotify1(sftpDone, 1);
+    return 1;
+}
+
+int sftp_cmd_share(struct sftp_command *cmd)
+{
+    if (back != NULL) {
+	fzprintf(sftpError, "share: already connected");
+	return 0;
+    }
+
+    if (cmd->nwords != 2 || !*cmd->words[1]) {
+	fzprintf(sftpError, "share: expects a group name");
+	return 0;
+    }
+
+    conf_set_int(conf, CONF_ssh_connection_sharing, TRUE);
+    conf_set_str(conf, CONF_fz_share_group, cmd->words[1]);
+
+    fznotify1(sftpDone, 1);
+    return 1;
+}
+
+int sftp_cmd_compression(struct sftp_command *cmd)
+{
+    int level;
+
+    if (back != NULL) {
+	fzprintf(sftpError, "compression: already connected");
+	return 0;
+    }
+
+    if (cmd->nwords != 2) {
+	fzprintf(sftpError, "compression: expects a compression level");
+	return 0;
+    }
+
+    level = atoi(cmd->words[1]);
+    if (level < 0 || level > 9) {
+	fzprintf(sftpError, "compression: level must be between 0 and 9");
+	return 0;
+    }
+
+    conf_set_int(conf, CONF_compression, level > 0);
+    if (level > 0)
+	zlib_set_compression_level(level);
+
+    fznotify1(sftpDone, 1);
+    return 1;
+}
+
 int sftp_cmd_proxy(struct sftp_command *cmd)
 {
     int proxy_type;
@@ -1218,13 +1344,29 @@ int sftp_cmd_ls(struct sftp_command *cmd)
 
 	    for (i = 0; i < names->nnames; i++) {
 		if (!wildcard || wc_match(wildcard, names->names[i].filename)) {
+		    struct fxp_attrs *attrs = &names->names[i].attrs;
 		    unsigned long mtime = 0;
+		    unsigned long permissions = 0, uid = 0, gid = 0;
+		    char sizebuf[40] = "0";
+
 		    if (names->names[i].attrs.flags & SSH_FILEXFER_ATTR_ACMODTIME) {
 			mtime = names->names[i].attrs.mtime;
 		    }
+		    /* Fields without their flag are undefined, send 0 instead */
+		    if (attrs->flags & SSH_FILEXFER_ATTR_SIZE)
+			uint64_decimal(attrs->size, sizebuf);
+		    if (attrs->flags & SSH_FILEXFER_ATTR_PERMISSIONS)
+			permissions = attrs->permissions;
+		    if (attrs->flags & SSH_FILEXFER_ATTR_UIDGID) {
+			uid = attrs->uid;
+			gid = attrs->gid;
+		    }
 		    fzprintf_raw_untrusted(sftpListentry, "%s", names->names[i].longname);
 		    fzprintf_raw_untrusted(sftpUnknown, "%lu", mtime);
 		    fzprintf_raw_untrusted(sftpUnknown, "%s", names->names[i].filename);
+		    /* Decoded attributes, spares the engine parsing the longname */
+		    fzprintf_raw_untrusted(sftpUnknown, "%lu %s %lu %lu %lu", attrs->flags,
+					   sizebuf, permissions, uid, gid);
 		}
 	    }
 
@@ -1682,6 +1824,163 @@ int sftp_cmd_rm(struct sftp_command *cmd)
     return ret;
 }
 
+/*
+ * Bulk operations on many entries of a single directory. In contrast
+ * to the commands above, the names are not subject to wildcard
+ * expansion and the parent directory only needs to be canonified
+ * once. Up to SFTP_BATCH_WINDOW requests are kept outstanding at a
+ * time, so the number of round trips no longer grows with the number
+ * of entries.
+ *
+ * Each entry gets its own result, reported in the order the entries
+ * were given: an sftpReply on success, or an sftpError followed by a
+ * failed sftpDone.
+ */
+#define SFTP_BATCH_WINDOW 32
+
+struct sftp_batch_item {
+    char *fname;
+    char *error;
+    int done;
+    int result;
+};
+
+struct sftp_batch_ops {
+    const char *verb;
+    struct sftp_request *(*send)(void *ctx, const char *fname);
+    int (*recv)(void *ctx, struct sftp_packet *pktin, struct sftp_request *req);
+};
+
+static int sftp_batch_iterate(const struct sftp_batch_ops *ops, void *ctx,
+			      const char *dir, char **names, int count)
+{
+    struct sftp_batch_item *items, *item;
+    struct sftp_packet *pktin;
+    struct sftp_request *req, *rreq;
+    char *cdir;
+    const char *slash;
+    int sent, reported, outstanding, i, ret;
+
+    cdir = canonify(dir, 0);
+    if (!cdir) {
+	fzprintf(sftpError, "%s: canonify: %s", dir, fxp_error());
+	for (i = 0; i < count; i++)
+	    fznotify1(sftpDone, 0);
+	return 0;
+    }
+    slash = (*cdir && cdir[strlen(cdir) - 1] == '/') ? "" : "/";
+
+    items = snewn(count, struct sftp_batch_item);
+    for (i = 0; i < count; i++) {
+	items[i].fname = dupcat(cdir, slash, names[i], NULL);
+	items[i].error = NULL;
+	items[i].done = FALSE;
+	items[i].result = 0;
+    }
+    sfree(cdir);
+
+    ret = 1;
+    sent = reported = outstanding = 0;
+    while (reported < count) {
+	while (sent < count && outstanding < SFTP_BATCH_WINDOW) {
+	    req = ops->send(ctx, items[sent].fname);
+	    fxp_set_userdata(req, &items[sent]);
+	    sftp_register(req);
+	    sent++;
+	    outstanding++;
+	}
+
+	pktin = sftp_recv();
+	if (pktin == NULL)
+	    connection_fatal(NULL, "did not receive SFTP response packet "
+			     "from server");
+	rreq = sftp_find_request(pktin);
+	item = rreq ? (struct sftp_batch_item *)fxp_get_userdata(rreq) : NULL;
+	if (!item || item->done)
+	    connection_fatal(NULL, "unable to understand SFTP response packet "
+			     "from server: %s", fxp_error());
+
+	item->result = ops->recv(ctx, pktin, rreq);
+	if (!item->result)
+	    item->error = dupstr(fxp_error());
+	item->done = TRUE;
+	outstanding--;
+
+	/* Servers may reply out of order, keep the output in order */
+	while (reported < count && items[reported].done) {
+	    item = &items[reported++];
+	    if (item->result)
+		fzprintf(sftpReply, "%s %s: OK", ops->verb, item->fname);
+	    else {
+		fzprintf(sftpError, "%s %s: %s", ops->verb, item->fname, item->error);
+		fznotify1(sftpDone, 0);
+		ret = 0;
+	    }
+	}
+    }
+
+    for (i = 0; i < count; i++) {
+	sfree(items[i].fname);
+	sfree(items[i].error);
+    }
+    sfree(items);
+
+    return ret;
+}
+
+/*
+ * Checks the arguments of a bulk command. Returns the number of
+ * entries, or 0 after having reported an error.
+ *
+ * The engine expects one result per entry. On error, a failed
+ * sftpDone is sent for all entries but the last one, the caller
+ * returning 0 accounts for that.
+ */
+static int sftp_batch_check(struct sftp_command *cmd, int first, const char *usage)
+{
+    int count = cmd->nwords - first - 1;
+
+    if (back == NULL)
+	not_connected();
+    else if (count < 1)
+	fzprintf(sftpError, "%s: expects %s", cmd->words[0], usage);
+    else
+	return count;
+
+    while (count-- > 1)
+	fznotify1(sftpDone, 0);
+
+    return 0;
+}
+
+static struct sftp_request *sftp_batch_rm_send(void *ctx, const char *fname)
+{
+    return fxp_remove_send(fname);
+}
+
+static int sftp_batch_rm_recv(void *ctx, struct sftp_packet *pktin, struct sftp_request *req)
+{
+    return fxp_remove_recv(pktin, req);
+}
+
+static const struct sftp_batch_ops sftp_batch_rm = {
+    "rm", sftp_batch_rm_send, sftp_batch_rm_recv
+};
+
+int sftp_cmd_rmmany(struct sftp_command *cmd)
+{
+    int count;
+
+    count = sftp_batch_check(cmd, 1, "a directory and one or more filenames");
+    if (!count)
+	return 0;
+
+    sftp_batch_iterate(&sftp_batch_rm, NULL, cmd->words[1], cmd->words + 2, count);
+
+    /* Failures have already been reported per file */
+    return 1;
+}
+
 static int check_is_dir(char *dstfname)
 {
     struct sftp_packet *pktin;
@@ -2292,6 +2591,13 @@ static struct sftp_cmd_lookup {
 	    "  session, to the same server or to a different one.\n",
 	    sftp_cmd_close
     },
+    {
+	"compression", TRUE, "set compression level",
+	    " <level>\n"
+	    "  Sets the zlib compression level from 1 (fastest) to 9 (best)\n"
+	    "  to use for the next connection. 0 disables compression.\n",
+	    sftp_cmd_compression
+    },
     {
 	"del", TRUE, "delete files on the remote server",
 	    " <filename-or-wildcard> [ <filename-or-wildcard>... ]\n"
@@ -2470,6 +2776,31 @@ END FZ UNUSED */
 	    "  The directory will not be removed unless it is empty.\n"
 	    "  Wildcards may be used to specify multiple directories.\n",
 	    sftp_cmd_rmdir
+    },
+    {
+	"rmmany", TRUE, "delete many files at once",
+	    " <directory> <filename> [ <filename>... ]\n"
+	    "  Delete the named files in the given directory from the server.\n"
+	    "  Wildcards are not supported.\n",
+	    sftp_cmd_rmmany
+    },
+    {
+	"share", TRUE, "share the SSH connection with other instances",
+	    " <group>\n"
+	    "  Run the SFTP session as a channel of an existing SSH connection\n"
+	    "  to the same server, or let later sessions join this one. Only\n"
+	    "  instances using the same group share a connection. Must be\n"
+	    "  given before connecting.\n",
+	    sftp_cmd_share
+    },
+    {
+	"xfersettings", TRUE, "set transfer window and request size",
+	    " <window> <block size>\n"
+	    "  Sets the amount of data in flight and the size of each read or\n"
+	    "  write request in KiB. Use 0 for automatic window sizing and\n"
+	    "  the default request size. Request sizes above 255 KiB are\n"
+	    "  reduced to 255 KiB.\n",
+	    sftp_cmd_xfersettings
     }
 };
 
@@ -2566,6 +2897,13 @@ struct sftp_command *sftp_getcmd(FILE *fp, int mode, int modeflags)
 	line = fgetline(fp);
     } else {
 	line = ssh_sftp_get_cmdline("psftp> ", back == NULL);
+
+	/* FZ: Control lines from the engine may also arrive between commands */
+	while (line && line[0] == '-') {
+	    ProcessQuotaCmd(line);
+	    sfree(line);
+	    line = ssh_sftp_get_cmdline("psftp> ", back == NULL);
+	}
     }
 
     if (!line || !*line) {
@@ -2937,6 +3275,8 @@ int from_backend_eof(void *frontend)
 }
 int sftp_recvdata(char *buf, int len)
 {
+    fz_charge_channel_quota(0, len);
+
     outptr = (unsigned char *) buf;
     outlen = len;
 
@@ -2971,6 +3311,7 @@ int sftp_recvdata(char *buf, int len)
 }
 int sftp_senddata(char *buf, int len)
 {
+    fz_charge_channel_quota(1, len);
     back->send(backhandle, buf, len);
     return 1;
 }
@@ -3331,8 +3672,9 @@ int psftp_init_utf8_locale()
 }
 #endif
 
-const int share_can_be_downstream = FALSE; // FZ: We're standalone
-const int share_can_be_upstream = FALSE;
+// FZ: Sharing is off unless enabled through the share command
+const int share_can_be_downstream = TRUE;
+const int share_can_be_upstream = TRUE;
 
 /*
  * Main program. Parse arguments etc.
@@ -3372,6 +3714,10 @@ int psftp_main(int argc, char *argv[])
     // FZ: Set proxy to none
     conf_set_int(conf, CONF_proxy_type, PROXY_NONE);
 
+    // FZ: Not sharing the connection until told otherwise
+    conf_set_int(conf, CONF_ssh_connection_sharing, FALSE);
+    conf_set_str(conf, CONF_fz_share_group, "");
+
     // FZ: Re-order ciphers so that old and insecure algorithms are always below the warning level
     {
 	// Find position of warning level
@@ -112,6 +112,29 @@ enum { FROM_START, FROM_CURRENT, FROM_END };
 int seek_file(WFile *f, uint64 offset, int whence);
 /* Get file position */
 uint64 get_file_posn(WFile *f);
+
+/*
+ * Asynchronous writing of downloaded files. Data is collected in a
+ * ring of large buffers, which a background thread writes to the
+ * WFile while the next packets are received and decrypted. There is
+ * at most one writer per process; its thread and buffers are reused
+ * for every download. The writer does not own the WFile, end the
+ * file before closing it.
+ */
+#define WFILE_WRITER_BUFFERS 4
+#define WFILE_WRITER_BUFFERSIZE (256 * 1024)
+typedef struct WFileWriter WFileWriter;
+/* Returns the writer, starting its thread on first use. Returns NULL
+ * if the thread could not be started. */
+WFileWriter *wfile_writer_get(void);
+/* Starts writing to the given file */
+void wfile_writer_begin(WFileWriter *w, WFile *f);
+/* Returns <0 if this or an earlier write failed, else length. May block
+ * until the writer thread has caught up. */
+int wfile_writer_write(WFileWriter *w, const void *buffer, int length);
+/* Writes out everything pending for the current file. Returns <0 if
+ * any write to it failed, 0 otherwise. */
+int wfile_writer_end(WFileWriter *w);
 /*
  * Determine the type of a file: nonexistent, file, directory or
  * weird. `weird' covers anything else - named pipes, Unix sockets,
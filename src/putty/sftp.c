@@ -14,8 +14,7 @@
 #include "ssh.h"
 #include "sftp.h"
 
-#include "fzprintf.h"
-#include "fzsftp.h"
+#include "putty.h"
 
 struct sftp_packet {
     char *data;
@@ -1153,18 +1152,78 @@ struct req {
     char *buffer;
     int len, retlen, complete;
     uint64 offset;
+    unsigned long sent;
     struct req *next, *prev;
 };
 
 struct fxp_xfer {
-    uint64 offset, furthestdata, filesize;
+    uint64 offset;
+    uint64 furthestdata;	       /* end of the furthest data received */
+    uint64 filesize;		       /* smallest offset reported as EOF */
+    uint64 knownsize;		       /* size from the stat before opening */
+    int sizeknown;
     int req_totalsize, req_maxsize, eof, err;
     struct fxp_handle *fh;
     struct req *head, *tail;
     _fztimer send_timer;
     int sent_interval;
+    int growing;
+    unsigned long min_rtt;
 };
 
+/*
+ * The window is the amount of data in outstanding read or write
+ * requests. Unless configured otherwise, it starts out at
+ * XFER_WINDOW_INITIAL and is grown similar to TCP slow start: each
+ * reply to a request sent while the window was full enlarges the
+ * window by the size of that request, doubling it every round trip.
+ * Growth stops once round trip times start to rise, meaning the
+ * window exceeds what the path can deliver and further requests
+ * would only queue up.
+ */
+#define XFER_WINDOW_INITIAL (1024*1024*4)
+#define XFER_WINDOW_MAX (1024*1024*64)
+
+#define XFER_READ_SIZE 32768
+#define XFER_WRITE_SIZE 16384
+/*
+ * OpenSSH drops the connection on packets larger than 256 KiB and
+ * returns at most 255 KiB per read. A WRITE of 255 KiB including its
+ * header stays well below the packet limit even with the longest
+ * possible handle.
+ */
+#define XFER_BLOCK_MAX (1024*255)
+
+static int xfer_window = 0;	       /* 0 = automatic */
+static int xfer_blocksize = 0;	       /* 0 = default */
+
+void xfer_set_limits(int window, int blocksize)
+{
+    if (window < 0)
+	window = 0;
+    else if (window > 0 && window < XFER_READ_SIZE)
+	window = XFER_READ_SIZE;
+    xfer_window = window;
+
+    if (blocksize < 0)
+	blocksize = 0;
+    else if (blocksize > XFER_BLOCK_MAX)
+	blocksize = XFER_BLOCK_MAX;
+    else if (blocksize > 0 && blocksize < 4096)
+	blocksize = 4096;
+    xfer_blocksize = blocksize;
+}
+
+int xfer_upload_blocksize(void)
+{
+    return xfer_blocksize ? xfer_blocksize : XFER_WRITE_SIZE;
+}
+
+static int xfer_download_blocksize(void)
+{
+    return xfer_blocksize ? xfer_blocksize : XFER_READ_SIZE;
+}
+
 static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64 offset)
 {
     struct fxp_xfer *xfer = snew(struct fxp_xfer);
@@ -1173,16 +1232,55 @@ static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64 offset)
     xfer->offset = offset;
     xfer->head = xfer->tail = NULL;
     xfer->req_totalsize = 0;
-    xfer->req_maxsize = 1048576*4;
+    xfer->req_maxsize = xfer_window ? xfer_window : XFER_WINDOW_INITIAL;
     xfer->err = 0;
     xfer->filesize = uint64_make(ULONG_MAX, ULONG_MAX);
     xfer->furthestdata = uint64_make(0, 0);
+    xfer->knownsize = uint64_make(0, 0);
+    xfer->sizeknown = FALSE;
     fz_timer_init(&xfer->send_timer);
     xfer->sent_interval = 0;
+    xfer->growing = !xfer_window;
+    xfer->min_rtt = ULONG_MAX;
 
     return xfer;
 }
 
+/*
+ * Called for each reply to a request, before the request is
+ * removed from the window.
+ */
+static void xfer_update_window(struct fxp_xfer *xfer, struct req *rr)
+{
+    unsigned long rtt;
+
+    if (!xfer->growing)
+	return;
+
+    rtt = GETTICKCOUNT() - rr->sent;
+    if (rtt < xfer->min_rtt)
+	xfer->min_rtt = rtt;
+
+    /*
+     * Allow for some jitter, in particular on low latency links where
+     * the tick resolution is too coarse to measure much at all.
+     */
+    if (rtt > xfer->min_rtt + xfer->min_rtt / 4 + TICKSPERSEC / 50) {
+	xfer->growing = 0;
+	return;
+    }
+
+    /* Only grow if the window is what limited us */
+    if (xfer->req_totalsize + rr->len < xfer->req_maxsize)
+	return;
+
+    xfer->req_maxsize += rr->len;
+    if (xfer->req_maxsize >= XFER_WINDOW_MAX) {
+	xfer->req_maxsize = XFER_WINDOW_MAX;
+	xfer->growing = 0;
+    }
+}
+
 int xfer_done(struct fxp_xfer *xfer)
 {
     /*
@@ -1215,8 +1313,9 @@ void xfer_download_queue(struct fxp_xfer *xfer)
 	xfer->tail = rr;
 	rr->next = NULL;
 
-	rr->len = 32768;
+	rr->len = xfer_download_blocksize();
 	rr->buffer = snewn(rr->len, char);
+	rr->sent = GETTICKCOUNT();
 	sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
 	fxp_set_userdata(req, rr);
 
@@ -1229,6 +1328,36 @@ void xfer_download_queue(struct fxp_xfer *xfer)
     }
 }
 
+/*
+ * Requests the given range and puts it into the queue directly after
+ * prev, so that it gets handed out in file order.
+ */
+static void xfer_download_queue_after(struct fxp_xfer *xfer, struct req *prev,
+				      uint64 offset, int len)
+{
+    struct req *rr;
+    struct sftp_request *req;
+
+    rr = snew(struct req);
+    rr->offset = offset;
+    rr->complete = 0;
+    rr->prev = prev;
+    rr->next = prev->next;
+    if (prev->next)
+	prev->next->prev = rr;
+    else
+	xfer->tail = rr;
+    prev->next = rr;
+
+    rr->len = len;
+    rr->buffer = snewn(rr->len, char);
+    rr->sent = GETTICKCOUNT();
+    sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
+    fxp_set_userdata(req, rr);
+
+    xfer->req_totalsize += rr->len;
+}
+
 struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64 offset)
 {
     struct fxp_xfer *xfer = xfer_init(fh, offset);
@@ -1239,6 +1368,16 @@ struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64 offset)
     return xfer;
 }
 
+/*
+ * The size of the file as far as known before the transfer. A short
+ * block reaching it is taken as the end of the file.
+ */
+void xfer_download_set_size(struct fxp_xfer *xfer, uint64 size)
+{
+    xfer->knownsize = size;
+    xfer->sizeknown = TRUE;
+}
+
 /*
  * Returns INT_MIN to indicate that it didn't even get as far as
  * fxp_read_recv and hence has not freed pktin.
@@ -1257,6 +1396,7 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 	return INT_MIN;		       /* this packet isn't ours */
     }
     rr->retlen = fxp_read_recv(pktin, rreq, rr->buffer, rr->len);
+    xfer_update_window(xfer, rr);
 #ifdef DEBUG_DOWNLOAD
     printf("read request %p has returned [%d]\n", rr, rr->retlen);
 #endif
@@ -1265,6 +1405,8 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 	xfer->eof = TRUE;
         rr->retlen = 0;
 	rr->complete = -1;
+	if (uint64_compare(xfer->filesize, rr->offset) > 0)
+	    xfer->filesize = rr->offset;
 #ifdef DEBUG_DOWNLOAD
 	printf("setting eof\n");
 #endif
@@ -1273,51 +1415,41 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 	xfer_set_error(xfer);
 	rr->complete = -1;
 	return -1;
-    }
-
-    rr->complete = 1;
-
-    /*
-     * Special case: if we have received fewer bytes than we
-     * actually read, we should do something. For the moment I'll
-     * just throw an ersatz FXP error to signal this; the SFTP
-     * draft I've got says that it can't happen except on special
-     * files, in which case seeking probably has very little
-     * meaning and so queueing an additional read request to fill
-     * up the gap sounds like the wrong answer. I'm not sure what I
-     * should be doing here - if it _was_ a special file, I suspect
-     * I simply shouldn't have been queueing multiple requests in
-     * the first place...
-     */
-    if (rr->retlen > 0 && uint64_compare(xfer->furthestdata, rr->offset) < 0) {
-	xfer->furthestdata = rr->offset;
-#ifdef DEBUG_DOWNLOAD
-	{ char buf[40];
-	uint64_decimal(xfer->furthestdata, buf);
-	printf("setting furthestdata = %s\n", buf); }
-#endif
-    }
+    } else {
+	uint64 end = uint64_add32(rr->offset, rr->retlen);
+	rr->complete = 1;
+	if (uint64_compare(xfer->furthestdata, end) < 0)
+	    xfer->furthestdata = end;
 
-    if (rr->retlen < rr->len) {
-	uint64 filesize = uint64_add32(rr->offset,
-				       (rr->retlen < 0 ? 0 : rr->retlen));
-#ifdef DEBUG_DOWNLOAD
-	{ char buf[40];
-	uint64_decimal(filesize, buf);
-	printf("short block! trying filesize = %s\n", buf); }
-#endif
-	if (uint64_compare(xfer->filesize, filesize) > 0) {
-	    xfer->filesize = filesize;
-#ifdef DEBUG_DOWNLOAD
-	    printf("actually changing filesize\n");
-#endif	    
+	/*
+	 * Servers may return less than requested even if not at EOF,
+	 * e.g. OpenSSH caps reads at 255 KiB. Request the rest right
+	 * away, it is handed out in order after this block. Should it
+	 * be at EOF after all, its reply tells us so.
+	 *
+	 * The final block of a file is short as well. Don't spend a
+	 * round trip on it if it reaches the known size or an offset
+	 * already reported as EOF. Should the file have grown, data
+	 * past this block then fails the check below.
+	 */
+	if (rr->retlen < rr->len && !xfer->err) {
+	    if ((xfer->sizeknown && uint64_compare(end, xfer->knownsize) >= 0) ||
+		uint64_compare(end, xfer->filesize) >= 0) {
+		if (uint64_compare(xfer->filesize, end) > 0)
+		    xfer->filesize = end;
+	    } else
+		xfer_download_queue_after(xfer, rr, end, rr->len - rr->retlen);
 	}
     }
 
+    /*
+     * Data past a reported EOF means the file has changed while we
+     * were reading it. The blocks cannot be joined up anymore.
+     */
     if (uint64_compare(xfer->furthestdata, xfer->filesize) > 0) {
 	sfree(fxp_error_message);
-	fxp_error_message = dupstr("received a short buffer from FXP_READ, but not"
-	    " at EOF");
+	fxp_error_message = dupstr("received data past EOF, the file has"
+	    " been modified during the transfer");
 	fxp_errtype = -1;
 	xfer_set_error(xfer);
 	return -1;
@@ -1391,6 +1523,8 @@ struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64 offset)
 
 int xfer_upload_ready(struct fxp_xfer *xfer)
 {
+    if (xfer->req_totalsize >= xfer->req_maxsize)
+	return 0;
     if (sftp_sendbuffer() == 0)
 	return 1;
     else
@@ -1417,6 +1551,7 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
 
     rr->len = len;
     rr->buffer = NULL;
+    rr->sent = GETTICKCOUNT();
     sftp_register(req = fxp_write_send(xfer->fh, buffer, rr->offset, len));
     fxp_set_userdata(req, rr);
 
@@ -1447,6 +1582,7 @@ int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 	return INT_MIN;		       /* this packet isn't ours */
     }
     ret = fxp_write_recv(pktin, rreq);
+    xfer_update_window(xfer, rr);
 #ifdef DEBUG_UPLOAD
     printf("write request %p has returned [%d]\n", rr, ret);
 #endif
@@ -254,7 +254,16 @@ struct sftp_packet *sftp_recv(void);
 
 struct fxp_xfer;
 
+/*
+ * Limits for transfers started afterwards. A window of 0 lets the
+ * window be sized automatically, a block size of 0 uses the default
+ * request sizes.
+ */
+void xfer_set_limits(int window, int blocksize);
+int xfer_upload_blocksize(void);
+
 struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64 offset);
+void xfer_download_set_size(struct fxp_xfer *xfer, uint64 size);
 void xfer_download_queue(struct fxp_xfer *xfer);
 int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 int xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len);
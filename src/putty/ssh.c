@@ -396,6 +396,11 @@ static void ssh2_msg_something_unimplemented(Ssh ssh, struct Packet *pktin);
  *  - OUR_V2_WINSIZE is the default window size we present on SSH-2
  *    channels.
  *
+ *  - OUR_V2_SHARED_WINSIZE is the initial window size of channels
+ *    in a shared connection (FZ). Each SFTP session of a shared
+ *    connection has a channel of its own, so they need about as much
+ *    data in flight as a simple connection would have.
+ *
  *  - OUR_V2_BIGWIN is the window size we advertise for the only
  *    channel in a simple connection.  It must be <= INT_MAX.
  *
@@ -413,6 +418,7 @@ static void ssh2_msg_something_unimplemented(Ssh ssh, struct Packet *pktin);
 #define SSH1_BUFFER_LIMIT 32768
 #define SSH_MAX_BACKLOG 32768
 #define OUR_V2_WINSIZE 16384
+#define OUR_V2_SHARED_WINSIZE 0x200000
 #define OUR_V2_BIGWIN 0x7fffffff
 #define OUR_V2_MAXPKT 0x4000UL
 #define OUR_V2_PACKETLIMIT 0x9000UL
@@ -3893,6 +3899,15 @@ static const char *connect_to_host(Ssh ssh, const char *host, int port,
          */
         ssh->do_ssh_init = do_ssh_init;
 
+        /*
+         * FZ: As upstream, our socket carries the traffic of all
+         * downstreams. Each of them applies its own speed limit
+         * on its connection to us, so only the data of our own
+         * session is charged against ours.
+         */
+        if (ssh->connshare)
+            fz_meter_channels();
+
         /*
          * Try to find host.
          */
@@ -8045,6 +8060,20 @@ static int ssh_is_simple(Ssh ssh)
             !ssh->bare_connection && !ssh->connshare);
 }
 
+/*
+ * Initial window for a new channel. FZ: Channels of a shared
+ * connection, both upstream and downstream, get a window large enough
+ * for bulk transfers, each channel sized independently of the others.
+ */
+static int ssh_initial_window(Ssh ssh)
+{
+    if (ssh_is_simple(ssh))
+        return OUR_V2_BIGWIN;
+    if (ssh->connshare || ssh->bare_connection)
+        return OUR_V2_SHARED_WINSIZE;
+    return OUR_V2_WINSIZE;
+}
+
 /*
  * Set up most of a new ssh_channel.
  */
@@ -8057,7 +8086,7 @@ static void ssh_channel_init(struct ssh_channel *c)
     c->throttling_conn = FALSE;
     if (ssh->version == 2) {
 	c->v.v2.locwindow = c->v.v2.locmaxwin = c->v.v2.remlocwin =
-	    ssh_is_simple(ssh) ? OUR_V2_BIGWIN : OUR_V2_WINSIZE;
+	    ssh_initial_window(ssh);
 	c->v.v2.chanreq_head = NULL;
 	c->v.v2.throttle_state = UNTHROTTLED;
 	bufchain_init(&c->v.v2.outbuffer);
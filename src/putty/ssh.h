@@ -815,6 +815,7 @@ void invent_firstbits(unsigned *one, unsigned *two);
  * zlib compression.
  */
 void *zlib_compress_init(void);
+void zlib_set_compression_level(int level);
 void zlib_compress_cleanup(void *);
 void *zlib_decompress_init(void);
 void zlib_decompress_cleanup(void *);
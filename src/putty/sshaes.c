@@ -8,8 +8,9 @@
 #include "ssh.h"
 
 #include <nettle/aes.h>
+#include <nettle/cbc.h>
+#include <nettle/ctr.h>
 #include <nettle/gcm.h>
-#include <nettle/memxor.h>
 
 typedef struct AESContext AESContext;
 
@@ -19,33 +20,25 @@ struct AESContext {
     uint8_t iv[16];
 };
 
+/*
+ * Whole packets are passed to Nettle at once rather than block by
+ * block, letting it process several blocks in parallel where the
+ * hardware supports it.
+ */
 static void aes_encrypt_cbc(unsigned char *blk, int len, AESContext * ctx)
 {
     assert((len & 15) == 0);
 
-    while (len > 0) {
-	memxor(blk, ctx->iv, 16);
-	aes_encrypt(&ctx->enc_ctx, 16, ctx->iv, blk);
-	memcpy(blk, ctx->iv, 16);
-	blk += 16;
-	len -= 16;
-    }
+    cbc_encrypt(&ctx->enc_ctx, (nettle_cipher_func *)aes_encrypt, 16,
+		ctx->iv, len, blk, blk);
 }
 
 static void aes_decrypt_cbc(unsigned char *blk, int len, AESContext * ctx)
 {
-    uint8_t x[16];
-
     assert((len & 15) == 0);
 
-    while (len > 0) {
-	aes_decrypt(&ctx->dec_ctx, 16, x, blk);
-	memxor(x, ctx->iv, 16);
-	memcpy(ctx->iv, blk, 16);
-	memcpy(blk, x, 16);
-	blk += 16;
-	len -= 16;
-    }
+    cbc_decrypt(&ctx->dec_ctx, (nettle_cipher_func *)aes_decrypt, 16,
+		ctx->iv, len, blk, blk);
 }
 
 static void increment_iv_step32(uint8_t *iv, int i)
@@ -62,17 +55,11 @@ static void increment_iv_step32(uint8_t *iv, int i)
 
 static void aes_sdctr(unsigned char *blk, int len, AESContext *ctx)
 {
-    uint8_t b[16];
-
     assert((len & 15) == 0);
 
-    while (len > 0) {
-	aes_encrypt(&ctx->enc_ctx, 16, b, ctx->iv);
-	memxor(blk, b, 16);
-	increment_iv_step32(ctx->iv, 4);
-	blk += 16;
-	len -= 16;
-    }
+    /* Nettle's counter is the whole 128-bit block in big-endian, as in SDCTR */
+    ctr_crypt(&ctx->enc_ctx, (nettle_cipher_func *)aes_encrypt, 16,
+	      ctx->iv, len, blk, blk);
 }
 
 void *aes_make_context(void)
@@ -434,14 +421,18 @@ static const struct ssh2_cipher ssh_aes128_gcm = {
 };
 
 
+/*
+ * GCM first, it is the fastest as it does not need a separate MAC and
+ * Nettle uses hardware acceleration for it where available.
+ */
 static const struct ssh2_cipher *const aes_list[] = {
     &ssh_aes256_gcm,
+    &ssh_aes128_gcm,
     &ssh_aes256_ctr,
     &ssh_aes256,
     &ssh_rijndael_lysator,
     &ssh_aes192_ctr,
     &ssh_aes192,
-    &ssh_aes128_gcm,
     &ssh_aes128_ctr,
     &ssh_aes128,
 };
@@ -32,139 +32,87 @@
 #include "ssh.h"
 #include "sshbn.h"
 
+#include <nettle/chacha.h>
+
 #ifndef INLINE
 #define INLINE
 #endif
 
-/* ChaCha20 implementation, only supporting 256-bit keys */
+/*
+ * ChaCha20 implementation, only supporting 256-bit keys
+ *
+ * Modified to use the ChaCha implementation from Nettle, which
+ * processes several blocks at once with its assembly cores where the
+ * platform has them. Whole blocks are handed to Nettle in a single
+ * call, only the tail of a partial block is buffered here.
+ */
 
 /* State for each ChaCha20 instance */
 struct chacha20 {
-    /* Current context, usually with the count incremented
-     * 0-3 are the static constant
-     * 4-11 are the key
-     * 12-13 are the counter
-     * 14-15 are the IV */
-    uint32 state[16];
-    /* The output of the state above ready to xor */
+    /* Nettle context, state[12-13] is the block counter */
+    struct chacha_ctx ctx;
+    /* Keystream left over from the last partial block */
     unsigned char current[64];
     /* The index of the above currently used to allow a true streaming cipher */
     int currentIndex;
 };
 
+/* Generate the next block of keystream into the xor buffer */
 static INLINE void chacha20_round(struct chacha20 *ctx)
 {
-    int i;
-    uint32 copy[16];
-
-    /* Take a copy */
-    memcpy(copy, ctx->state, sizeof(copy));
-
-    /* A circular rotation for a 32bit number */
-#define rotl(x, shift) x = ((x << shift) | (x >> (32 - shift)))
-
-    /* What to do for each quarter round operation */
-#define qrop(a, b, c, d)                        \
-    copy[a] += copy[b];                         \
-    copy[c] ^= copy[a];                         \
-    rotl(copy[c], d)
-
-    /* A quarter round */
-#define quarter(a, b, c, d)                     \
-    qrop(a, b, d, 16);                          \
-    qrop(c, d, b, 12);                          \
-    qrop(a, b, d, 8);                           \
-    qrop(c, d, b, 7)
-
-    /* Do 20 rounds, in pairs because every other is different */
-    for (i = 0; i < 20; i += 2) {
-        /* A round */
-        quarter(0, 4, 8, 12);
-        quarter(1, 5, 9, 13);
-        quarter(2, 6, 10, 14);
-        quarter(3, 7, 11, 15);
-        /* Another slightly different round */
-        quarter(0, 5, 10, 15);
-        quarter(1, 6, 11, 12);
-        quarter(2, 7, 8, 13);
-        quarter(3, 4, 9, 14);
-    }
-
-    /* Dump the macros, don't need them littering */
-#undef rotl
-#undef qrop
-#undef quarter
-
-    /* Add the initial state */
-    for (i = 0; i < 16; ++i) {
-        copy[i] += ctx->state[i];
-    }
-
-    /* Update the content of the xor buffer */
-    for (i = 0; i < 16; ++i) {
-        ctx->current[i * 4 + 0] = copy[i] >> 0;
-        ctx->current[i * 4 + 1] = copy[i] >> 8;
-        ctx->current[i * 4 + 2] = copy[i] >> 16;
-        ctx->current[i * 4 + 3] = copy[i] >> 24;
-    }
-    /* State full, reset pointer to beginning */
+    memset(ctx->current, 0, sizeof(ctx->current));
+    chacha_crypt(&ctx->ctx, sizeof(ctx->current),
+                 ctx->current, ctx->current);
     ctx->currentIndex = 0;
-    smemclr(copy, sizeof(copy));
-
-    /* Increment round counter */
-    ++ctx->state[12];
-    /* Check for overflow, not done in one line so the 32 bits are chopped by the type */
-    if (!(uint32)(ctx->state[12])) {
-        ++ctx->state[13];
-    }
 }
 
 /* Initialise context with 256bit key */
 static void chacha20_key(struct chacha20 *ctx, const unsigned char *key)
 {
-    static const char constant[16] = "expand 32-byte k";
-
-    /* Add the fixed string to the start of the state */
-    ctx->state[0] = GET_32BIT_LSB_FIRST(constant + 0);
-    ctx->state[1] = GET_32BIT_LSB_FIRST(constant + 4);
-    ctx->state[2] = GET_32BIT_LSB_FIRST(constant + 8);
-    ctx->state[3] = GET_32BIT_LSB_FIRST(constant + 12);
-
-    /* Add the key */
-    ctx->state[4]  = GET_32BIT_LSB_FIRST(key + 0);
-    ctx->state[5]  = GET_32BIT_LSB_FIRST(key + 4);
-    ctx->state[6]  = GET_32BIT_LSB_FIRST(key + 8);
-    ctx->state[7]  = GET_32BIT_LSB_FIRST(key + 12);
-    ctx->state[8]  = GET_32BIT_LSB_FIRST(key + 16);
-    ctx->state[9]  = GET_32BIT_LSB_FIRST(key + 20);
-    ctx->state[10] = GET_32BIT_LSB_FIRST(key + 24);
-    ctx->state[11] = GET_32BIT_LSB_FIRST(key + 28);
+    chacha_set_key(&ctx->ctx, key);
 
     /* New key, dump context */
     ctx->currentIndex = 64;
 }
 
+/* Takes the 64bit nonce, resets the block counter to zero */
 static void chacha20_iv(struct chacha20 *ctx, const unsigned char *iv)
 {
-    ctx->state[12] = 0;
-    ctx->state[13] = 0;
-    ctx->state[14] = GET_32BIT_MSB_FIRST(iv);
-    ctx->state[15] = GET_32BIT_MSB_FIRST(iv + 4);
+    chacha_set_nonce(&ctx->ctx, iv);
 
     /* New IV, dump context */
     ctx->currentIndex = 64;
 }
 
+/* Skip a block of keystream without generating it */
+static void chacha20_skip_block(struct chacha20 *ctx)
+{
+    /* Check for overflow, not done in one line so the 32 bits are chopped by the type */
+    if (!(uint32)(++ctx->ctx.state[12])) {
+        ++ctx->ctx.state[13];
+    }
+}
+
 static void chacha20_encrypt(struct chacha20 *ctx, unsigned char *blk, int len)
 {
-    while (len) {
-        /* If we don't have any state left, then cycle to the next */
-        if (ctx->currentIndex >= 64) {
-            chacha20_round(ctx);
-        }
+    /* Use up what is left of the buffered block first */
+    while (ctx->currentIndex < 64 && len) {
+        *blk++ ^= ctx->current[ctx->currentIndex++];
+        --len;
+    }
 
-        /* Do the xor while there's some state left and some plaintext left */
-        while (ctx->currentIndex < 64 && len) {
+    /* Whole blocks in one go */
+    if (len >= 64) {
+        int whole = len & ~63;
+        chacha_crypt(&ctx->ctx, whole, blk, blk);
+        blk += whole;
+        len -= whole;
+    }
+
+    /* Buffer the keystream for the final partial block */
+    if (len) {
+        chacha20_round(ctx);
+        while (len) {
             *blk++ ^= ctx->current[ctx->currentIndex++];
             --len;
         }
@@ -859,7 +807,7 @@ struct ccp_context {
     struct chacha20 b_cipher; /* Used for content */
 
     /* Cache of the first 4 bytes because they are the sequence number */
-    /* Kept in 8 bytes with the top as zero to allow easy passing to setiv */
+    /* Kept as a 64bit big endian nonce with the top as zero to allow easy passing to setiv */
     int mac_initialised; /* Where we have got to in filling mac_iv */
     unsigned char mac_iv[8];
 
@@ -896,7 +844,7 @@ static void poly_bytes(void *handle, unsigned char const *blk, int len)
 
     /* First 4 bytes are the IV */
     while (ctx->mac_initialised < 4 && len) {
-        ctx->mac_iv[7 - ctx->mac_initialised] = *blk++;
+        ctx->mac_iv[4 + ctx->mac_initialised] = *blk++;
         ++ctx->mac_initialised;
         --len;
     }
@@ -1029,12 +977,12 @@ static void ccp_length_op(struct ccp_context *ctx, unsigned char *blk, int len,
      * According to RFC 4253 (section 6.4), the packet sequence number wraps
      * at 2^32, so its 32 high-order bits will always be zero.
      */
-    PUT_32BIT_LSB_FIRST(iv, 0);
-    PUT_32BIT_LSB_FIRST(iv + 4, seq);
+    PUT_32BIT_MSB_FIRST(iv, 0);
+    PUT_32BIT_MSB_FIRST(iv + 4, seq);
     chacha20_iv(&ctx->a_cipher, iv);
     chacha20_iv(&ctx->b_cipher, iv);
     /* Reset content block count to 1, as the first is the key for Poly1305 */
-    ++ctx->b_cipher.state[12];
+    chacha20_skip_block(&ctx->b_cipher);
     smemclr(iv, sizeof(iv));
 }
 
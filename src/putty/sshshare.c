@@ -2025,6 +2025,7 @@ extern const int share_can_be_upstream;
 char *ssh_share_sockname(const char *host, int port, Conf *conf)
 {
     char *username = get_remote_username(conf);
+    const char *group = conf_get_str(conf, CONF_fz_share_group);
     char *sockname;
 
     if (port == 22) {
@@ -2039,6 +2040,13 @@ char *ssh_share_sockname(const char *host, int port, Conf *conf)
             sockname = dupprintf("%s:%d", host, port);
     }
 
+    /* FZ: Each group is a separate shared connection */
+    if (*group) {
+        char *grouped = dupprintf("%s#%s", sockname, group);
+        sfree(sockname);
+        sockname = grouped;
+    }
+
     sfree(username);
     return sockname;
 }
@@ -133,6 +133,7 @@ struct LZ77InternalContext {
     struct HashEntry hashtab[HASHMAX];
     unsigned char pending[HASHCHARS];
     int npending;
+    int maxchain;		       /* FZ: hash chain entries to examine */
 };
 
 static int lz77_hash(unsigned char *data)
@@ -158,6 +159,7 @@ static int lz77_init(struct LZ77Context *ctx)
     st->winpos = 0;
 
     st->npending = 0;
+    st->maxchain = WINSIZE;
 
     return 1;
 }
@@ -248,9 +250,10 @@ static void lz77_compress(struct LZ77Context *ctx,
 	     * Look the hash up in the corresponding hash chain and see
 	     * what we can find.
 	     */
+	    int chain = st->maxchain;
 	    nmatch = 0;
 	    for (off = st->hashtab[hash].first;
-		 off != INVALID; off = st->win[off].next) {
+		 off != INVALID && chain-- > 0; off = st->win[off].next) {
 		/* distance = 1       if off == st->winpos-1 */
 		/* distance = WINSIZE if off == st->winpos   */
 		distance =
@@ -371,7 +374,35 @@ struct Outbuf {
     int noutbits;
     int firstblock;
     int comp_disabled;
+    /*
+     * FZ: Adaptive compression. The compressed size of each
+     * ZLIB_SAMPLE bytes of input is measured, and if it isn't worth
+     * it, the next ZLIB_SKIP bytes are sent as stored blocks.
+     */
+    unsigned long sample_in, sample_out;
+    unsigned long skip;
+};
+
+#define ZLIB_SAMPLE 0x10000
+#define ZLIB_SKIP 0x100000
+
+/*
+ * FZ: Chain lengths searched at each compression level, trading
+ * compression ratio for speed.
+ */
+static const int zlib_maxchain[10] = {
+    0, 4, 8, 16, 32, 64, 128, 256, 1024, WINSIZE
 };
+static int zlib_level = 6;
+
+void zlib_set_compression_level(int level)
+{
+    if (level < 1)
+	level = 1;
+    else if (level > 9)
+	level = 9;
+    zlib_level = level;
+}
 
 static void outbits(struct Outbuf *out, unsigned long bits, int nbits)
 {
@@ -380,7 +411,7 @@ static void outbits(struct Outbuf *out, unsigned long bits, int nbits)
     out->noutbits += nbits;
     while (out->noutbits >= 8) {
 	if (out->outlen >= out->outsize) {
-	    out->outsize = out->outlen + 64;
+	    out->outsize = out->outlen + out->outlen / 2 + 64;
 	    out->outbuf = sresize(out->outbuf, out->outsize, unsigned char);
 	}
 	out->outbuf[out->outlen++] = (unsigned char) (out->outbits & 0xFF);
@@ -500,9 +531,9 @@ static void zlib_literal(struct LZ77Context *ectx, unsigned char c)
 
     if (out->comp_disabled) {
 	/*
-	 * We're in an uncompressed block, so just output the byte.
+	 * We're in an uncompressed block. FZ: zlib_compress_block
+	 * has already copied the data in one go.
 	 */
-	outbits(out, c, 8);
 	return;
     }
 
@@ -613,6 +644,7 @@ void *zlib_compress_init(void)
     struct LZ77Context *ectx = snew(struct LZ77Context);
 
     lz77_init(ectx);
+    ectx->ictx->maxchain = zlib_maxchain[zlib_level];
     ectx->literal = zlib_literal;
     ectx->match = zlib_match;
 
@@ -620,6 +652,8 @@ void *zlib_compress_init(void)
     out->outbits = out->noutbits = 0;
     out->firstblock = 1;
     out->comp_disabled = FALSE;
+    out->sample_in = out->sample_out = 0;
+    out->skip = 0;
     ectx->userdata = out;
 
     return ectx;
@@ -681,9 +715,28 @@ int zlib_compress_block(void *handle, unsigned char *block, int len,
     struct LZ77Context *ectx = (struct LZ77Context *)handle;
     struct Outbuf *out = (struct Outbuf *) ectx->userdata;
     int in_block;
+    int adaptive = FALSE;
 
-    out->outbuf = NULL;
-    out->outlen = out->outsize = 0;
+    /*
+     * FZ: Size the buffer for the common case up front rather than
+     * growing it bit by bit.
+     */
+    out->outsize = len + len / 8 + 64;
+    out->outbuf = snewn(out->outsize, unsigned char);
+    out->outlen = 0;
+
+    /*
+     * FZ: If recent data did not compress, don't waste time on
+     * trying to compress this block.
+     */
+    if (!out->comp_disabled) {
+	if (out->skip > 0) {
+	    out->skip = (out->skip > (unsigned long)len) ?
+		out->skip - len : 0;
+	    out->comp_disabled = TRUE;
+	} else
+	    adaptive = TRUE;
+    }
 
     /*
      * If this is the first block, output the Zlib (RFC1950) header
@@ -728,6 +781,18 @@ int zlib_compress_block(void *handle, unsigned char *block, int len,
 	    outbits(out, blen, 16);
 	    outbits(out, blen ^ 0xFFFF, 16);
 
+	    /*
+	     * FZ: We're byte aligned now, copy the data directly.
+	     */
+	    assert(out->noutbits == 0);
+	    if (out->outlen + blen > out->outsize) {
+		out->outsize = out->outlen + blen + 64;
+		out->outbuf = sresize(out->outbuf, out->outsize,
+				      unsigned char);
+	    }
+	    memcpy(out->outbuf + out->outlen, block, blen);
+	    out->outlen += blen;
+
 	    /*
 	     * Do the `compression': we need to pass the data to
 	     * lz77_compress so that it will be taken into account
@@ -736,7 +801,7 @@ int zlib_compress_block(void *handle, unsigned char *block, int len,
 	     * actually find (or even look for) any matches; so
 	     * every character will be passed straight to
 	     * zlib_literal which will spot out->comp_disabled and
-	     * emit in the uncompressed format.
+	     * ignore it.
 	     */
 	    lz77_compress(ectx, block, blen, FALSE);
 
@@ -788,6 +853,16 @@ int zlib_compress_block(void *handle, unsigned char *block, int len,
 	outbits(out, 2, 3);	       /* open new block */
     }
 
+    if (adaptive) {
+	out->sample_in += len;
+	out->sample_out += out->outlen;
+	if (out->sample_in >= ZLIB_SAMPLE) {
+	    if (out->sample_out >= out->sample_in - out->sample_in / 16)
+		out->skip = ZLIB_SKIP;
+	    out->sample_in = out->sample_out = 0;
+	}
+    }
+
     out->comp_disabled = FALSE;
 
     *outblock = out->outbuf;
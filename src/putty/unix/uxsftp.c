@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <glob.h>
+#include <pthread.h>
 #ifndef HAVE_NO_SYS_SELECT_H
 #include <sys/select.h>
 #endif
@@ -301,6 +302,168 @@ uint64 get_file_posn(WFile *f)
     return ret;
 }
 
+struct WFileWriter {
+    WFile *file;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    char *buffers[WFILE_WRITER_BUFFERS];
+    int lengths[WFILE_WRITER_BUFFERS];
+    int head;       /* Next buffer to be written by the thread */
+    int count;      /* Number of filled buffers waiting for the thread */
+    int fill;       /* Bytes in the buffer being filled, the one after the waiting ones */
+    int error;
+};
+
+static WFileWriter *wfile_writer;
+static int wfile_writer_failed;
+
+static void *wfile_writer_thread(void *param)
+{
+    WFileWriter *w = (WFileWriter *)param;
+
+    pthread_mutex_lock(&w->mutex);
+    for (;;) {
+        int len, ret;
+        char *buffer;
+
+        while (!w->count)
+            pthread_cond_wait(&w->cond, &w->mutex);
+
+        buffer = w->buffers[w->head];
+        len = w->lengths[w->head];
+        /* After an error, the rest of the file is discarded */
+        if (!w->error) {
+            pthread_mutex_unlock(&w->mutex);
+            ret = write_to_file(w->file, buffer, len);
+            pthread_mutex_lock(&w->mutex);
+            if (ret != len)
+                w->error = 1;
+        }
+        w->head = (w->head + 1) % WFILE_WRITER_BUFFERS;
+        --w->count;
+        pthread_cond_broadcast(&w->cond);
+    }
+
+    return NULL;
+}
+
+WFileWriter *wfile_writer_get(void)
+{
+    WFileWriter *w;
+    int i;
+
+    if (wfile_writer || wfile_writer_failed)
+        return wfile_writer;
+
+    /* Don't retry for every file if the thread cannot be started */
+    wfile_writer_failed = 1;
+
+    w = snew(WFileWriter);
+    memset(w, 0, sizeof(*w));
+
+    for (i = 0; i < WFILE_WRITER_BUFFERS; i++) {
+        void *buffer;
+        /* Page aligned, so the kernel can copy whole pages */
+        if (posix_memalign(&buffer, 4096, WFILE_WRITER_BUFFERSIZE)) {
+            while (i--)
+                free(w->buffers[i]);
+            sfree(w);
+            return NULL;
+        }
+        w->buffers[i] = (char *)buffer;
+    }
+
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, wfile_writer_thread, w)) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->mutex);
+        for (i = 0; i < WFILE_WRITER_BUFFERS; i++)
+            free(w->buffers[i]);
+        sfree(w);
+        return NULL;
+    }
+
+    wfile_writer_failed = 0;
+    wfile_writer = w;
+    return w;
+}
+
+void wfile_writer_begin(WFileWriter *w, WFile *f)
+{
+    pthread_mutex_lock(&w->mutex);
+    w->file = f;
+    w->error = 0;
+    pthread_mutex_unlock(&w->mutex);
+    w->fill = 0;
+}
+
+/* Hands the buffer being filled over to the thread */
+static void wfile_writer_commit(WFileWriter *w, int index)
+{
+    pthread_mutex_lock(&w->mutex);
+    w->lengths[index] = w->fill;
+    ++w->count;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+    w->fill = 0;
+}
+
+int wfile_writer_write(WFileWriter *w, const void *buffer, int length)
+{
+    const char *p = (const char *)buffer;
+    int left = length;
+
+    while (left > 0) {
+        int index, n;
+
+        pthread_mutex_lock(&w->mutex);
+        while (w->count == WFILE_WRITER_BUFFERS && !w->error)
+            pthread_cond_wait(&w->cond, &w->mutex);
+        if (w->error) {
+            pthread_mutex_unlock(&w->mutex);
+            return -1;
+        }
+        index = (w->head + w->count) % WFILE_WRITER_BUFFERS;
+        pthread_mutex_unlock(&w->mutex);
+
+        n = WFILE_WRITER_BUFFERSIZE - w->fill;
+        if (n > left)
+            n = left;
+        memcpy(w->buffers[index] + w->fill, p, n);
+        w->fill += n;
+        p += n;
+        left -= n;
+
+        if (w->fill == WFILE_WRITER_BUFFERSIZE)
+            wfile_writer_commit(w, index);
+    }
+
+    return length;
+}
+
+int wfile_writer_end(WFileWriter *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->fill && !w->error) {
+        w->lengths[(w->head + w->count) % WFILE_WRITER_BUFFERS] = w->fill;
+        ++w->count;
+        pthread_cond_broadcast(&w->cond);
+    }
+    w->fill = 0;
+    while (w->count)
+        pthread_cond_wait(&w->cond, &w->mutex);
+    ret = w->error ? -1 : 0;
+    w->file = NULL;
+    pthread_mutex_unlock(&w->mutex);
+
+    return ret;
+}
+
 int file_type(const char *name)
 {
     struct stat statbuf;
@@ -466,7 +629,7 @@ static int ssh_sftp_do_select(int include_stdin, int no_fds_ok)
     fdlist = NULL;
     fdcount = fdsize = 0;
 
-    if (include_stdin && has_input_pushback())
+    if (include_stdin && (has_input_pushback() || has_buffered_input_line()))
 	return 0;
 
     do {
@@ -591,7 +754,10 @@ char *ssh_sftp_get_cmdline(const char *prompt, int no_fds_ok)
 
 
     while (1) {
-	ret = ssh_sftp_do_select(TRUE, no_fds_ok);
+	if (has_buffered_input_line())
+	    ret = 1;
+	else
+	    ret = ssh_sftp_do_select(TRUE, no_fds_ok);
 	if (ret < 0) {
 	    printf("connection died\n");
             sfree(line);
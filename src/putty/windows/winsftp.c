@@ -281,6 +281,176 @@ uint64 get_file_posn(WFile *f)
     return ret;
 }
 
+struct WFileWriter {
+    WFile *file;
+    HANDLE thread;
+    CRITICAL_SECTION cs;
+    CONDITION_VARIABLE cond;
+
+    char *buffers[WFILE_WRITER_BUFFERS];
+    int lengths[WFILE_WRITER_BUFFERS];
+    int head;       /* Next buffer to be written by the thread */
+    int count;      /* Number of filled buffers waiting for the thread */
+    int fill;       /* Bytes in the buffer being filled, the one after the waiting ones */
+    int error;
+};
+
+static WFileWriter *wfile_writer;
+static int wfile_writer_failed;
+
+static DWORD WINAPI wfile_writer_thread(void *param)
+{
+    WFileWriter *w = (WFileWriter *)param;
+
+    EnterCriticalSection(&w->cs);
+    for (;;) {
+        int len, ret;
+        char *buffer;
+
+        while (!w->count)
+            SleepConditionVariableCS(&w->cond, &w->cs, INFINITE);
+
+        buffer = w->buffers[w->head];
+        len = w->lengths[w->head];
+        /* After an error, the rest of the file is discarded */
+        if (!w->error) {
+            LeaveCriticalSection(&w->cs);
+            ret = write_to_file(w->file, buffer, len);
+            EnterCriticalSection(&w->cs);
+            if (ret != len)
+                w->error = 1;
+        }
+        w->head = (w->head + 1) % WFILE_WRITER_BUFFERS;
+        --w->count;
+        WakeAllConditionVariable(&w->cond);
+    }
+
+    return 0;
+}
+
+static void wfile_writer_free_buffers(WFileWriter *w)
+{
+    int i;
+    for (i = 0; i < WFILE_WRITER_BUFFERS; i++) {
+        if (w->buffers[i])
+            VirtualFree(w->buffers[i], 0, MEM_RELEASE);
+    }
+}
+
+WFileWriter *wfile_writer_get(void)
+{
+    WFileWriter *w;
+    DWORD threadid;
+    int i;
+
+    if (wfile_writer || wfile_writer_failed)
+        return wfile_writer;
+
+    /* Don't retry for every file if the thread cannot be started */
+    wfile_writer_failed = 1;
+
+    w = snew(WFileWriter);
+    memset(w, 0, sizeof(*w));
+
+    for (i = 0; i < WFILE_WRITER_BUFFERS; i++) {
+        /* Page aligned, so the kernel can copy whole pages */
+        w->buffers[i] = VirtualAlloc(NULL, WFILE_WRITER_BUFFERSIZE,
+                                     MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!w->buffers[i]) {
+            wfile_writer_free_buffers(w);
+            sfree(w);
+            return NULL;
+        }
+    }
+
+    InitializeCriticalSection(&w->cs);
+    InitializeConditionVariable(&w->cond);
+    w->thread = CreateThread(NULL, 0, wfile_writer_thread, w, 0, &threadid);
+    if (!w->thread) {
+        DeleteCriticalSection(&w->cs);
+        wfile_writer_free_buffers(w);
+        sfree(w);
+        return NULL;
+    }
+
+    wfile_writer_failed = 0;
+    wfile_writer = w;
+    return w;
+}
+
+void wfile_writer_begin(WFileWriter *w, WFile *f)
+{
+    EnterCriticalSection(&w->cs);
+    w->file = f;
+    w->error = 0;
+    LeaveCriticalSection(&w->cs);
+    w->fill = 0;
+}
+
+/* Hands the buffer being filled over to the thread */
+static void wfile_writer_commit(WFileWriter *w, int index)
+{
+    EnterCriticalSection(&w->cs);
+    w->lengths[index] = w->fill;
+    ++w->count;
+    WakeAllConditionVariable(&w->cond);
+    LeaveCriticalSection(&w->cs);
+    w->fill = 0;
+}
+
+int wfile_writer_write(WFileWriter *w, const void *buffer, int length)
+{
+    const char *p = (const char *)buffer;
+    int left = length;
+
+    while (left > 0) {
+        int index, n;
+
+        EnterCriticalSection(&w->cs);
+        while (w->count == WFILE_WRITER_BUFFERS && !w->error)
+            SleepConditionVariableCS(&w->cond, &w->cs, INFINITE);
+        if (w->error) {
+            LeaveCriticalSection(&w->cs);
+            return -1;
+        }
+        index = (w->head + w->count) % WFILE_WRITER_BUFFERS;
+        LeaveCriticalSection(&w->cs);
+
+        n = WFILE_WRITER_BUFFERSIZE - w->fill;
+        if (n > left)
+            n = left;
+        memcpy(w->buffers[index] + w->fill, p, n);
+        w->fill += n;
+        p += n;
+        left -= n;
+
+        if (w->fill == WFILE_WRITER_BUFFERSIZE)
+            wfile_writer_commit(w, index);
+    }
+
+    return length;
+}
+
+int wfile_writer_end(WFileWriter *w)
+{
+    int ret;
+
+    EnterCriticalSection(&w->cs);
+    if (w->fill && !w->error) {
+        w->lengths[(w->head + w->count) % WFILE_WRITER_BUFFERS] = w->fill;
+        ++w->count;
+        WakeAllConditionVariable(&w->cond);
+    }
+    w->fill = 0;
+    while (w->count)
+        SleepConditionVariableCS(&w->cond, &w->cs, INFINITE);
+    ret = w->error ? -1 : 0;
+    w->file = NULL;
+    LeaveCriticalSection(&w->cs);
+
+    return ret;
+}
+
 int file_type(const char *name)
 {
     DWORD attr;
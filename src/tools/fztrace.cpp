@@ -0,0 +1,284 @@
+// Converts binary traces written by the engine into human-readable
+// per-transfer timelines and latency histograms.
+//
+// Usage: fztrace [-t] [-l] tracefile
+//   -t  Only print the transfer timelines
+//   -l  Only print the latency histograms
+
+#include "trace_format.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Matches the public part of enum class Command in commands.h
+char const* const op_names[] = {
+	"none", "connect", "disconnect", "list", "transfer", "delete",
+	"removedir", "mkdir", "rename", "chmod", "raw", "httprequest"
+};
+
+std::string op_name(uint16_t op)
+{
+	if (op < sizeof(op_names) / sizeof(*op_names)) {
+		return op_names[op];
+	}
+	return "op" + std::to_string(op);
+}
+
+std::string format_duration(int64_t us)
+{
+	char buf[64];
+	if (us < 1000) {
+		snprintf(buf, sizeof(buf), "%lld us", static_cast<long long>(us));
+	}
+	else if (us < 1000000) {
+		snprintf(buf, sizeof(buf), "%.1f ms", us / 1000.0);
+	}
+	else {
+		snprintf(buf, sizeof(buf), "%.2f s", us / 1000000.0);
+	}
+	return buf;
+}
+
+std::string format_rate(int64_t bytes, int64_t us)
+{
+	if (us <= 0) {
+		return "-";
+	}
+	double rate = bytes * 1000000.0 / us;
+	char const* const units[] = { "B/s", "KiB/s", "MiB/s", "GiB/s" };
+	size_t unit = 0;
+	while (rate >= 1024 && unit + 1 < sizeof(units) / sizeof(*units)) {
+		rate /= 1024;
+		++unit;
+	}
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.1f %s", rate, units[unit]);
+	return buf;
+}
+
+struct transfer final
+{
+	uint16_t op{};
+	int64_t start{-1};
+	int64_t size{-1};
+	int64_t offset{};
+	std::vector<std::pair<int64_t, int64_t>> progress;
+};
+
+struct engine_state final
+{
+	transfer current;
+	std::map<uint16_t, int64_t> operation_start;
+
+	// Last reply was a preliminary 1yz reply
+	bool preliminary{};
+};
+
+class histogram final
+{
+public:
+	void add(int64_t us)
+	{
+		values_.push_back(std::max(us, int64_t(0)));
+	}
+
+	void print(std::string const& title)
+	{
+		if (values_.empty()) {
+			return;
+		}
+
+		std::sort(values_.begin(), values_.end());
+		auto const percentile = [this](size_t p) {
+			return values_[std::min(values_.size() - 1, values_.size() * p / 100)];
+		};
+
+		printf("%s: %zu samples, min %s, median %s, p90 %s, p99 %s, max %s\n", title.c_str(), values_.size(),
+			format_duration(values_.front()).c_str(), format_duration(percentile(50)).c_str(),
+			format_duration(percentile(90)).c_str(), format_duration(percentile(99)).c_str(),
+			format_duration(values_.back()).c_str());
+
+		// Power of two buckets
+		std::vector<size_t> buckets(64);
+		size_t first = buckets.size();
+		size_t last = 0;
+		for (auto v : values_) {
+			size_t b = 0;
+			while (v > 1) {
+				v >>= 1;
+				++b;
+			}
+			++buckets[b];
+			first = std::min(first, b);
+			last = std::max(last, b);
+		}
+
+		size_t const max_count = *std::max_element(buckets.begin(), buckets.end());
+		for (size_t b = first; b <= last; ++b) {
+			size_t const width = (buckets[b] * 50 + max_count - 1) / max_count;
+			printf("  < %10s %8zu %s\n", format_duration(int64_t(1) << (b + 1)).c_str(), buckets[b], std::string(width, '#').c_str());
+		}
+		printf("\n");
+	}
+
+private:
+	std::vector<int64_t> values_;
+};
+
+int usage(char const* name)
+{
+	fprintf(stderr, "Usage: %s [-t] [-l] tracefile\n", name);
+	fprintf(stderr, "  -t  Only print the transfer timelines\n");
+	fprintf(stderr, "  -l  Only print the latency histograms\n");
+	return 1;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	bool timelines = true;
+	bool latencies = true;
+	char const* file = nullptr;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-t")) {
+			latencies = false;
+		}
+		else if (!strcmp(argv[i], "-l")) {
+			timelines = false;
+		}
+		else if (argv[i][0] == '-' || file) {
+			return usage(argv[0]);
+		}
+		else {
+			file = argv[i];
+		}
+	}
+	if (!file || (!timelines && !latencies)) {
+		return usage(argv[0]);
+	}
+
+	FILE* f = fopen(file, "rb");
+	if (!f) {
+		fprintf(stderr, "Could not open %s\n", file);
+		return 1;
+	}
+
+	trace_file_header header;
+	if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, "FZTRACE", 8)) {
+		fprintf(stderr, "%s is not a trace file\n", file);
+		fclose(f);
+		return 1;
+	}
+	if (header.version != trace_format_version || header.record_size != sizeof(trace_record)) {
+		if ((header.version & 0xffffu) == 0 && (header.version >> 24) == trace_format_version) {
+			fprintf(stderr, "Trace has been written on a machine with different byte order\n");
+		}
+		else {
+			fprintf(stderr, "Unsupported trace format version %u\n", header.version);
+		}
+		fclose(f);
+		return 1;
+	}
+
+	std::map<uint32_t, engine_state> engines;
+	std::map<uint16_t, histogram> operations;
+	histogram replies;
+	uint64_t records{};
+	uint64_t dropped{};
+
+	if (timelines) {
+		printf("Transfer timelines\n\n");
+	}
+
+	trace_record r;
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		++records;
+		if (static_cast<trace_event>(r.event) == trace_event::dropped) {
+			dropped += static_cast<uint64_t>(r.value);
+			continue;
+		}
+
+		engine_state & e = engines[r.engine];
+
+		switch (static_cast<trace_event>(r.event)) {
+		case trace_event::operation_start:
+			e.operation_start[r.op] = r.time;
+			break;
+		case trace_event::operation_end:
+			{
+				auto it = e.operation_start.find(r.op);
+				if (it != e.operation_start.end()) {
+					operations[r.op].add(r.time - it->second);
+					e.operation_start.erase(it);
+				}
+			}
+			break;
+		case trace_event::transfer_start:
+			e.current = transfer();
+			e.current.op = r.op;
+			e.current.start = r.time;
+			e.current.size = r.bytes;
+			e.current.offset = r.value;
+			break;
+		case trace_event::transfer_progress:
+			if (e.current.start >= 0) {
+				e.current.progress.emplace_back(r.time - e.current.start, r.bytes);
+			}
+			break;
+		case trace_event::transfer_end:
+			if (e.current.start >= 0 && timelines) {
+				int64_t const duration = r.time - e.current.start;
+				printf("Engine %u, %s at %s: %lld of %lld bytes from offset %lld in %s, %s\n", r.engine, op_name(e.current.op).c_str(),
+					format_duration(e.current.start).c_str(), static_cast<long long>(r.bytes), static_cast<long long>(e.current.size),
+					static_cast<long long>(e.current.offset), format_duration(duration).c_str(), format_rate(r.bytes, duration).c_str());
+
+				int64_t last_time{};
+				int64_t last_bytes{};
+				for (auto const& p : e.current.progress) {
+					printf("  +%-10s %14lld bytes  %s\n", format_duration(p.first).c_str(), static_cast<long long>(p.second),
+						format_rate(p.second - last_bytes, p.first - last_time).c_str());
+					last_time = p.first;
+					last_bytes = p.second;
+				}
+			}
+			e.current = transfer();
+			break;
+		case trace_event::command_sent:
+			break;
+		case trace_event::reply_received:
+			// Older engines also timed the final reply after a preliminary
+			// one, which includes the data transfer.
+			if (r.value >= 0 && !e.preliminary) {
+				replies.add(r.value);
+			}
+			e.preliminary = r.reply >= 100 && r.reply < 200;
+			break;
+		default:
+			break;
+		}
+	}
+	fclose(f);
+
+	if (latencies) {
+		printf("\nLatency histograms\n\n");
+		replies.print("Control connection replies");
+		for (auto & h : operations) {
+			h.second.print("Operation " + op_name(h.first));
+		}
+	}
+
+	printf("%llu records from %zu engines", static_cast<unsigned long long>(records), engines.size());
+	if (dropped) {
+		printf(", %llu records have been dropped while tracing", static_cast<unsigned long long>(dropped));
+	}
+	printf("\n");
+
+	return 0;
+}
@@ -31,6 +31,7 @@ class CDirectoryListingParserTest final : public CppUnit::TestFixture
 	}
 	CPPUNIT_TEST(testAll);
 	CPPUNIT_TEST(testSpecial);
+	CPPUNIT_TEST(testAddEntry);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -40,6 +41,7 @@ public:
 	void testIndividual();
 	void testAll();
 	void testSpecial();
+	void testAddEntry();
 
 	static std::vector<t_entry> m_entries;
 
@@ -1546,6 +1548,51 @@ void CDirectoryListingParserTest::testSpecial()
 	}
 }
 
+void CDirectoryListingParserTest::testAddEntry()
+{
+	CServer server;
+	server.SetTimezoneOffset(90);
+
+	CDirectoryListingParser parser(0, server);
+
+	auto make_entry = [](std::wstring const& name, int64_t size, int flags) {
+		CDirentry entry;
+		entry.name = name;
+		entry.size = size;
+		entry.flags = flags;
+		entry.time = fz::datetime(fz::datetime::utc, 2020, 2, 29, 23, 1, 2);
+		return entry;
+	};
+
+	// . and .. are skipped
+	CPPUNIT_ASSERT(parser.AddEntry(L"drwxr-xr-x 2 root root 4096 Feb 29 23:01 .", make_entry(L".", 4096, CDirentry::flag_dir), L"drwxr-xr-x", L"root root"));
+	CPPUNIT_ASSERT(parser.AddEntry(L"drwxr-xr-x 2 root root 4096 Feb 29 23:01 ..", make_entry(L"..", 4096, CDirentry::flag_dir), L"drwxr-xr-x", L"root root"));
+	CPPUNIT_ASSERT(parser.AddEntry(L"", make_entry(L"", 0, 0), L"", L""));
+
+	// The line is only logged, the entry is taken as is
+	CPPUNIT_ASSERT(parser.AddEntry(L"-rw-r--r-- 1 foo bar 123 Feb 29 23:01 file with spaces", make_entry(L"file with spaces", 123, 0), L"-rw-r--r--", L"foo bar"));
+	CPPUNIT_ASSERT(parser.AddEntry(L"garbage", make_entry(L"dir", -1, CDirentry::flag_dir), L"drwx------", L"1000 1000"));
+	CPPUNIT_ASSERT(parser.AddEntry(L"lrwxrwxrwx 1 foo bar 3 Feb 29 23:01 link -> dir", make_entry(L"link", 3, CDirentry::flag_dir | CDirentry::flag_link), L"lrwxrwxrwx", L"foo bar"));
+
+	CDirectoryListing listing = parser.Parse(CServerPath());
+	CPPUNIT_ASSERT(listing.size() == 3);
+
+	// The server's timezone offset gets applied
+	fz::datetime const time(fz::datetime::utc, 2020, 3, 1, 0, 31, 2);
+
+	CDirentry const file = { L"file with spaces", 123, R(L"-rw-r--r--"), R(L"foo bar"), 0, O(), time };
+	std::string msg = fz::sprintf("Expected:\n%s\n  Got:\n%s", file.dump(), listing[0].dump());
+	CPPUNIT_ASSERT_MESSAGE(msg, listing[0] == file);
+
+	CDirentry const dir = { L"dir", -1, R(L"drwx------"), R(L"1000 1000"), CDirentry::flag_dir, O(), time };
+	msg = fz::sprintf("Expected:\n%s\n  Got:\n%s", dir.dump(), listing[1].dump());
+	CPPUNIT_ASSERT_MESSAGE(msg, listing[1] == dir);
+
+	CDirentry const link = { L"link", 3, R(L"lrwxrwxrwx"), R(L"foo bar"), CDirentry::flag_dir | CDirentry::flag_link, O(), time };
+	msg = fz::sprintf("Expected:\n%s\n  Got:\n%s", link.dump(), listing[2].dump());
+	CPPUNIT_ASSERT_MESSAGE(msg, listing[2] == link);
+}
+
 void CDirectoryListingParserTest::setUp()
 {
 }
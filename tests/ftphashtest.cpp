@@ -0,0 +1,105 @@
+#include <filezilla.h>
+#include "ftp/filetransfer.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts that the digests get extracted from the replies
+ * to the FTP hash commands.
+ */
+
+class CFtpHashTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CFtpHashTest);
+	CPPUNIT_TEST(testHash);
+	CPPUNIT_TEST(testXHash);
+	CPPUNIT_TEST(testCrc);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testHash();
+	void testXHash();
+	void testCrc();
+
+protected:
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CFtpHashTest);
+
+namespace {
+std::wstring const sha256 = L"9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08";
+std::wstring const sha1 = L"a94a8fe5ccb19ba61c4c0873d391e987982fbbd3";
+std::wstring const md5 = L"098f6bcd4621d373cade4e832627b4f6";
+}
+
+void CFtpHashTest::testHash()
+{
+	CPPUNIT_ASSERT(ParseHashReply(L"213 SHA-256 0-4 " + sha256 + L" test.txt", L"HASH", L"SHA-256", 64) == sha256);
+	CPPUNIT_ASSERT(ParseHashReply(L"213 sha-256 0-4 " + fz::str_toupper_ascii(sha256) + L" test.txt", L"HASH", L"SHA-256", 64) == sha256);
+	CPPUNIT_ASSERT(ParseHashReply(L"213 SHA-1 0-4 " + sha1 + L" test.txt", L"HASH", L"SHA-1", 40) == sha1);
+	CPPUNIT_ASSERT(ParseHashReply(L"213 MD5 0-4 " + md5 + L" test.txt", L"HASH", L"MD5", 32) == md5);
+
+	// Filenames with spaces
+	CPPUNIT_ASSERT(ParseHashReply(L"213 MD5 0-4 " + md5 + L" my file.txt", L"HASH", L"MD5", 32) == md5);
+
+	// A filename that looks like a digest must not be taken
+	CPPUNIT_ASSERT(ParseHashReply(L"213 MD5 0-4 foo " + md5, L"HASH", L"MD5", 32).empty());
+
+	// Algorithm other than the selected one
+	CPPUNIT_ASSERT(ParseHashReply(L"213 SHA-1 0-4 " + sha1 + L" test.txt", L"HASH", L"SHA-256", 64).empty());
+
+	// Wrong length or not hex
+	CPPUNIT_ASSERT(ParseHashReply(L"213 SHA-256 0-4 " + sha1 + L" test.txt", L"HASH", L"SHA-256", 64).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"213 MD5 0-4 098f6bcd4621d373cade4e832627b4g6 test.txt", L"HASH", L"MD5", 32).empty());
+
+	// Truncated
+	CPPUNIT_ASSERT(ParseHashReply(L"213 MD5 0-4", L"HASH", L"MD5", 32).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"213", L"HASH", L"MD5", 32).empty());
+}
+
+void CFtpHashTest::testXHash()
+{
+	CPPUNIT_ASSERT(ParseHashReply(L"250 " + sha256, L"XSHA256", std::wstring(), 64) == sha256);
+	CPPUNIT_ASSERT(ParseHashReply(L"213 " + fz::str_toupper_ascii(sha1), L"XSHA1", std::wstring(), 40) == sha1);
+	CPPUNIT_ASSERT(ParseHashReply(L"250 " + md5 + L" test.txt", L"XMD5", std::wstring(), 32) == md5);
+
+	// Command name repeated in front of the digest
+	CPPUNIT_ASSERT(ParseHashReply(L"250 XSHA256 " + sha256, L"XSHA256", std::wstring(), 64) == sha256);
+	CPPUNIT_ASSERT(ParseHashReply(L"250 xmd5 " + md5 + L" test.txt", L"XMD5", std::wstring(), 32) == md5);
+
+	// Digest not in the expected position
+	CPPUNIT_ASSERT(ParseHashReply(L"250 test.txt " + md5, L"XMD5", std::wstring(), 32).empty());
+
+	// Wrong length or not hex
+	CPPUNIT_ASSERT(ParseHashReply(L"250 " + sha1, L"XSHA256", std::wstring(), 64).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"250 " + sha256, L"XSHA1", std::wstring(), 40).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"250 " + md5.substr(0, 31) + L"x", L"XMD5", std::wstring(), 32).empty());
+
+	// Truncated
+	CPPUNIT_ASSERT(ParseHashReply(L"250", L"XMD5", std::wstring(), 32).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"250 XMD5", L"XMD5", std::wstring(), 32).empty());
+}
+
+void CFtpHashTest::testCrc()
+{
+	CPPUNIT_ASSERT(ParseHashReply(L"250 D87F7E0C", L"XCRC", std::wstring(), 8) == L"d87f7e0c");
+	CPPUNIT_ASSERT(ParseHashReply(L"213 CRC32 0-4 d87f7e0c test.txt", L"HASH", L"CRC32", 8) == L"d87f7e0c");
+
+	// Leading zeroes omitted
+	CPPUNIT_ASSERT(ParseHashReply(L"250 7F7E0C", L"XCRC", std::wstring(), 8) == L"007f7e0c");
+	CPPUNIT_ASSERT(ParseHashReply(L"250 0", L"XCRC", std::wstring(), 8) == L"00000000");
+	CPPUNIT_ASSERT(ParseHashReply(L"213 CRC32 0-4 c test.txt", L"HASH", L"CRC32", 8) == L"0000000c");
+
+	// Only the digest position is considered, a short hex token elsewhere is not taken
+	CPPUNIT_ASSERT(ParseHashReply(L"213 CRC32 0-4 test.txt", L"HASH", L"CRC32", 8).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"250 XCRC test.txt ab", L"XCRC", std::wstring(), 8).empty());
+
+	// Too long or not hex
+	CPPUNIT_ASSERT(ParseHashReply(L"250 1D87F7E0C", L"XCRC", std::wstring(), 8).empty());
+	CPPUNIT_ASSERT(ParseHashReply(L"250 -1", L"XCRC", std::wstring(), 8).empty());
+
+	// Short tokens are only accepted for CRC32
+	CPPUNIT_ASSERT(ParseHashReply(L"250 " + md5.substr(1), L"XMD5", std::wstring(), 32).empty());
+}
@@ -0,0 +1,216 @@
+#include <filezilla.h>
+#include "http/rangedownload.h"
+#include "http/request.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string.h>
+
+/*
+ * This testsuite asserts the correctness of the helpers parsing HTTP
+ * response headers and chunked transfer encoding.
+ */
+
+class CHttpParserTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CHttpParserTest);
+	CPPUNIT_TEST(testFindLineEnd);
+	CPPUNIT_TEST(testFindLineEndSplit);
+	CPPUNIT_TEST(testAddHeaderLine);
+	CPPUNIT_TEST(testChunkSize);
+	CPPUNIT_TEST(testContentRange);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testFindLineEnd();
+	void testFindLineEndSplit();
+	void testAddHeaderLine();
+	void testChunkSize();
+	void testContentRange();
+
+protected:
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CHttpParserTest);
+
+namespace {
+line_result find(std::string const& data, size_t & scanned, size_t & len)
+{
+	return FindLineEnd(reinterpret_cast<unsigned char const*>(data.c_str()), data.size(), scanned, len);
+}
+
+bool chunk_size(std::string const& line, uint64_t & size)
+{
+	return ParseChunkSize(reinterpret_cast<unsigned char const*>(line.c_str()), line.size(), size);
+}
+}
+
+void CHttpParserTest::testFindLineEnd()
+{
+	size_t scanned{};
+	size_t len{};
+
+	CPPUNIT_ASSERT(find("Server: foo\r\nDate: bar\r\n", scanned, len) == line_ok);
+	CPPUNIT_ASSERT(len == 11);
+	CPPUNIT_ASSERT(scanned == 0);
+
+	CPPUNIT_ASSERT(find("\r\n", scanned, len) == line_ok);
+	CPPUNIT_ASSERT(len == 0);
+
+	CPPUNIT_ASSERT(find("", scanned, len) == line_incomplete);
+	CPPUNIT_ASSERT(find("Server: foo", scanned, len) == line_incomplete);
+	scanned = 0;
+
+	CPPUNIT_ASSERT(find("Server: foo\rbar\r\n", scanned, len) == line_bad_ending);
+	scanned = 0;
+	CPPUNIT_ASSERT(find("Server: foo\nbar", scanned, len) == line_incomplete);
+	scanned = 0;
+	CPPUNIT_ASSERT(find(std::string("Server: f\0o\r\n", 13), scanned, len) == line_null);
+	scanned = 0;
+
+	CPPUNIT_ASSERT(find(std::string(8191, 'a'), scanned, len) == line_incomplete);
+	scanned = 0;
+	CPPUNIT_ASSERT(find(std::string(8192, 'a'), scanned, len) == line_too_long);
+	scanned = 0;
+	CPPUNIT_ASSERT(find(std::string(8192, 'a') + "\r\n", scanned, len) == line_ok);
+	CPPUNIT_ASSERT(len == 8192);
+}
+
+void CHttpParserTest::testFindLineEndSplit()
+{
+	// A line arriving in pieces, the buffer grows with each piece
+	size_t scanned{};
+	size_t len{};
+
+	std::string data = "Content-Le";
+	CPPUNIT_ASSERT(find(data, scanned, len) == line_incomplete);
+	CPPUNIT_ASSERT(scanned == 10);
+
+	data += "ngth: 42";
+	CPPUNIT_ASSERT(find(data, scanned, len) == line_incomplete);
+	CPPUNIT_ASSERT(scanned == 18);
+
+	// CR at the end of one piece, LF at the start of the next
+	data += "\r";
+	CPPUNIT_ASSERT(find(data, scanned, len) == line_incomplete);
+	CPPUNIT_ASSERT(scanned == 18);
+
+	data += "\nServer";
+	CPPUNIT_ASSERT(find(data, scanned, len) == line_ok);
+	CPPUNIT_ASSERT(len == 18);
+	CPPUNIT_ASSERT(scanned == 0);
+
+	// Line ending split after the CR, followed by a bad character
+	scanned = 0;
+	data = "Server: foo\r";
+	CPPUNIT_ASSERT(find(data, scanned, len) == line_incomplete);
+	data += "x";
+	CPPUNIT_ASSERT(find(data, scanned, len) == line_bad_ending);
+
+	// A stale scan position past the end of the buffer is ignored
+	scanned = 100;
+	CPPUNIT_ASSERT(find("ab\r\n", scanned, len) == line_ok);
+	CPPUNIT_ASSERT(len == 2);
+}
+
+void CHttpParserTest::testAddHeaderLine()
+{
+	HttpHeaders headers;
+
+	std::string line = "Content-Type: text/html";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size()));
+	CPPUNIT_ASSERT(headers["Content-Type"] == "text/html");
+
+	// Only the given length counts
+	line = "Server:  \t foo \t \r\n";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size() - 2));
+	CPPUNIT_ASSERT(headers["Server"] == "foo");
+
+	line = "Empty:";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size()));
+	CPPUNIT_ASSERT(headers.find("Empty") != headers.end());
+	CPPUNIT_ASSERT(headers["Empty"].empty());
+
+	// Repeated fields get combined, empty values don't add anything
+	line = "Cache-Control: no-cache";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size()));
+	line = "cache-control: no-store";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size()));
+	line = "Cache-Control: ";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size()));
+	CPPUNIT_ASSERT(headers["Cache-Control"] == "no-cache, no-store");
+
+	// Only the first colon separates name and value
+	line = "Location: http://example.com:8080/";
+	CPPUNIT_ASSERT(AddHeaderLine(headers, line.c_str(), line.size()));
+	CPPUNIT_ASSERT(headers["Location"] == "http://example.com:8080/");
+
+	line = "No colon";
+	CPPUNIT_ASSERT(!AddHeaderLine(headers, line.c_str(), line.size()));
+	line = ": no name";
+	CPPUNIT_ASSERT(!AddHeaderLine(headers, line.c_str(), line.size()));
+	CPPUNIT_ASSERT(!AddHeaderLine(headers, "", 0));
+}
+
+void CHttpParserTest::testChunkSize()
+{
+	uint64_t size{};
+
+	CPPUNIT_ASSERT(chunk_size("0", size) && size == 0);
+	CPPUNIT_ASSERT(chunk_size("1a", size) && size == 26);
+	CPPUNIT_ASSERT(chunk_size("FfFf", size) && size == 65535);
+	CPPUNIT_ASSERT(chunk_size("00000010", size) && size == 16);
+	CPPUNIT_ASSERT(chunk_size("7fffffffffffffff", size) && size == 0x7fffffffffffffffull);
+	CPPUNIT_ASSERT(chunk_size("fffffffffffffffff", size) == false);
+
+	// Chunk extensions
+	CPPUNIT_ASSERT(chunk_size("1a;name=value", size) && size == 26);
+	CPPUNIT_ASSERT(chunk_size("1a ; name=\"quoted;value\"", size) && size == 26);
+	CPPUNIT_ASSERT(chunk_size("1a\t;name", size) && size == 26);
+	CPPUNIT_ASSERT(chunk_size("0;last", size) && size == 0);
+
+	CPPUNIT_ASSERT(!chunk_size("", size));
+	CPPUNIT_ASSERT(!chunk_size(";name=value", size));
+	CPPUNIT_ASSERT(!chunk_size("1g", size));
+	CPPUNIT_ASSERT(!chunk_size("-1", size));
+	CPPUNIT_ASSERT(!chunk_size("0x10", size));
+}
+
+void CHttpParserTest::testContentRange()
+{
+	int64_t start{};
+	int64_t end{};
+	int64_t total{};
+
+	CPPUNIT_ASSERT(ParseContentRange("bytes 0-499/1234", start, end, total));
+	CPPUNIT_ASSERT(start == 0 && end == 500 && total == 1234);
+
+	CPPUNIT_ASSERT(ParseContentRange("bytes 734-1233/1234", start, end, total));
+	CPPUNIT_ASSERT(start == 734 && end == 1234 && total == 1234);
+
+	CPPUNIT_ASSERT(ParseContentRange("Bytes 5-5/6", start, end, total));
+	CPPUNIT_ASSERT(start == 5 && end == 6 && total == 6);
+
+	// Unknown total size
+	CPPUNIT_ASSERT(ParseContentRange("bytes 100-199/*", start, end, total));
+	CPPUNIT_ASSERT(start == 100 && end == 200 && total == -1);
+
+	CPPUNIT_ASSERT(ParseContentRange("bytes 4294967296-8589934591/8589934592", start, end, total));
+	CPPUNIT_ASSERT(start == 4294967296ll && end == 8589934592ll && total == 8589934592ll);
+
+	// Unsatisfied range
+	CPPUNIT_ASSERT(!ParseContentRange("bytes */1234", start, end, total));
+
+	// Bad ranges
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 500-499/1234", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-1234/1234", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-x/10", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes a-5/10", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-5/x", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-5", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("items 0-5/10", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("bytes 0-5/10/20", start, end, total));
+	CPPUNIT_ASSERT(!ParseContentRange("", start, end, total));
+}
@@ -0,0 +1,303 @@
+#include <filezilla.h>
+#include "logfile_writer.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <atomic>
+#include <functional>
+
+#ifndef FZ_WINDOWS
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * This testsuite asserts that the background log file writer writes every
+ * line exactly once and in order, rotates the file and flushes on shutdown.
+ */
+
+class CLogFileWriterTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CLogFileWriterTest);
+	CPPUNIT_TEST(testSingleThread);
+	CPPUNIT_TEST(testOrder);
+	CPPUNIT_TEST(testManyThreads);
+	CPPUNIT_TEST(testRotation);
+	CPPUNIT_TEST(testShutdownFlush);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testSingleThread();
+	void testOrder();
+	void testManyThreads();
+	void testRotation();
+	void testShutdownFlush();
+
+protected:
+	fz::native_string file_;
+	std::string prefixes_[static_cast<int>(MessageType::count)];
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CLogFileWriterTest);
+
+namespace {
+class CLogThread final : public fz::thread
+{
+public:
+	explicit CLogThread(std::function<void()> const& f)
+		: f_(f)
+	{
+		run();
+	}
+
+	virtual ~CLogThread()
+	{
+		join();
+	}
+
+private:
+	virtual void entry() override
+	{
+		f_();
+	}
+
+	std::function<void()> const f_;
+};
+
+std::unique_ptr<CLogFileWriter> open_writer(fz::native_string const& file, int64_t maxSize, std::string const* prefixes)
+{
+#ifdef FZ_WINDOWS
+	HANDLE fd = CreateFile(file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	CPPUNIT_ASSERT(fd != INVALID_HANDLE_VALUE);
+#else
+	int fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	CPPUNIT_ASSERT(fd != -1);
+#endif
+	return std::make_unique<CLogFileWriter>(file, fd, maxSize, prefixes);
+}
+
+// Returns the messages of the lines in the file
+std::vector<std::string> read_lines(fz::native_string const& file)
+{
+	std::string data;
+	fz::file f(file, fz::file::reading, fz::file::existing);
+	if (f.opened()) {
+		char buf[64 * 1024];
+		int64_t read;
+		while ((read = f.read(buf, sizeof(buf))) > 0) {
+			data.append(buf, static_cast<size_t>(read));
+		}
+	}
+
+	std::vector<std::string> lines;
+	size_t start = 0;
+	size_t pos;
+	while ((pos = data.find('\n', start)) != std::string::npos) {
+		std::string line = data.substr(start, pos - start);
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		// Timestamp, process id, engine id and prefix come first
+		size_t const prefix = line.find(" T: ");
+		CPPUNIT_ASSERT(prefix != std::string::npos);
+		lines.push_back(line.substr(prefix + 4));
+
+		start = pos + 1;
+	}
+	CPPUNIT_ASSERT(start == data.size());
+
+	return lines;
+}
+
+std::wstring message(size_t thread, size_t i)
+{
+	return fz::sprintf(L"%d %d", thread, i);
+}
+}
+
+void CLogFileWriterTest::setUp()
+{
+	file_ = fz::to_native(fz::sprintf(L"logfilewritertest_%d.log", fz::random_number(0, 1000000000)));
+	for (auto & prefix : prefixes_) {
+		prefix = "T:";
+	}
+}
+
+void CLogFileWriterTest::tearDown()
+{
+	fz::remove_file(file_);
+	fz::remove_file(file_ + fzT(".1"));
+}
+
+void CLogFileWriterTest::testSingleThread()
+{
+	std::vector<std::string> expected;
+	{
+		auto writer = open_writer(file_, 0, prefixes_);
+
+		// Several times the size of the ring buffer, the logging thread has
+		// to wait for the writer thread.
+		std::wstring const padding(500, 'x');
+		for (size_t i = 0; i < 5000; ++i) {
+			std::wstring const msg = message(0, i) + padding;
+			writer->Log(MessageType::Status, 1, msg);
+			expected.push_back(fz::to_utf8(msg));
+		}
+
+		// Multi-byte characters
+		writer->Log(MessageType::Error, 2, L"äöü €");
+		expected.push_back(fz::to_utf8(L"äöü €"));
+
+		CPPUNIT_ASSERT(!writer->Failed());
+	}
+
+	CPPUNIT_ASSERT(read_lines(file_) == expected);
+
+	// A message larger than the ring buffer gets truncated
+	std::string const huge(1024 * 1024, 'y');
+	{
+		auto writer = open_writer(file_, 0, prefixes_);
+		writer->Log(MessageType::Status, 1, fz::to_wstring(huge));
+		writer->Log(MessageType::Status, 1, L"after");
+	}
+
+	auto const lines = read_lines(file_);
+	CPPUNIT_ASSERT(lines.size() == expected.size() + 2);
+	std::string const& truncated = lines[expected.size()];
+	CPPUNIT_ASSERT(!truncated.empty() && truncated.size() < huge.size());
+	CPPUNIT_ASSERT(huge.compare(0, truncated.size(), truncated) == 0);
+	CPPUNIT_ASSERT(lines.back() == "after");
+}
+
+void CLogFileWriterTest::testOrder()
+{
+	// Two threads taking turns, each line has to be written after the line
+	// of the other thread logged before it.
+	size_t const count = 2000;
+	{
+		auto writer = open_writer(file_, 0, prefixes_);
+
+		std::atomic<size_t> turn{};
+		auto const f = [&](size_t thread) {
+			for (size_t i = thread; i < count; i += 2) {
+				while (turn != i) {
+					fz::yield();
+				}
+				writer->Log(MessageType::Status, 1, message(0, i));
+				++turn;
+			}
+		};
+
+		CLogThread t0([&] { f(0); });
+		CLogThread t1([&] { f(1); });
+	}
+
+	auto const lines = read_lines(file_);
+	CPPUNIT_ASSERT(lines.size() == count);
+	for (size_t i = 0; i < lines.size(); ++i) {
+		CPPUNIT_ASSERT(lines[i] == fz::to_utf8(message(0, i)));
+	}
+}
+
+void CLogFileWriterTest::testManyThreads()
+{
+	size_t const threads = 8;
+	size_t const count = 5000;
+	{
+		auto writer = open_writer(file_, 0, prefixes_);
+
+		std::vector<std::unique_ptr<CLogThread>> logThreads;
+		for (size_t t = 0; t < threads; ++t) {
+			logThreads.push_back(std::make_unique<CLogThread>([&writer, t] {
+				for (size_t i = 0; i < count; ++i) {
+					writer->Log(MessageType::Status, static_cast<unsigned int>(t), message(t, i));
+				}
+			}));
+		}
+	}
+
+	// Every line exactly once, the lines of each thread in order
+	auto const lines = read_lines(file_);
+	CPPUNIT_ASSERT(lines.size() == threads * count);
+
+	std::vector<size_t> next(threads);
+	for (auto const& line : lines) {
+		size_t const space = line.find(' ');
+		CPPUNIT_ASSERT(space != std::string::npos);
+		size_t const t = fz::to_integral<size_t>(line.substr(0, space));
+		size_t const i = fz::to_integral<size_t>(line.substr(space + 1));
+		CPPUNIT_ASSERT(t < threads);
+		CPPUNIT_ASSERT(i == next[t]);
+		++next[t];
+	}
+	for (auto const& n : next) {
+		CPPUNIT_ASSERT(n == count);
+	}
+}
+
+void CLogFileWriterTest::testRotation()
+{
+	std::vector<std::string> before;
+	{
+		auto writer = open_writer(file_, 0, prefixes_);
+		for (size_t i = 0; i < 100; ++i) {
+			writer->Log(MessageType::Status, 1, message(0, i));
+			before.push_back(fz::to_utf8(message(0, i)));
+		}
+	}
+	CPPUNIT_ASSERT(read_lines(file_) == before);
+
+	{
+		auto writer = open_writer(file_, 1000, prefixes_);
+		writer->Log(MessageType::Status, 1, L"rotated");
+	}
+
+	auto const after = read_lines(file_);
+	CPPUNIT_ASSERT(after.size() == 1);
+	CPPUNIT_ASSERT(after[0] == "rotated");
+	CPPUNIT_ASSERT(read_lines(file_ + fzT(".1")) == before);
+
+	// No rotation below the limit
+	{
+		auto writer = open_writer(file_, 1000, prefixes_);
+		writer->Log(MessageType::Status, 1, L"appended");
+	}
+	auto const appended = read_lines(file_);
+	CPPUNIT_ASSERT(appended.size() == 2);
+	CPPUNIT_ASSERT(appended.back() == "appended");
+	CPPUNIT_ASSERT(read_lines(file_ + fzT(".1")) == before);
+}
+
+void CLogFileWriterTest::testShutdownFlush()
+{
+	std::vector<std::string> expected;
+	{
+		auto writer = open_writer(file_, 0, prefixes_);
+
+		// From a thread that has exited before the writer is destroyed
+		{
+			CLogThread t([&writer] {
+				for (size_t i = 0; i < 1000; ++i) {
+					writer->Log(MessageType::Status, 1, message(1, i));
+				}
+			});
+		}
+		for (size_t i = 0; i < 1000; ++i) {
+			expected.push_back(fz::to_utf8(message(1, i)));
+		}
+
+		// Destroyed right after logging
+		for (size_t i = 0; i < 1000; ++i) {
+			writer->Log(MessageType::Status, 1, message(0, i));
+			expected.push_back(fz::to_utf8(message(0, i)));
+		}
+	}
+
+	CPPUNIT_ASSERT(read_lines(file_) == expected);
+}
@@ -0,0 +1,182 @@
+#include <filezilla.h>
+#include "metrics.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+/*
+ * This testsuite asserts the correctness of the Prometheus text output of
+ * the metrics registry.
+ */
+
+class CMetricsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CMetricsTest);
+	CPPUNIT_TEST(testCounterAndGauge);
+	CPPUNIT_TEST(testHistogram);
+	CPPUNIT_TEST(testHeaders);
+	CPPUNIT_TEST(testWriteToFile);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testCounterAndGauge();
+	void testHistogram();
+	void testHeaders();
+	void testWriteToFile();
+
+protected:
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CMetricsTest);
+
+namespace {
+bool contains(std::string const& s, std::string const& line)
+{
+	return s.find(line + "\n") != std::string::npos;
+}
+
+size_t count(std::string const& s, std::string const& sub)
+{
+	size_t ret = 0;
+	for (size_t pos = s.find(sub); pos != std::string::npos; pos = s.find(sub, pos + 1)) {
+		++ret;
+	}
+	return ret;
+}
+
+std::string read_file(fz::native_string const& file)
+{
+	std::string ret;
+	fz::file f(file, fz::file::reading, fz::file::existing);
+	if (f.opened()) {
+		char buf[4096];
+		int64_t read;
+		while ((read = f.read(buf, sizeof(buf))) > 0) {
+			ret.append(buf, static_cast<size_t>(read));
+		}
+	}
+	return ret;
+}
+}
+
+void CMetricsTest::testCounterAndGauge()
+{
+	CMetrics metrics;
+
+	CMetricCounter & c = metrics.AddCounter("test_counter_total", "A counter");
+	c.Add();
+	c.Add(41);
+
+	// Registering again returns the same metric
+	CPPUNIT_ASSERT(&metrics.AddCounter("test_counter_total", "A counter") == &c);
+
+	CMetricGauge & g = metrics.AddGauge("test_gauge", "A gauge");
+	g.Set(5);
+	g.Add(-7);
+
+	std::string const out = metrics.Format();
+	CPPUNIT_ASSERT(contains(out, "test_counter_total 42"));
+	CPPUNIT_ASSERT(contains(out, "test_gauge -2"));
+}
+
+void CMetricsTest::testHistogram()
+{
+	CMetrics metrics;
+
+	CMetricHistogram & h = metrics.AddHistogram("test_seconds", "A histogram", {0.5, 1, 2.5});
+	h.Observe(0.25);
+	h.Observe(0.5); // Bounds are inclusive
+	h.Observe(0.75);
+	h.Observe(10);
+	h.Observe(fz::duration::from_milliseconds(2000));
+
+	// Bucket counts are cumulative, the count matches the +Inf bucket
+	std::string const out = metrics.Format();
+	CPPUNIT_ASSERT(contains(out, "test_seconds_bucket{le=\"0.5\"} 2"));
+	CPPUNIT_ASSERT(contains(out, "test_seconds_bucket{le=\"1\"} 3"));
+	CPPUNIT_ASSERT(contains(out, "test_seconds_bucket{le=\"2.5\"} 4"));
+	CPPUNIT_ASSERT(contains(out, "test_seconds_bucket{le=\"+Inf\"} 5"));
+	CPPUNIT_ASSERT(contains(out, "test_seconds_sum 13.5"));
+	CPPUNIT_ASSERT(contains(out, "test_seconds_count 5"));
+
+	// Labels are merged with the bucket label
+	CMetricHistogram & labeled = metrics.AddHistogram("test_labeled_seconds", "A labeled histogram", {1}, "direction=\"inbound\"");
+	labeled.Observe(2);
+
+	std::string const out2 = metrics.Format();
+	CPPUNIT_ASSERT(contains(out2, "test_labeled_seconds_bucket{direction=\"inbound\",le=\"1\"} 0"));
+	CPPUNIT_ASSERT(contains(out2, "test_labeled_seconds_bucket{direction=\"inbound\",le=\"+Inf\"} 1"));
+	CPPUNIT_ASSERT(contains(out2, "test_labeled_seconds_sum{direction=\"inbound\"} 2"));
+	CPPUNIT_ASSERT(contains(out2, "test_labeled_seconds_count{direction=\"inbound\"} 1"));
+}
+
+void CMetricsTest::testHeaders()
+{
+	CMetrics metrics;
+
+	metrics.AddCounter("test_lookups_total", "Lookups", "result=\"hit\"").Add(3);
+	metrics.AddCounter("test_lookups_total", "Lookups", "result=\"miss\"").Add(1);
+	metrics.AddHistogram("test_wait_seconds", "Waits", {1}, "direction=\"inbound\"");
+	metrics.AddHistogram("test_wait_seconds", "Waits", {1}, "direction=\"outbound\"");
+
+	std::string const out = metrics.Format();
+
+	// HELP and TYPE once per name, followed by all of its series
+	CPPUNIT_ASSERT(count(out, "# HELP test_lookups_total ") == 1);
+	CPPUNIT_ASSERT(count(out, "# TYPE test_lookups_total ") == 1);
+	CPPUNIT_ASSERT(contains(out, "# HELP test_lookups_total Lookups\n# TYPE test_lookups_total counter\ntest_lookups_total{result=\"hit\"} 3\ntest_lookups_total{result=\"miss\"} 1"));
+
+	CPPUNIT_ASSERT(count(out, "# HELP test_wait_seconds ") == 1);
+	CPPUNIT_ASSERT(count(out, "# TYPE test_wait_seconds histogram\n") == 1);
+	CPPUNIT_ASSERT(count(out, "test_wait_seconds_count{") == 2);
+
+	// The same holds for the metrics registered by the engine
+	CPPUNIT_ASSERT(count(out, "# HELP filezilla_ratelimit_wait_seconds ") == 1);
+	CPPUNIT_ASSERT(count(out, "# TYPE filezilla_ratelimit_waits_total counter\n") == 1);
+
+	// Every series belongs to the preceding TYPE line
+	std::string type;
+	size_t start = 0;
+	size_t pos;
+	while ((pos = out.find('\n', start)) != std::string::npos) {
+		std::string const line = out.substr(start, pos - start);
+		start = pos + 1;
+
+		if (!line.compare(0, 7, "# TYPE ")) {
+			type = line.substr(7, line.find(' ', 7) - 7);
+		}
+		else if (line[0] != '#') {
+			CPPUNIT_ASSERT(!type.empty());
+			CPPUNIT_ASSERT(!line.compare(0, type.size(), type));
+		}
+	}
+	CPPUNIT_ASSERT(start == out.size());
+}
+
+void CMetricsTest::testWriteToFile()
+{
+	fz::native_string const file = fz::to_native(fz::sprintf(L"metricstest_%d.prom", fz::random_number(0, 1000000000)));
+
+	CMetrics metrics;
+	CMetricCounter & c = metrics.AddCounter("test_counter_total", "A counter");
+
+	CPPUNIT_ASSERT(metrics.WriteToFile(file));
+	CPPUNIT_ASSERT(read_file(file) == metrics.Format());
+
+	// Replaces the previous contents, no temporary file left behind
+	c.Add(1000);
+	CPPUNIT_ASSERT(metrics.WriteToFile(file));
+	std::string const data = read_file(file);
+	CPPUNIT_ASSERT(data == metrics.Format());
+	CPPUNIT_ASSERT(contains(data, "test_counter_total 1000"));
+	CPPUNIT_ASSERT(fz::local_filesys::get_file_type(file + fzT(".tmp")) == fz::local_filesys::unknown);
+
+	CPPUNIT_ASSERT(fz::remove_file(file));
+
+	// Directory does not exist
+	CPPUNIT_ASSERT(!metrics.WriteToFile(fz::to_native(L"metricstest_nonexisting_dir/metrics.prom")));
+}
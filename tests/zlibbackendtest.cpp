@@ -0,0 +1,329 @@
+#include <filezilla.h>
+#include "ftp/zlibbackend.h"
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <string.h>
+
+/*
+ * This testsuite asserts the correctness of the MODE Z stream wrapper
+ * around the backend of FTP data connections.
+ */
+
+class CZlibBackendTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CZlibBackendTest);
+	CPPUNIT_TEST(testRoundTrip);
+	CPPUNIT_TEST(testPartialWrites);
+	CPPUNIT_TEST(testFinish);
+	CPPUNIT_TEST(testInflateErrors);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testRoundTrip();
+	void testPartialWrites();
+	void testFinish();
+	void testInflateErrors();
+
+protected:
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CZlibBackendTest);
+
+namespace {
+// In-memory stand-in for the socket backend. Writes are accepted up to
+// a budget, reads hand out the input in chunks of limited size.
+class CMemoryBackend final : public CBackend
+{
+public:
+	CMemoryBackend()
+		: CBackend(nullptr)
+	{}
+
+	virtual int Read(void *buffer, unsigned int size, int& error) override
+	{
+		if (readOffset_ == in_.size()) {
+			if (eof_) {
+				return 0;
+			}
+			error = EAGAIN;
+			return -1;
+		}
+
+		size_t len = std::min({static_cast<size_t>(size), readChunk_, in_.size() - readOffset_});
+		memcpy(buffer, in_.data() + readOffset_, len);
+		readOffset_ += len;
+		return static_cast<int>(len);
+	}
+
+	virtual int Peek(void *, unsigned int, int& error) override
+	{
+		error = EINVAL;
+		return -1;
+	}
+
+	virtual int Write(const void *buffer, unsigned int size, int& error) override
+	{
+		if (!writeBudget_) {
+			error = EAGAIN;
+			return -1;
+		}
+
+		size_t len = std::min(static_cast<size_t>(size), writeBudget_);
+		writeBudget_ -= len;
+		out_.append(static_cast<char const*>(buffer), len);
+		return static_cast<int>(len);
+	}
+
+	std::string in_;
+	size_t readOffset_{};
+	size_t readChunk_{static_cast<size_t>(-1)};
+	bool eof_{true};
+
+	std::string out_;
+	size_t writeBudget_{static_cast<size_t>(-1)};
+
+protected:
+	virtual void OnRateAvailable(CRateLimiter::rate_direction) override {}
+};
+
+// Compressible, but not trivially so
+std::string make_data(size_t size)
+{
+	std::string data;
+	data.reserve(size);
+	unsigned int v = 1;
+	while (data.size() < size) {
+		v = v * 1103515245 + 12345;
+		data += fz::sprintf("line %d: value %d\n", data.size() / 20, (v >> 16) % 1000);
+	}
+	data.resize(size);
+	return data;
+}
+
+// Writes all of the data, the next backend must not block
+void deflate_all(CZlibBackend & zlib, std::string const& data)
+{
+	size_t offset = 0;
+	while (offset < data.size()) {
+		int error = 0;
+		int written = zlib.Write(data.data() + offset, static_cast<unsigned int>(data.size() - offset), error);
+		CPPUNIT_ASSERT(written > 0);
+		offset += written;
+	}
+}
+
+std::string inflate_all(std::string const& compressed, size_t readChunk, size_t bufferSize)
+{
+	CMemoryBackend next;
+	next.in_ = compressed;
+	next.readChunk_ = readChunk;
+
+	CZlibBackend zlib(nullptr, next, false, 0);
+
+	std::string out;
+	std::vector<char> buffer(bufferSize);
+	while (true) {
+		int error = 0;
+		int read = zlib.Read(buffer.data(), static_cast<unsigned int>(buffer.size()), error);
+		CPPUNIT_ASSERT(read >= 0);
+		if (!read) {
+			break;
+		}
+		out.append(buffer.data(), read);
+	}
+
+	CPPUNIT_ASSERT(zlib.GetCompressedBytes() <= static_cast<int64_t>(compressed.size()));
+	CPPUNIT_ASSERT(zlib.GetUncompressedBytes() == static_cast<int64_t>(out.size()));
+	return out;
+}
+}
+
+void CZlibBackendTest::testRoundTrip()
+{
+	std::string const data = make_data(1024 * 1024 + 17);
+
+	CMemoryBackend next;
+	CZlibBackend zlib(nullptr, next, true, 6);
+
+	size_t offset = 0;
+	size_t chunk = 1;
+	while (offset < data.size()) {
+		unsigned int const len = static_cast<unsigned int>(std::min(chunk, data.size() - offset));
+		int error = 0;
+		int written = zlib.Write(data.data() + offset, len, error);
+		CPPUNIT_ASSERT(written == static_cast<int>(len));
+		offset += written;
+		chunk = chunk * 3 + 1;
+		if (chunk > 100000) {
+			chunk = 1;
+		}
+	}
+	CPPUNIT_ASSERT(zlib.Finish() == 0);
+
+	CPPUNIT_ASSERT(zlib.GetUncompressedBytes() == static_cast<int64_t>(data.size()));
+	CPPUNIT_ASSERT(zlib.GetCompressedBytes() == static_cast<int64_t>(next.out_.size()));
+	CPPUNIT_ASSERT(next.out_.size() < data.size() / 2);
+
+	CPPUNIT_ASSERT(inflate_all(next.out_, static_cast<size_t>(-1), 64 * 1024) == data);
+
+	// Compressed data trickling in, small reads
+	CPPUNIT_ASSERT(inflate_all(next.out_, 7, 1000) == data);
+	CPPUNIT_ASSERT(inflate_all(next.out_, 1, 1) == data);
+
+	// Empty stream
+	CMemoryBackend emptyNext;
+	CZlibBackend empty(nullptr, emptyNext, true, 0);
+	CPPUNIT_ASSERT(empty.Finish() == 0);
+	CPPUNIT_ASSERT(!emptyNext.out_.empty());
+	CPPUNIT_ASSERT(inflate_all(emptyNext.out_, static_cast<size_t>(-1), 100).empty());
+}
+
+void CZlibBackendTest::testPartialWrites()
+{
+	std::string const data = make_data(512 * 1024);
+
+	CMemoryBackend next;
+	next.writeBudget_ = 0;
+	CZlibBackend zlib(nullptr, next, true, 1);
+
+	// The input is taken even if the next backend would block, the
+	// compressed data stays pending.
+	int error = 0;
+	CPPUNIT_ASSERT(zlib.Write(data.data(), 100, error) == 100);
+	CPPUNIT_ASSERT(next.out_.empty());
+
+	size_t offset = 100;
+	int blocked = 0;
+	while (offset < data.size()) {
+		unsigned int const len = static_cast<unsigned int>(std::min(size_t(4096), data.size() - offset));
+		error = 0;
+		int written = zlib.Write(data.data() + offset, len, error);
+		if (written < 0) {
+			// Pending data could not be flushed, nothing taken
+			CPPUNIT_ASSERT(error == EAGAIN);
+			++blocked;
+			next.writeBudget_ = 1000;
+			continue;
+		}
+		CPPUNIT_ASSERT(written == static_cast<int>(len));
+		offset += written;
+	}
+	CPPUNIT_ASSERT(blocked > 0);
+
+	int finished;
+	while ((finished = zlib.Finish()) == EAGAIN) {
+		next.writeBudget_ = 1000;
+	}
+	CPPUNIT_ASSERT(finished == 0);
+
+	CPPUNIT_ASSERT(zlib.GetCompressedBytes() == static_cast<int64_t>(next.out_.size()));
+	CPPUNIT_ASSERT(inflate_all(next.out_, static_cast<size_t>(-1), 64 * 1024) == data);
+}
+
+void CZlibBackendTest::testFinish()
+{
+	std::string const data = make_data(256 * 1024);
+
+	CMemoryBackend next;
+	CZlibBackend zlib(nullptr, next, true, 9);
+
+	deflate_all(zlib, data);
+
+	// Finish only reports success once everything has been handed to the
+	// next backend, only then may the TLS layer below be shut down.
+	size_t const written = next.out_.size();
+	next.writeBudget_ = 10;
+	CPPUNIT_ASSERT(zlib.Finish() == EAGAIN);
+	CPPUNIT_ASSERT(next.out_.size() == written + 10);
+
+	std::string partial = next.out_;
+	next.writeBudget_ = 0;
+	CPPUNIT_ASSERT(zlib.Finish() == EAGAIN);
+	CPPUNIT_ASSERT(next.out_ == partial);
+
+	next.writeBudget_ = static_cast<size_t>(-1);
+	CPPUNIT_ASSERT(zlib.Finish() == 0);
+	CPPUNIT_ASSERT(inflate_all(next.out_, static_cast<size_t>(-1), 64 * 1024) == data);
+
+	// Called again while the TLS shutdown is pending, nothing more gets written
+	std::string const complete = next.out_;
+	CPPUNIT_ASSERT(zlib.Finish() == 0);
+	CPPUNIT_ASSERT(next.out_ == complete);
+
+	// No more writes after the end of the stream
+	int error = 0;
+	CPPUNIT_ASSERT(zlib.Write(data.data(), 10, error) == -1);
+	CPPUNIT_ASSERT(error == EINVAL);
+
+	// Wrong direction
+	CPPUNIT_ASSERT(zlib.Read(&partial[0], 1, error) == -1);
+	CPPUNIT_ASSERT(error == EINVAL);
+}
+
+void CZlibBackendTest::testInflateErrors()
+{
+	std::string const data = make_data(100 * 1024);
+
+	CMemoryBackend deflateNext;
+	CZlibBackend deflater(nullptr, deflateNext, true, 6);
+	deflate_all(deflater, data);
+	CPPUNIT_ASSERT(deflater.Finish() == 0);
+	std::string const compressed = deflateNext.out_;
+
+	int error = 0;
+	char buffer[4096];
+
+	// Would block while waiting for more compressed data
+	{
+		CMemoryBackend next;
+		next.in_ = compressed.substr(0, compressed.size() / 2);
+		next.eof_ = false;
+		CZlibBackend zlib(nullptr, next, false, 0);
+
+		int read;
+		while ((read = zlib.Read(buffer, sizeof(buffer), error)) > 0) {
+		}
+		CPPUNIT_ASSERT(read == -1);
+		CPPUNIT_ASSERT(error == EAGAIN);
+
+		// Rest arrives
+		next.in_ = compressed;
+		next.eof_ = true;
+		while ((read = zlib.Read(buffer, sizeof(buffer), error)) > 0) {
+		}
+		CPPUNIT_ASSERT(read == 0);
+		CPPUNIT_ASSERT(zlib.GetUncompressedBytes() == static_cast<int64_t>(data.size()));
+	}
+
+	// Connection closed in the middle of the stream
+	{
+		CMemoryBackend next;
+		next.in_ = compressed.substr(0, compressed.size() - 10);
+		CZlibBackend zlib(nullptr, next, false, 0);
+
+		int read;
+		while ((read = zlib.Read(buffer, sizeof(buffer), error)) > 0) {
+		}
+		CPPUNIT_ASSERT(read == -1);
+		CPPUNIT_ASSERT(error == EPROTO);
+	}
+
+	// Not a zlib stream
+	{
+		CMemoryBackend next;
+		next.in_ = data;
+		CZlibBackend zlib(nullptr, next, false, 0);
+
+		CPPUNIT_ASSERT(zlib.Read(buffer, sizeof(buffer), error) == -1);
+		CPPUNIT_ASSERT(error == EPROTO);
+	}
+
+	// Trailing data after the end of the stream is ignored
+	CPPUNIT_ASSERT(inflate_all(compressed + "garbage", static_cast<size_t>(-1), 64 * 1024) == data);
+}